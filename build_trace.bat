@@ -0,0 +1,18 @@
+@echo off
+
+REM Change this to your visual studio's 'vcvars64.bat' script path
+set MSVC_PATH="C:\Program Files (x86)\Microsoft Visual Studio\2019\Community\VC\Auxiliary\Build"
+
+set CXXFLAGS=/std:c++17 /EHsc /W4 /WX /FC /MT /wd4996 /wd4201 /nologo /O2 /DNDEBUG %*
+set INCLUDES=/I"deps\include"
+
+call %MSVC_PATH%\vcvars64.bat
+
+pushd %~dp0
+if not exist .\build mkdir build
+cl %CXXFLAGS% %INCLUDES% "code\trace_tool.cpp" /Fo:build\ /Fe:build\maidai-trace.exe /link /SUBSYSTEM:CONSOLE
+
+cd build
+del *.obj
+cd ..
+popd
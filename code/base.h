@@ -0,0 +1,15 @@
+#ifndef BASE_H
+#define BASE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UNUSED(x) ((void)(x))
+#define ARR_SZ(arr) (sizeof(arr)/sizeof(arr[0]))
+
+#define CACHE_LINE_SIZE 64
+
+#define internal static
+#define global static
+
+#endif // BASE_H
@@ -0,0 +1,787 @@
+// @Note: Microbenchmarks for the MIDI input -> key output hot path.
+// Results are written as JSON (default: bench.json) so runs across versions
+// can be diffed by a script instead of by eye.
+//
+// Usage: maidai_bench.exe [output.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+#include "./base.h"
+#include "./vk.h"
+#include "./timer.h"
+#include "./midi.h"
+#include "./config.h"
+#include "./config_text.h"
+#include "./queue.h"
+#include "./log.h"
+#include "./receive.h"
+#include "./filter.h"
+#include "./strum.h"
+#include "./timer_wheel.h"
+#include "./trace.h"
+#include "./note_roll.h"
+#include "./pipeline.h"
+#include "./smf.h"
+#include "./octave.h"
+#include "./voice.h"
+#include "./timeline.h"
+#include "./library.h"
+
+#define BENCH_EVENTS (1 << 16)
+#define BENCH_RUNS 15
+#define BENCH_RESULTS_CAP 128
+#define BENCH_DEFAULT_OUTPUT "bench.json"
+#define BENCH_TEXT_PROFILES 1000
+#define BENCH_SONGS 64
+
+struct Bench_Result {
+    const char *name;
+    const char *pattern;
+    int producers;
+    size_t events;
+    double best_ns;
+    double median_ns;
+};
+
+struct Bench_Pattern {
+    const char *name;
+    std::vector<uint32_t> messages;
+};
+
+global Mapping_Table bench_table;
+global Bench_Result results[BENCH_RESULTS_CAP];
+global size_t results_len = 0;
+
+// @Note: Results get folded into this so the compiler can't drop the work.
+global volatile uint64_t bench_sink = 0;
+
+internal uint32_t bench_pack(int status, int note, int velocity)
+{
+    return((uint32_t) (status | (note << 8) | (velocity << 16)));
+}
+
+// @Note: xorshift, we only need something cheap and reproducible.
+internal uint32_t bench_random(uint32_t *seed)
+{
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+
+    return(x);
+}
+
+internal Bench_Pattern make_random_pattern()
+{
+    Bench_Pattern pattern = { "random", {} };
+    uint32_t seed = 0x6d616964;
+
+    while (pattern.messages.size() < BENCH_EVENTS) {
+        int note = NOTE_OFFSET + (int) (bench_random(&seed) % MIDI_FULL_LEN);
+        int velocity = 1 + (int) (bench_random(&seed) % 127);
+        pattern.messages.push_back(bench_pack(NOTE_ON, note, velocity));
+        pattern.messages.push_back(bench_pack(NOTE_OFF, note, 0));
+    }
+
+    return(pattern);
+}
+
+// @Note: Run up and down the whole keyboard plus a bit outside of it,
+// so the out-of-range branch gets exercised too.
+internal Bench_Pattern make_glissando_pattern()
+{
+    Bench_Pattern pattern = { "glissando", {} };
+    int note = NOTE_OFFSET - 4;
+    int direction = 1;
+
+    while (pattern.messages.size() < BENCH_EVENTS) {
+        pattern.messages.push_back(bench_pack(NOTE_ON, note, 100));
+        pattern.messages.push_back(bench_pack(NOTE_OFF, note, 0));
+
+        note += direction;
+        if (note >= NOTE_OFFSET + MIDI_FULL_LEN + 4 || note <= NOTE_OFFSET - 4) {
+            direction = -direction;
+        }
+    }
+
+    return(pattern);
+}
+
+internal Bench_Pattern make_chord_pattern()
+{
+    Bench_Pattern pattern = { "chord10", {} };
+    const int chord[10] = { 0, 4, 7, 11, 12, 14, 16, 19, 23, 24 };
+    int root = 0;
+
+    while (pattern.messages.size() < BENCH_EVENTS) {
+        for (size_t i = 0; i < ARR_SZ(chord); ++i) {
+            pattern.messages.push_back(bench_pack(NOTE_ON, NOTE_OFFSET + root + chord[i], 90));
+        }
+        
+        for (size_t i = 0; i < ARR_SZ(chord); ++i) {
+            pattern.messages.push_back(bench_pack(NOTE_OFF, NOTE_OFFSET + root + chord[i], 0));
+        }
+
+        root = (root + 1) % (MIDI_FULL_LEN - 24);
+    }
+
+    return(pattern);
+}
+
+// @Note: What a controller with a running clock looks like, a 0xF8 between
+// every couple of notes and the odd active sensing byte.
+internal Bench_Pattern make_clocked_pattern()
+{
+    Bench_Pattern pattern = { "clocked", {} };
+    uint32_t seed = 0x636c6b;
+
+    while (pattern.messages.size() < BENCH_EVENTS) {
+        int note = NOTE_OFFSET + (int) (bench_random(&seed) % MIDI_FULL_LEN);
+        pattern.messages.push_back(bench_pack(NOTE_ON, note, 100));
+        pattern.messages.push_back(0xF8);
+        pattern.messages.push_back(0xF8);
+        pattern.messages.push_back(bench_pack(NOTE_OFF, note, 0));
+        pattern.messages.push_back(0xF8);
+        
+        if (bench_random(&seed) % 8 == 0) pattern.messages.push_back(0xFE);
+    }
+
+    return(pattern);
+}
+
+internal Config make_bench_config()
+{
+    Config config = {0};
+    strncpy(config.name, "Bench", CONFIG_NAME_LEN);
+    
+    const char *keys = "QWERTYUASDFGHJZXCVBNM1234567890ASDFGHJKL";
+    for (size_t i = 0; i < MIDI_FULL_LEN; ++i) {
+        config.keys_map[i] = keys[i];
+        config.layers[1][i] = KEY_COMBO(keys[i], KEY_MOD_SHIFT);
+    }
+
+    // @Note: One layer with its own keys, one that falls back, like a real profile would.
+    config.velocity_thresholds[0] = 64;
+    config.velocity_thresholds[1] = 110;
+    config_build_table(&config, &bench_table);
+
+    return(config);
+}
+
+typedef uint64_t (*Bench_Proc)(const Bench_Pattern *pattern, const Config *config);
+
+internal uint64_t bench_decode(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    uint64_t acc = 0;
+    
+    for (uint32_t packed : pattern->messages) {
+        Midi_Message message = midi_decode(packed);
+        acc += message.status + message.note + message.velocity;
+    }
+
+    return(acc);
+}
+
+internal uint64_t bench_receive_filter(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    static Receive_Filter filter;
+    receive_filter_set(&filter, DEFAULT_RECEIVE_DROP);
+    uint64_t acc = 0;
+    
+    for (uint32_t packed : pattern->messages) {
+        acc += receive_filter_accept(&filter, packed);
+    }
+
+    return(acc);
+}
+
+internal uint64_t bench_note_offset(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    uint64_t acc = 0;
+    
+    for (uint32_t packed : pattern->messages) {
+        Midi_Message message = midi_decode(packed);
+        acc += midi_note_to_index(message.note, NOTE_OFFSET);
+    }
+
+    return(acc);
+}
+
+internal uint64_t bench_keys_map_lookup(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    uint64_t acc = 0;
+    
+    for (uint32_t packed : pattern->messages) {
+        Midi_Message message = midi_decode(packed);
+        int index = midi_note_to_index(message.note, NOTE_OFFSET);
+        
+        if (message.status == NOTE_ON && index != -1) {
+            acc += mapping_lookup_key(&bench_table, index, message.velocity);
+        }
+    }
+
+    return(acc);
+}
+
+// @Note: Turning a mapped key (maybe a combo) into the key events that go
+// on the wheel, and taking them back off.
+internal uint64_t bench_modifier_sequence(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    static Pipeline pipeline = {0};
+    static uint64_t time_ns = 0;
+    static bool initialized = false;
+    
+    if (!initialized) {
+        pipeline_init(&pipeline, time_ns);
+        initialized = true;
+    }
+
+    Pipeline_Settings settings = default_pipeline_settings();
+    uint64_t acc = 0;
+    Key_Event key = {0};
+    
+    for (uint32_t packed : pattern->messages) {
+        Midi_Message message = midi_decode(packed);
+        int index = midi_note_to_index(message.note, NOTE_OFFSET);
+        if (message.status != NOTE_ON || index == -1) continue;
+        
+        time_ns += 1000000;
+        pipeline_schedule_tap(&pipeline, mapping_lookup_key(&bench_table, index, message.velocity), time_ns, index);
+
+        while (pipeline_pop_due(&pipeline, &settings, time_ns, &key)) {
+            acc += key.vk;
+        }
+    }
+
+    return(acc);
+}
+
+internal uint64_t bench_note_filter(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    static Note_Filter filter = {0};
+    Note_Filter_Settings settings = { 5, 40, RETRIGGER_DELAY };
+    
+    uint64_t acc = 0;
+    uint64_t time_ns = 0;
+    
+    for (uint32_t packed : pattern->messages) {
+        Midi_Message message = midi_decode(packed);
+        uint64_t due_ns = 0;
+        
+        time_ns += 1000000;
+        acc += note_filter_apply(&filter, &settings, &message, time_ns, &due_ns);
+    }
+
+    return(acc);
+}
+
+// @Note: Everything the injection thread does per event, short of SendInput.
+internal uint64_t bench_pipeline(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    static Pipeline pipeline = {0};
+    static uint64_t time_ns = 0;
+    static bool initialized = false;
+    
+    if (!initialized) {
+        pipeline_init(&pipeline, time_ns);
+        initialized = true;
+    }
+    
+    Pipeline_Settings settings = default_pipeline_settings();
+    uint64_t acc = 0;
+    Midi_Event event = {0};
+    Key_Event key = {0};
+    
+    for (uint32_t packed : pattern->messages) {
+        time_ns += 1000000;
+        event.time_ns = time_ns;
+        event.packed = packed;
+        pipeline_process(&pipeline, &bench_table, &settings, &event);
+        pipeline_update(&pipeline, &settings, time_ns);
+
+        while (pipeline_pop_due(&pipeline, &settings, time_ns, &key)) {
+            acc += key.vk;
+        }
+    }
+
+    return(acc);
+}
+
+// @Note: Keeps a few thousand key events pending at all times, spread up
+// to a couple of seconds out, like a strummed/paced passage would.
+internal uint64_t bench_timer_wheel(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    static Timer_Wheel wheel;
+    static uint64_t time_ns = 0;
+    static bool initialized = false;
+    
+    if (!initialized) {
+        timer_wheel_init(&wheel, time_ns);
+        initialized = true;
+    }
+
+    uint64_t acc = 0;
+    uint32_t seed = 0x77686c;
+    Key_Event event = {0};
+    
+    for (uint32_t packed : pattern->messages) {
+        time_ns += 500000;
+        
+        event.time_ns = time_ns + (bench_random(&seed) % 2000)*1000000ull;
+        event.vk = (uint16_t) (packed >> 8);
+        timer_wheel_insert(&wheel, event);
+
+        timer_wheel_advance(&wheel, time_ns);
+        while (timer_wheel_peek_ready(&wheel)) {
+            timer_wheel_pop_ready(&wheel, &event);
+            acc += event.vk;
+        }
+    }
+
+    return(acc);
+}
+
+// @Note: The whole pattern as one song, planned at once like a file would be.
+// Per event, note offs included, so it lines up with the rest.
+internal uint64_t bench_octave_assign(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    static std::vector<Octave_Note> notes;
+    static std::vector<int8_t> shifts;
+    notes.clear();
+
+    for (uint32_t packed : pattern->messages) {
+        Midi_Message message = midi_decode(packed);
+        if (message.status == NOTE_ON) notes.push_back({ message.note, message.velocity });
+    }
+
+    shifts.resize(notes.size() + 1);
+    octave_assign(notes.data(), notes.size(), &bench_table, shifts.data());
+
+    uint64_t acc = 0;
+    for (size_t i = 0; i < notes.size(); ++i) acc += (uint64_t) (shifts[i] + OCTAVE_SHIFT_RANGE);
+
+    return(acc);
+}
+
+// @Note: Every three messages share a time so chords have something to resolve.
+internal uint64_t bench_voice_reduce(const Bench_Pattern *pattern, const Config *config)
+{
+    UNUSED(config);
+    Voice_Reducer reducer;
+    voice_init(&reducer, VOICE_HIGHEST, 0);
+
+    Voice_Out out[VOICE_OUT_LEN];
+    uint64_t acc = 0;
+
+    for (size_t i = 0; i < pattern->messages.size(); ++i) {
+        Midi_Message message = midi_decode(pattern->messages[i]);
+        Voice_Note note = { 0, message.note, message.velocity, message.channel, (uint8_t) (i & 3) };
+
+        int count = voice_push(&reducer, (i/3)*1000000, pattern->messages[i], &note, out);
+        for (int j = 0; j < count; ++j) acc += out[j].packed;
+    }
+    acc += (uint64_t) voice_flush(&reducer, out);
+
+    return(acc);
+}
+
+internal void bench_put_varlen(std::vector<uint8_t> *out, uint32_t value)
+{
+    uint8_t bytes[4];
+    int len = 0;
+    do {
+        bytes[len++] = (uint8_t) (value & 0x7F);
+        value >>= 7;
+    } while (value);
+
+    while (len-- > 0) out->push_back((uint8_t) (bytes[len] | (len ? 0x80 : 0)));
+}
+
+internal void bench_put_u32(std::vector<uint8_t> *out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8) out->push_back((uint8_t) (value >> shift));
+}
+
+// @Note: A format 1 file shaped like a piano arrangement: a melody, a second
+// voice under it, block chords and a bass line, each on its own track and
+// all overlapping. Stands in for a song library, the repo doesn't ship one.
+internal std::vector<uint8_t> make_bench_song(uint32_t *seed)
+{
+    std::vector<uint8_t> file = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 4, 0x01, 0xE0 };
+    const int steps[] = { 240, 120, 480 }; // @Note: In ticks, 480 a beat.
+    const int bars = 48;
+
+    for (int track = 0; track < 4; ++track) {
+        std::vector<uint8_t> body;
+        if (track == 0) {
+            const uint8_t tempo[] = { 0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20 };
+            body.insert(body.end(), tempo, tempo + sizeof(tempo));
+        }
+
+        int note = 60 - track*7;
+        for (int tick = 0, delta = 0; tick < bars*1920;) {
+            int step = track == 2 ? 960 : steps[bench_random(seed) % 3];
+            int voices = track == 2 ? 3 : 1;
+            note += (int) (bench_random(seed) % 7) - 3;
+            if (note < 24 || note > 100) note = 60 - track*7;
+            int velocity = 40 + (int) (bench_random(seed) % 80);
+
+            for (int v = 0; v < voices; ++v) {
+                bench_put_varlen(&body, v == 0 ? (uint32_t) delta : 0);
+                body.push_back((uint8_t) (NOTE_ON | track));
+                body.push_back((uint8_t) (note + v*4));
+                body.push_back((uint8_t) velocity);
+            }
+            for (int v = 0; v < voices; ++v) {
+                bench_put_varlen(&body, v == 0 ? (uint32_t) (step - step/8) : 0);
+                body.push_back((uint8_t) (NOTE_OFF | track));
+                body.push_back((uint8_t) (note + v*4));
+                body.push_back(0);
+            }
+
+            delta = step/8;
+            tick += step;
+        }
+
+        const uint8_t end[] = { 0x00, 0xFF, 0x2F, 0x00 };
+        body.insert(body.end(), end, end + sizeof(end));
+
+        const uint8_t chunk[] = { 'M', 'T', 'r', 'k' };
+        file.insert(file.end(), chunk, chunk + sizeof(chunk));
+        bench_put_u32(&file, (uint32_t) body.size());
+        file.insert(file.end(), body.begin(), body.end());
+    }
+
+    return(file);
+}
+
+internal void bench_push_result(Bench_Result result)
+{
+    assert(results_len < BENCH_RESULTS_CAP);
+    results[results_len++] = result;
+
+    printf("%-24s %-10s producers=%d  best %8.2f ns/event  median %8.2f ns/event\n",
+           result.name, result.pattern, result.producers, result.best_ns, result.median_ns);
+}
+
+internal void bench_run(const char *name, Bench_Proc proc, const Bench_Pattern *pattern, const Config *config)
+{
+    double samples[BENCH_RUNS] = {0};
+    size_t events = pattern->messages.size();
+
+    // @Note: Warm up caches and branch predictors first.
+    bench_sink = bench_sink + proc(pattern, config);
+    
+    for (size_t i = 0; i < BENCH_RUNS; ++i) {
+        uint64_t start = get_time_ns();
+        bench_sink = bench_sink + proc(pattern, config);
+        uint64_t end = get_time_ns();
+
+        samples[i] = (double) (end - start) / (double) events;
+    }
+
+    std::sort(samples, samples + BENCH_RUNS);
+
+    Bench_Result result = {0};
+    result.name = name;
+    result.pattern = pattern->name;
+    result.producers = 1;
+    result.events = events;
+    result.best_ns = samples[0];
+    result.median_ns = samples[BENCH_RUNS/2];
+    bench_push_result(result);
+}
+
+// @Note: A text file with BENCH_TEXT_PROFILES profiles shaped like a
+// real one (every note mapped, a Shift layer on top, a couple of controls),
+// parsed from memory the same way a mapped file would be. Reported per
+// profile, and checked to round trip.
+internal void bench_run_config_text()
+{
+    static Config configs[BENCH_TEXT_PROFILES];
+    static Config parsed[BENCH_TEXT_PROFILES];
+    uint32_t seed = 0x74657874;
+
+    for (size_t i = 0; i < BENCH_TEXT_PROFILES; ++i) {
+        Config *config = &configs[i];
+        snprintf(config->name, CONFIG_NAME_LEN, "Profile %zu", i);
+        config->velocity_thresholds[0] = 64;
+        config->velocity_thresholds[1] = 110;
+
+        for (size_t note = 0; note < MIDI_FULL_LEN; ++note) {
+            int vk = 1 + (int) (bench_random(&seed) % 255);
+            config->keys_map[note] = vk;
+            config->layers[0][note] = KEY_COMBO(vk, KEY_MOD_SHIFT);
+        }
+
+        config->controls[0] = { CONTROL_CC, 1, 64, 8, ACTION_OCTAVE_UP, 0 };
+        config->controls[1] = { CONTROL_CC, 64, 64, 8, ACTION_KEY, KEY_COMBO(0x20, KEY_MOD_CTRL) };
+    }
+
+    std::vector<char> text(BENCH_TEXT_PROFILES*8192);
+    size_t text_len = config_text_write(configs, BENCH_TEXT_PROFILES, text.data(), text.size());
+    assert(text_len > 0);
+
+    double samples[BENCH_RUNS] = {0};
+    Config_Text_Result parse = config_text_parse(text.data(), text_len, parsed, BENCH_TEXT_PROFILES);
+
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        uint64_t start = get_time_ns();
+        parse = config_text_parse(text.data(), text_len, parsed, BENCH_TEXT_PROFILES);
+        uint64_t end = get_time_ns();
+
+        samples[run] = (double) (end - start) / (double) BENCH_TEXT_PROFILES;
+    }
+
+    if (parse.profiles != BENCH_TEXT_PROFILES || parse.errors != 0 || memcmp(configs, parsed, sizeof(configs)) != 0) {
+        fprintf(stderr, "config_text: round trip failed (%zu profiles, %zu errors, first on line %d)\n",
+                parse.profiles, parse.errors, parse.first_error_line);
+    }
+
+    std::sort(samples, samples + BENCH_RUNS);
+
+    Bench_Result result = {0};
+    result.name = "config_text_parse";
+    result.pattern = "profiles";
+    result.producers = 1;
+    result.events = BENCH_TEXT_PROFILES;
+    result.best_ns = samples[0];
+    result.median_ns = samples[BENCH_RUNS/2];
+    bench_push_result(result);
+
+    printf("%zu profiles, %.1f KB of text, %.2f ms per file\n", (size_t) BENCH_TEXT_PROFILES, text_len/1024.0,
+           result.median_ns*BENCH_TEXT_PROFILES/1e6);
+}
+
+// @Note: BENCH_SONGS files read from memory and reduced to one voice the way
+// the compiler does it, per MIDI event in the files (the reading included,
+// the extra pass VOICE_LONGEST needs too).
+internal void bench_run_voice_corpus()
+{
+    std::vector<std::vector<uint8_t>> songs;
+    uint32_t seed = 0x766F6963;
+    for (int i = 0; i < BENCH_SONGS; ++i) songs.push_back(make_bench_song(&seed));
+
+    size_t events = 0;
+    Timeline_Options options = default_timeline_options();
+    static Timeline_Source source;
+    for (const std::vector<uint8_t> &song : songs) {
+        timeline_source_open(&source, song.data(), song.size(), &options, 0, 0);
+        Voice_Out event;
+        while (timeline_source_next(&source, &event)) events += 1;
+    }
+
+    for (int mode = VOICE_HIGHEST; mode < VOICE_MODE_COUNT; ++mode) {
+        double samples[BENCH_RUNS] = {0};
+        size_t kept = 0;
+        options.voice = mode;
+        options.voice_track = 1;
+
+        for (size_t run = 0; run < BENCH_RUNS; ++run) {
+            kept = 0;
+            uint64_t start = get_time_ns();
+
+            for (const std::vector<uint8_t> &song : songs) {
+                uint64_t *durations = 0;
+                if (!timeline_source_prepare(&source, song.data(), song.size(), &options, &durations)) continue;
+
+                Voice_Out event;
+                while (timeline_source_next(&source, &event)) kept += 1;
+                free(durations);
+            }
+
+            uint64_t end = get_time_ns();
+            samples[run] = (double) (end - start) / (double) events;
+        }
+
+        std::sort(samples, samples + BENCH_RUNS);
+
+        Bench_Result result = {0};
+        result.name = "voice_corpus";
+        result.pattern = voice_mode_names[mode];
+        result.producers = 1;
+        result.events = events;
+        result.best_ns = samples[0];
+        result.median_ns = samples[BENCH_RUNS/2];
+        bench_push_result(result);
+
+        printf("%d songs, %zu of %zu events kept\n", BENCH_SONGS, kept, events);
+    }
+}
+
+// @Note: What a library scan does per file once it's read, reported per song.
+internal void bench_run_library_analyze()
+{
+    std::vector<std::vector<uint8_t>> songs;
+    uint32_t seed = 0x6C696272;
+    for (int i = 0; i < BENCH_SONGS; ++i) songs.push_back(make_bench_song(&seed));
+
+    static Smf smf;
+    double samples[BENCH_RUNS] = {0};
+    uint64_t acc = 0;
+
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        uint64_t start = get_time_ns();
+
+        for (const std::vector<uint8_t> &song : songs) {
+            Library_Record record = {0};
+            library_analyze(song.data(), song.size(), &smf, &record);
+            acc += record.fit + (uint64_t) (record.transpose + LIBRARY_TRANSPOSE_RANGE);
+        }
+
+        uint64_t end = get_time_ns();
+        samples[run] = (double) (end - start) / (double) BENCH_SONGS;
+    }
+
+    bench_sink = bench_sink + acc;
+    std::sort(samples, samples + BENCH_RUNS);
+
+    Bench_Result result = {0};
+    result.name = "library_analyze";
+    result.pattern = "songs";
+    result.producers = 1;
+    result.events = BENCH_SONGS;
+    result.best_ns = samples[0];
+    result.median_ns = samples[BENCH_RUNS/2];
+    bench_push_result(result);
+}
+
+// @Note: Every producer stands in for one MIDI device callback, the consumer
+// is the injection thread. Measured from the first push to the last pop.
+internal void bench_run_queue(const Bench_Pattern *pattern, int producers)
+{
+    static Midi_Queue queue;
+    double samples[BENCH_RUNS] = {0};
+    size_t events = pattern->messages.size();
+
+    for (size_t run = 0; run < BENCH_RUNS; ++run) {
+        midi_queue_init(&queue);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> threads;
+
+        for (int p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p]() {
+                while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+                
+                Midi_Event event = {0};
+                event.device = (uint32_t) p;
+                
+                for (size_t i = (size_t) p; i < events; i += (size_t) producers) {
+                    event.packed = pattern->messages[i];
+                    while (!midi_queue_push(&queue, &event)) std::this_thread::yield();
+                }
+            });
+        }
+
+        uint64_t start = get_time_ns();
+        go.store(true, std::memory_order_release);
+        
+        uint64_t acc = 0;
+        Midi_Event event = {0};
+        for (size_t popped = 0; popped < events;) {
+            if (midi_queue_pop(&queue, &event)) {
+                acc += event.packed;
+                popped += 1;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        
+        uint64_t end = get_time_ns();
+        bench_sink = bench_sink + acc;
+
+        for (std::thread &thread : threads) thread.join();
+        samples[run] = (double) (end - start) / (double) events;
+    }
+    
+    std::sort(samples, samples + BENCH_RUNS);
+
+    Bench_Result result = {0};
+    result.name = "queue_push_pop";
+    result.pattern = pattern->name;
+    result.producers = producers;
+    result.events = events;
+    result.best_ns = samples[0];
+    result.median_ns = samples[BENCH_RUNS/2];
+    bench_push_result(result);
+}
+
+internal bool write_results_json(const char *file_path)
+{
+    FILE *file = fopen(file_path, "wb");
+    if (file == 0) return(false);
+
+    fprintf(file, "{\n  \"version\": 1,\n  \"unit\": \"ns/event\",\n  \"results\": [\n");
+    for (size_t i = 0; i < results_len; ++i) {
+        const Bench_Result *r = &results[i];
+        fprintf(file, "    { \"name\": \"%s\", \"pattern\": \"%s\", \"producers\": %d, \"events\": %zu, \"best\": %.3f, \"median\": %.3f }%s\n",
+                r->name, r->pattern, r->producers, r->events, r->best_ns, r->median_ns, i + 1 < results_len ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+
+    return(true);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output_path = argc > 1 ? argv[1] : BENCH_DEFAULT_OUTPUT;
+    
+    Bench_Pattern patterns[] = {
+        make_random_pattern(),
+        make_glissando_pattern(),
+        make_chord_pattern(),
+        make_clocked_pattern(),
+    };
+    Config config = make_bench_config();
+
+    for (size_t i = 0; i < ARR_SZ(patterns); ++i) {
+        bench_run("receive_filter", bench_receive_filter, &patterns[i], &config);
+        bench_run("decode", bench_decode, &patterns[i], &config);
+        bench_run("note_offset", bench_note_offset, &patterns[i], &config);
+        bench_run("keys_map_lookup", bench_keys_map_lookup, &patterns[i], &config);
+        bench_run("modifier_sequence", bench_modifier_sequence, &patterns[i], &config);
+        bench_run("note_filter", bench_note_filter, &patterns[i], &config);
+        bench_run("pipeline", bench_pipeline, &patterns[i], &config);
+        bench_run("timer_wheel", bench_timer_wheel, &patterns[i], &config);
+        bench_run("octave_assign", bench_octave_assign, &patterns[i], &config);
+        bench_run("voice_reduce", bench_voice_reduce, &patterns[i], &config);
+    }
+
+    const int producers[] = { 1, 2, 4 };
+    for (size_t i = 0; i < ARR_SZ(patterns); ++i) {
+        for (size_t j = 0; j < ARR_SZ(producers); ++j) {
+            bench_run_queue(&patterns[i], producers[j]);
+        }
+    }
+
+    bench_run_config_text();
+    bench_run_voice_corpus();
+    bench_run_library_analyze();
+
+    if (!write_results_json(output_path)) {
+        fprintf(stderr, "Could not write results to '%s'\n", output_path);
+        return 1;
+    }
+
+    printf("Results written to '%s'\n", output_path);
+    
+    return 0;
+}
@@ -0,0 +1,160 @@
+// @Note: Compiles a MIDI file into a timeline (see timeline.h) for maidai to
+// replay. The profile comes from a text export (F5 in maidai), the settings
+// default to the same ones the app starts with.
+//
+// Usage: maidai-compile <song.mid> <out.timeline> [options]
+//
+//     --profiles file.txt  profiles to map with (default profiles.txt)
+//     --profile 1          which of them, counting from 1
+//     --transpose 0        semitones
+//     --octaves best       what to do with notes outside the keyboard:
+//                          none drops them, fold moves each one by octaves
+//                          until it fits, best plans the whole song (octave.h)
+//     --voice all          all plays every note, highest, loudest, longest
+//                          and track play one at a time (voice.h)
+//     --voice-track 1      which track wins with --voice track, counting from 1
+//     --mode tap|hold      key mode
+//     --gap 0              minimum ms between two key events
+//     --max-delay 250      key downs the gap would hold back longer than this
+//                          are dropped
+//     --strum 0            strum window ms (--strum-step for the step)
+//     --debounce 5         debounce ms
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "./base.h"
+#include "./vk.h"
+#include "./timer.h"
+#include "./midi.h"
+#include "./config.h"
+#include "./config_text.h"
+#include "./queue.h"
+#include "./log.h"
+#include "./receive.h"
+#include "./filter.h"
+#include "./strum.h"
+#include "./timer_wheel.h"
+#include "./trace.h"
+#include "./note_roll.h"
+#include "./pipeline.h"
+#include "./smf.h"
+#include "./octave.h"
+#include "./voice.h"
+#include "./timeline.h"
+
+global Mapping_Table table;
+
+internal bool read_whole_file(const char *path, std::vector<char> *data)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) return(false);
+
+    char chunk[4096];
+    size_t len = 0;
+    while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0) data->insert(data->end(), chunk, chunk + len);
+    fclose(file);
+
+    return(true);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: maidai-compile <song.mid> <out.timeline> [--profiles file.txt] [--profile n] [--transpose n]\n"
+                        "                      [--octaves none|fold|best] [--voice all|highest|loudest|longest|track] [--voice-track n]\n"
+                        "                      [--mode tap|hold] [--gap ms] [--max-delay ms] [--strum ms] [--strum-step ms] [--debounce ms]\n");
+        return 1;
+    }
+
+    const char *profiles = "profiles.txt";
+    int profile = 1;
+    Timeline_Options options = default_timeline_options();
+
+    for (int i = 3; i < argc; ++i) {
+        const char *option = argv[i];
+        if (i + 1 >= argc) {
+            fprintf(stderr, "'%s' needs a value\n", option);
+            return 1;
+        }
+
+        const char *value = argv[++i];
+        if (strcmp(option, "--profiles") == 0) profiles = value;
+        else if (strcmp(option, "--profile") == 0) profile = atoi(value);
+        else if (strcmp(option, "--transpose") == 0) options.transpose = atoi(value);
+        else if (strcmp(option, "--octaves") == 0) {
+            options.octaves = -1;
+            for (int mode = 0; mode < OCTAVE_MODE_COUNT; ++mode) {
+                if (strcmp(value, octave_mode_names[mode]) == 0) options.octaves = mode;
+            }
+            if (options.octaves == -1) {
+                fprintf(stderr, "--octaves is none, fold or best\n");
+                return 1;
+            }
+        }
+        else if (strcmp(option, "--voice") == 0) {
+            options.voice = -1;
+            for (int mode = 0; mode < VOICE_MODE_COUNT; ++mode) {
+                if (strcmp(value, voice_mode_names[mode]) == 0) options.voice = mode;
+            }
+            if (options.voice == -1) {
+                fprintf(stderr, "--voice is all, highest, loudest, longest or track\n");
+                return 1;
+            }
+        }
+        else if (strcmp(option, "--voice-track") == 0) options.voice_track = atoi(value) - 1;
+        else if (strcmp(option, "--mode") == 0) options.settings.key_mode = strcmp(value, "hold") == 0 ? KEY_MODE_HOLD : KEY_MODE_TAP;
+        else if (strcmp(option, "--gap") == 0) options.settings.key_gap_ms = atoi(value);
+        else if (strcmp(option, "--max-delay") == 0) options.settings.key_delay_max_ms = atoi(value);
+        else if (strcmp(option, "--strum") == 0) options.settings.strum.window_ms = atoi(value);
+        else if (strcmp(option, "--strum-step") == 0) options.settings.strum.offset_ms = atoi(value);
+        else if (strcmp(option, "--debounce") == 0) options.settings.filter.debounce_ms = atoi(value);
+        else {
+            fprintf(stderr, "Unknown option '%s'\n", option);
+            return 1;
+        }
+    }
+
+    std::vector<char> text;
+    Config configs[CONFIG_LEN] = {};
+    if (!read_whole_file(profiles, &text)) {
+        fprintf(stderr, "Could not open '%s'\n", profiles);
+        return 1;
+    }
+
+    Config_Text_Result parsed = config_text_parse(text.data(), text.size(), configs, CONFIG_LEN);
+    size_t loaded = parsed.profiles < CONFIG_LEN ? parsed.profiles : CONFIG_LEN;
+    if (profile < 1 || (size_t) profile > loaded) {
+        fprintf(stderr, "'%s' has %zu profiles, there's no profile %d\n", profiles, loaded, profile);
+        return 1;
+    }
+    config_build_table(&configs[profile - 1], &table);
+
+    std::vector<char> song;
+    if (!read_whole_file(argv[1], &song)) {
+        fprintf(stderr, "Could not open '%s'\n", argv[1]);
+        return 1;
+    }
+
+    Timeline timeline = {0};
+    if (!timeline_compile((const uint8_t *) song.data(), song.size(), &table, &options, &timeline)) {
+        fprintf(stderr, "'%s' isn't a MIDI file\n", argv[1]);
+        return 1;
+    }
+
+    if (!timeline_write(&timeline, argv[2])) {
+        fprintf(stderr, "Could not write '%s'\n", argv[2]);
+        timeline_free(&timeline);
+        return 1;
+    }
+
+    printf("%zu key events over %.1f s (%s, %s, octaves %s, voice %s) -> %s\n", timeline.count, timeline.duration_ns/1e9,
+           configs[profile - 1].name, key_mode_names[options.settings.key_mode], octave_mode_names[options.octaves],
+           voice_mode_names[options.voice], argv[2]);
+
+    timeline_free(&timeline);
+    return 0;
+}
@@ -0,0 +1,164 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// @Note: A mapping is an int, the virtual key code in the low byte and
+// KEY_MOD_* flags above it, so plain keys are stored exactly like they
+// always were and old config files still load.
+//
+// On top of the base mapping every note can have one extra mapping per
+// velocity layer. Layer N kicks in from 'velocity_thresholds[N]' up, a
+// layer with nothing mapped for a note falls back to the layer below it.
+// All of that is flattened into a per-note 128-entry LUT whenever a config
+// changes, so the hot path is just table->keys[note][velocity].
+//
+// Configs also carry 'controls', mappings from CC, pitch bend and program
+// change to actions (see 'pipeline_control()'). Continuous controllers act
+// like a switch with a threshold and some hysteresis, so a knob being turned
+// only produces an event when it crosses the threshold, not on every value.
+//
+// Fields are only ever appended to Config, loading copies whatever prefix
+// the file has and anything newer stays zeroed (which has to mean "off").
+
+#define CONFIG_LEN 4
+#define CONFIG_NAME_LEN 32
+#define VELOCITY_LAYERS_LEN 2
+#define CONTROLS_LEN 8
+
+#define KEY_MOD_SHIFT 0x1
+#define KEY_MOD_CTRL 0x2
+#define KEY_MOD_ALT 0x4
+#define KEY_MOD_SHIFT_BITS 8
+
+#define KEY_VK(key) ((key) & 0xFF)
+#define KEY_MODS(key) (((key) >> KEY_MOD_SHIFT_BITS) & 0x7)
+#define KEY_COMBO(vk, mods) ((vk) | ((mods) << KEY_MOD_SHIFT_BITS))
+
+// @Note: Same values as VK_SHIFT/VK_CONTROL/VK_MENU, without dragging windows.h in.
+#define KEY_VK_SHIFT 0x10
+#define KEY_VK_CTRL 0x11
+#define KEY_VK_ALT 0x12
+
+enum Control_Source {
+    CONTROL_NONE = 0,
+    CONTROL_CC,
+    CONTROL_PITCH_BEND,
+    CONTROL_PROGRAM_CHANGE,
+    CONTROL_SOURCE_COUNT,
+};
+
+enum Control_Action {
+    ACTION_KEY = 0,
+    ACTION_OCTAVE_UP,
+    ACTION_OCTAVE_DOWN,
+    ACTION_OCTAVE_RESET,
+    ACTION_PROFILE,
+    ACTION_COUNT,
+};
+
+global const char *const control_source_names[CONTROL_SOURCE_COUNT] = { "Off", "CC", "Pitch bend", "Program" };
+global const char *const control_action_names[ACTION_COUNT] = { "Key", "Octave up", "Octave down", "Octave 0", "Profile" };
+
+// @Note: 'number' is the CC or program number, unused for pitch bend.
+// For CC the value is 0..127, for pitch bend it's -64..63 (centered), a
+// negative 'threshold' triggers when the value goes below it instead of
+// above. 'param' is the key for ACTION_KEY and the config index for ACTION_PROFILE.
+struct Control_Mapping {
+    int source;
+    int number;
+    int threshold;
+    int hysteresis;
+    int action;
+    int param;
+};
+
+struct Config {
+    char name[CONFIG_NAME_LEN];
+    int keys_map[MIDI_FULL_LEN];
+
+    int velocity_thresholds[VELOCITY_LAYERS_LEN];
+    int layers[VELOCITY_LAYERS_LEN][MIDI_FULL_LEN];
+
+    Control_Mapping controls[CONTROLS_LEN];
+};
+
+// @Note: Everything the injection thread needs from a config, built from it on every change.
+struct Mapping_Table {
+    uint16_t keys[MIDI_FULL_LEN][128];
+    Control_Mapping controls[CONTROLS_LEN];
+};
+
+internal inline void config_build_table(const Config *config, Mapping_Table *table)
+{
+    for (int note = 0; note < MIDI_FULL_LEN; ++note) {
+        for (int velocity = 0; velocity < 128; ++velocity) {
+            int key = config->keys_map[note];
+            
+            for (int layer = 0; layer < VELOCITY_LAYERS_LEN; ++layer) {
+                int threshold = config->velocity_thresholds[layer];
+                int layer_key = config->layers[layer][note];
+                
+                if (threshold > 0 && velocity >= threshold && layer_key != 0) {
+                    key = layer_key;
+                }
+            }
+
+            table->keys[note][velocity] = (uint16_t) key;
+        }
+    }
+
+    for (int i = 0; i < CONTROLS_LEN; ++i) {
+        table->controls[i] = config->controls[i];
+    }
+}
+
+// @Note: 'layer' 0 is the base mapping, 1..VELOCITY_LAYERS_LEN are the velocity layers.
+internal inline int *config_layer_keys(Config *config, int layer)
+{
+    if (layer == 0) return(config->keys_map);
+    
+    return(config->layers[layer - 1]);
+}
+
+internal inline int config_layer_key(const Config *config, int layer, int note)
+{
+    if (layer == 0) return(config->keys_map[note]);
+
+    return(config->layers[layer - 1][note]);
+}
+
+// @Note: What a note actually sends on 'layer', after falling back to the layers below it.
+internal inline int config_effective_key(const Config *config, int layer, int note)
+{
+    for (int i = layer; i > 0; --i) {
+        if (config->layers[i - 1][note] != 0) return(config->layers[i - 1][note]);
+    }
+
+    return(config->keys_map[note]);
+}
+
+internal inline int mapping_lookup_key(const Mapping_Table *table, int index, int velocity)
+{
+    return(table->keys[index][velocity & 0x7F]);
+}
+
+// @Note: config.dat is a header followed by the raw configs and then the raw
+// pipeline settings. Each section carries its size, since both structs only
+// ever grow at the end, a smaller section is loaded as a prefix and the rest
+// is left at its defaults. Files from before the header existed are just
+// CONFIG_LEN 'Config_V1's.
+#define CONFIG_FILE_MAGIC 0x4941444D // @Note: "MDAI"
+#define CONFIG_FILE_VERSION 2
+
+struct Config_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t configs_size;
+    uint32_t settings_size;
+};
+
+struct Config_V1 {
+    char name[CONFIG_NAME_LEN];
+    int keys_map[MIDI_FULL_LEN];
+};
+
+#endif // CONFIG_H
@@ -0,0 +1,463 @@
+#ifndef CONFIG_TEXT_H
+#define CONFIG_TEXT_H
+
+#include <stdarg.h>
+
+// @Note: Text version of the configs, for diffing and sharing them. config.dat
+// stays the format the app saves in, this is only an import/export path.
+//
+//     # Comments start at the beginning of a line.
+//     [profile]
+//     name = Genshin
+//     layer1_from = 96
+//     layer2_from = 120
+//     C3 = Q
+//     C#3 = SHIFT+2
+//     layer1.C3 = CTRL+Q
+//     control1 = cc 64 64 8 key SPACE
+//
+// Notes go from C3 (MIDI note 48) to C6. Keys use the names from
+// 'vk_translation' with optional 'Shift+', 'Ctrl+' and 'Alt+' in front, or a
+// raw '0x41' for keys whose name isn't unique. Controls are
+// 'source number threshold hysteresis action [key or profile index]'.
+//
+// The parser is a single pass over a buffer that doesn't have to be null
+// terminated (it's a mapped file), it never allocates and never copies
+// anything but the profile name.
+
+#define CONFIG_TEXT_PROFILE_SECTION "[profile]"
+
+global const char *const config_text_sources[CONTROL_SOURCE_COUNT] = { "off", "cc", "bend", "program" };
+global const char *const config_text_actions[ACTION_COUNT] = { "key", "octave_up", "octave_down", "octave_reset", "profile" };
+global const char *const config_text_notes[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+
+struct Config_Text_Result {
+    size_t profiles; // @Note: All of them, even those that didn't fit.
+    size_t errors;
+    int first_error_line;
+};
+
+struct Text_Span {
+    const char *at;
+    size_t len;
+};
+
+// @Note: Open addressing, name -> vk. Built the first time it's needed, from
+// whoever parses first (so don't start doing that from two threads at once).
+#define VK_NAME_TABLE_LEN 512
+
+struct Vk_Name_Table {
+    uint8_t vks[VK_NAME_TABLE_LEN]; // @Note: 0 is empty, VK 0 isn't a key anyway.
+    uint8_t name_lens[256];
+    bool built;
+};
+
+global Vk_Name_Table vk_name_table;
+
+internal inline char text_lower(char c)
+{
+    return(c >= 'A' && c <= 'Z' ? (char) (c - 'A' + 'a') : c);
+}
+
+internal inline bool text_equals(Text_Span span, const char *text)
+{
+    size_t i = 0;
+    for (; i < span.len; ++i) {
+        if (text[i] == 0 || text_lower(span.at[i]) != text_lower(text[i])) return(false);
+    }
+
+    return(text[i] == 0);
+}
+
+// @Note: Only looks at the length and three characters, names are short and
+// mostly differ in those, and the probing sorts out the rest. Hashing every
+// character was most of the time spent on a key.
+internal inline uint32_t vk_name_hash(const char *text, size_t len)
+{
+    if (len == 0) return(0);
+
+    uint32_t hash = (uint32_t) len;
+    hash = hash*31 + (uint8_t) text_lower(text[0]);
+    hash = hash*31 + (uint8_t) text_lower(text[len/2]);
+    hash = hash*31 + (uint8_t) text_lower(text[len - 1]);
+
+    return(hash*2654435761u >> 16);
+}
+
+internal inline void vk_name_table_build()
+{
+    for (int vk = 1; vk < 256; ++vk) {
+        const char *name = vk_translation[vk];
+        size_t len = strlen(name);
+        uint32_t slot = vk_name_hash(name, len) % VK_NAME_TABLE_LEN;
+        vk_name_table.name_lens[vk] = (uint8_t) len;
+
+        // @Note: Duplicate names ("N/A", "RES") keep the first VK that has them.
+        bool duplicate = false;
+        while (vk_name_table.vks[slot] != 0) {
+            if (strcmp(vk_translation[vk_name_table.vks[slot]], name) == 0) duplicate = true;
+            slot = (slot + 1) % VK_NAME_TABLE_LEN;
+        }
+
+        if (!duplicate) vk_name_table.vks[slot] = (uint8_t) vk;
+    }
+
+    vk_name_table.built = true;
+}
+
+internal inline int vk_from_name(Text_Span name)
+{
+    if (!vk_name_table.built) vk_name_table_build();
+
+    uint32_t slot = vk_name_hash(name.at, name.len) % VK_NAME_TABLE_LEN;
+    while (vk_name_table.vks[slot] != 0) {
+        int vk = vk_name_table.vks[slot];
+        
+        if (vk_name_table.name_lens[vk] == name.len) {
+            // @Note: Names are written the way 'vk_translation' has them, case only differs if someone typed them.
+            if (memcmp(name.at, vk_translation[vk], name.len) == 0) return(vk);
+            if (text_equals(name, vk_translation[vk])) return(vk);
+        }
+
+        slot = (slot + 1) % VK_NAME_TABLE_LEN;
+    }
+
+    return(0);
+}
+
+internal inline Text_Span text_trim(const char *at, const char *end)
+{
+    while (at < end && (*at == ' ' || *at == '\t')) ++at;
+    while (end > at && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+
+    Text_Span span = { at, (size_t) (end - at) };
+    return(span);
+}
+
+// @Note: Splits the next space separated token off the front of 'span'.
+internal inline Text_Span text_next_token(Text_Span *span)
+{
+    Text_Span rest = text_trim(span->at, span->at + span->len);
+    size_t len = 0;
+    while (len < rest.len && rest.at[len] != ' ' && rest.at[len] != '\t') ++len;
+
+    Text_Span token = { rest.at, len };
+    span->at = rest.at + len;
+    span->len = rest.len - len;
+
+    return(token);
+}
+
+internal inline bool text_parse_int(Text_Span span, int *value)
+{
+    size_t i = 0;
+    bool negative = span.len > 0 && span.at[0] == '-';
+    if (negative) ++i;
+
+    int result = 0;
+    int base = 10;
+    if (span.len - i > 2 && span.at[i] == '0' && text_lower(span.at[i + 1]) == 'x') {
+        base = 16;
+        i += 2;
+    }
+
+    if (i == span.len) return(false);
+
+    for (; i < span.len; ++i) {
+        char c = text_lower(span.at[i]);
+        int digit = -1;
+
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        if (digit < 0) return(false);
+
+        result = result*base + digit;
+        if (result > 0xFFFF) return(false);
+    }
+
+    *value = negative ? -result : result;
+    return(true);
+}
+
+// @Note: "Shift+Ctrl+Q", "ALT++", "0x41". 0 if it isn't a key. Modifiers
+// have to come in that order, which is the order they're written in.
+internal inline int text_parse_key(Text_Span span)
+{
+    const char *const modifier_names[3] = { "shift+", "ctrl+", "alt+" };
+    const size_t modifier_lens[3] = { 6, 5, 4 };
+    const int modifier_bits[3] = { KEY_MOD_SHIFT, KEY_MOD_CTRL, KEY_MOD_ALT };
+    int modifiers = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        Text_Span prefix = { span.at, modifier_lens[i] };
+
+        if (span.len > modifier_lens[i] && text_equals(prefix, modifier_names[i])) {
+            modifiers |= modifier_bits[i];
+            span.at += modifier_lens[i];
+            span.len -= modifier_lens[i];
+        }
+    }
+
+    int vk = 0;
+    if (!(span.len > 2 && span.at[0] == '0' && text_parse_int(span, &vk))) {
+        vk = vk_from_name(span);
+    }
+
+    if (vk <= 0 || vk > 0xFF) return(0);
+
+    return(KEY_COMBO(vk, modifiers));
+}
+
+// @Note: "C3", "C#3", "Db3" -> index into 'keys_map', -1 if it isn't one.
+internal inline int text_parse_note(Text_Span span)
+{
+    if (span.len < 2) return(-1);
+
+    const int pitch_classes[7] = { 9, 11, 0, 2, 4, 5, 7 }; // @Note: A to G.
+    char letter = text_lower(span.at[0]);
+    if (letter < 'a' || letter > 'g') return(-1);
+
+    int pitch = pitch_classes[letter - 'a'];
+    size_t i = 1;
+
+    if (span.at[i] == '#') { pitch += 1; ++i; }
+    else if (span.at[i] == 'b') { pitch -= 1; ++i; }
+
+    Text_Span octave_span = { span.at + i, span.len - i };
+    int octave = 0;
+    if (!text_parse_int(octave_span, &octave)) return(-1);
+
+    int note = (octave + 1)*12 + pitch;
+    return(midi_note_to_index(note, NOTE_OFFSET));
+}
+
+internal inline int text_find_name(Text_Span span, const char *const *names, int len)
+{
+    for (int i = 0; i < len; ++i) {
+        if (text_equals(span, names[i])) return(i);
+    }
+
+    return(-1);
+}
+
+internal inline bool config_text_parse_control(Text_Span value, Control_Mapping *control)
+{
+    Control_Mapping result = {0};
+
+    result.source = text_find_name(text_next_token(&value), config_text_sources, CONTROL_SOURCE_COUNT);
+    if (result.source < 0) return(false);
+
+    if (!text_parse_int(text_next_token(&value), &result.number)) return(false);
+    if (!text_parse_int(text_next_token(&value), &result.threshold)) return(false);
+    if (!text_parse_int(text_next_token(&value), &result.hysteresis)) return(false);
+
+    result.action = text_find_name(text_next_token(&value), config_text_actions, ACTION_COUNT);
+    if (result.action < 0) return(false);
+
+    // @Note: Key names can have spaces in them, so the key is the rest of the line.
+    Text_Span param = text_trim(value.at, value.at + value.len);
+    if (result.action == ACTION_KEY && param.len > 0) {
+        result.param = text_parse_key(param);
+        if (result.param == 0) return(false);
+    } else if (result.action == ACTION_PROFILE) {
+        if (!text_parse_int(param, &result.param) || result.param < 0 || result.param >= CONFIG_LEN) return(false);
+    }
+
+    *control = result;
+    return(true);
+}
+
+// @Note: Handles one 'key = value' line for 'config', false if it makes no sense.
+internal inline bool config_text_parse_entry(Config *config, Text_Span key, Text_Span value)
+{
+    if (text_equals(key, "name")) {
+        size_t len = value.len < CONFIG_NAME_LEN - 1 ? value.len : CONFIG_NAME_LEN - 1;
+        memcpy(config->name, value.at, len);
+        config->name[len] = 0;
+        return(true);
+    }
+
+    int *keys_map = config->keys_map;
+
+    // @Note: "layer1_from", "layer2.C3", "control3", the number is 1 based.
+    if (key.len > 6 && text_equals({ key.at, 5 }, "layer")) {
+        int layer = key.at[5] - '1';
+        if (layer < 0 || layer >= VELOCITY_LAYERS_LEN) return(false);
+
+        Text_Span rest = { key.at + 6, key.len - 6 };
+        if (text_equals(rest, "_from")) {
+            int threshold = 0;
+            if (!text_parse_int(value, &threshold) || threshold < 0 || threshold > 127) return(false);
+
+            config->velocity_thresholds[layer] = threshold;
+            return(true);
+        }
+
+        if (rest.at[0] != '.') return(false);
+
+        keys_map = config->layers[layer];
+        key.at += 7;
+        key.len -= 7;
+    } else if (key.len > 7 && text_equals({ key.at, 7 }, "control")) {
+        Text_Span number = { key.at + 7, key.len - 7 };
+        int index = 0;
+        if (!text_parse_int(number, &index) || index < 1 || index > CONTROLS_LEN) return(false);
+
+        return(config_text_parse_control(value, &config->controls[index - 1]));
+    }
+
+    int note = text_parse_note(key);
+    int mapped = text_parse_key(value);
+    if (note < 0 || (mapped == 0 && value.len > 0)) return(false);
+
+    keys_map[note] = mapped;
+    return(true);
+}
+
+// @Note: Fills in up to 'configs_len' profiles, in order, each one starts
+// out zeroed. Lines that don't parse are skipped and counted.
+internal inline Config_Text_Result config_text_parse(const char *data, size_t size, Config *configs, size_t configs_len)
+{
+    Config_Text_Result result = {0};
+    const char *end = data + size;
+    Config scratch = {0}; // @Note: Where profiles past 'configs_len' (and lines before the first one) go.
+    Config *config = 0;
+    int line_number = 0;
+
+    for (const char *at = data; at < end;) {
+        const char *line_end = (const char *) memchr(at, '\n', (size_t) (end - at));
+        if (line_end == 0) line_end = end;
+
+        Text_Span line = text_trim(at, line_end);
+        at = line_end + 1;
+        line_number += 1;
+
+        if (line.len == 0 || line.at[0] == '#') continue;
+
+        if (line.at[0] == '[') {
+            if (text_equals(line, CONFIG_TEXT_PROFILE_SECTION)) {
+                config = result.profiles < configs_len ? &configs[result.profiles] : &scratch;
+                memset(config, 0, sizeof(*config));
+                result.profiles += 1;
+                continue;
+            }
+        } else {
+            const char *equals = (const char *) memchr(line.at, '=', line.len);
+
+            if (config && equals) {
+                Text_Span key = text_trim(line.at, equals);
+                Text_Span value = text_trim(equals + 1, line.at + line.len);
+
+                if (config_text_parse_entry(config, key, value)) continue;
+            }
+        }
+
+        if (result.errors == 0) result.first_error_line = line_number;
+        result.errors += 1;
+    }
+
+    return(result);
+}
+
+// @Note: Appends to 'out' like snprintf, but keeps track of the length and
+// stops quietly once it runs out of space.
+struct Text_Writer {
+    char *data;
+    size_t cap;
+    size_t len;
+    bool overflow;
+};
+
+internal inline void text_write(Text_Writer *writer, const char *format, ...)
+{
+    if (writer->overflow) return;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(writer->data + writer->len, writer->cap - writer->len, format, args);
+    va_end(args);
+
+    if (written < 0 || (size_t) written >= writer->cap - writer->len) {
+        writer->overflow = true;
+        return;
+    }
+
+    writer->len += (size_t) written;
+}
+
+internal inline void text_write_key(Text_Writer *writer, int key)
+{
+    int vk = KEY_VK(key);
+    int modifiers = KEY_MODS(key);
+
+    if (modifiers & KEY_MOD_SHIFT) text_write(writer, "Shift+");
+    if (modifiers & KEY_MOD_CTRL) text_write(writer, "Ctrl+");
+    if (modifiers & KEY_MOD_ALT) text_write(writer, "Alt+");
+
+    // @Note: Names that belong to more than one VK wouldn't come back as the same key.
+    Text_Span name = { vk_translation[vk], strlen(vk_translation[vk]) };
+    if (vk_from_name(name) == vk) {
+        text_write(writer, "%s", vk_translation[vk]);
+    } else {
+        text_write(writer, "0x%02X", vk);
+    }
+}
+
+internal inline void text_write_keys(Text_Writer *writer, const int *keys_map, const char *prefix)
+{
+    for (int i = 0; i < MIDI_FULL_LEN; ++i) {
+        if (keys_map[i] == 0) continue;
+
+        int note = NOTE_OFFSET + i;
+        text_write(writer, "%s%s%d = ", prefix, config_text_notes[note % 12], note/12 - 1);
+        text_write_key(writer, keys_map[i]);
+        text_write(writer, "\n");
+    }
+}
+
+// @Note: Returns the length written, 0 if it didn't fit in 'cap'.
+internal inline size_t config_text_write(const Config *configs, size_t configs_len, char *out, size_t cap)
+{
+    Text_Writer writer = { out, cap, 0, false };
+    text_write(&writer, "# maidai profiles\n");
+
+    for (size_t i = 0; i < configs_len; ++i) {
+        const Config *config = &configs[i];
+
+        text_write(&writer, "\n" CONFIG_TEXT_PROFILE_SECTION "\n");
+        text_write(&writer, "name = %.*s\n", CONFIG_NAME_LEN, config->name);
+
+        for (int layer = 0; layer < VELOCITY_LAYERS_LEN; ++layer) {
+            text_write(&writer, "layer%d_from = %d\n", layer + 1, config->velocity_thresholds[layer]);
+        }
+
+        text_write_keys(&writer, config->keys_map, "");
+
+        for (int layer = 0; layer < VELOCITY_LAYERS_LEN; ++layer) {
+            char prefix[16] = {0};
+            snprintf(prefix, sizeof(prefix), "layer%d.", layer + 1);
+            text_write_keys(&writer, config->layers[layer], prefix);
+        }
+
+        for (int c = 0; c < CONTROLS_LEN; ++c) {
+            const Control_Mapping *control = &config->controls[c];
+            if (control->source == CONTROL_NONE) continue;
+
+            text_write(&writer, "control%d = %s %d %d %d %s", c + 1, config_text_sources[control->source], control->number,
+                       control->threshold, control->hysteresis, config_text_actions[control->action]);
+
+            if (control->action == ACTION_KEY && control->param != 0) {
+                text_write(&writer, " ");
+                text_write_key(&writer, control->param);
+            } else if (control->action == ACTION_PROFILE) {
+                text_write(&writer, " %d", control->param);
+            }
+
+            text_write(&writer, "\n");
+        }
+    }
+
+    return(writer.overflow ? 0 : writer.len);
+}
+
+#endif // CONFIG_TEXT_H
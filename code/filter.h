@@ -0,0 +1,99 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+// @Note: Per-note re-trigger/debounce filter. One small struct per MIDI note,
+// indexed directly by the note number, so every event is a single load and
+// store and the whole table (2KB) stays in cache.
+//
+// - A NOTE_ON within 'debounce_ms' of the last accepted one for the same note
+//   is a double fire from the controller and is always dropped.
+// - A NOTE_ON within 'retrigger_ms' is a real re-press that's too fast for
+//   the game. It's either dropped, or delayed until the interval has passed
+//   (other notes aren't held back, so this can reorder the output).
+//   Only one delayed re-press is kept per note, further ones collapse into it.
+
+enum Retrigger_Mode {
+    RETRIGGER_DROP = 0,
+    RETRIGGER_DELAY,
+    RETRIGGER_MODE_COUNT,
+};
+
+global const char *const retrigger_mode_names[RETRIGGER_MODE_COUNT] = { "Drop", "Delay" };
+
+struct Note_Filter_Settings {
+    int debounce_ms;
+    int retrigger_ms;
+    int retrigger_mode;
+};
+
+struct Note_State {
+    uint64_t last_on_ns; // @Note: In the future when a delayed re-press is pending.
+    uint8_t held;
+    uint8_t seen;
+};
+
+struct Note_Filter {
+    Note_State notes[128];
+    
+    uint32_t debounced;
+    uint32_t dropped;
+    uint32_t delayed;
+};
+
+enum Filter_Action {
+    FILTER_PASS = 0,
+    FILTER_DROP,
+    FILTER_DELAY,
+};
+
+// @Note: On FILTER_PASS and FILTER_DELAY 'due_ns' is when the event should go out.
+internal inline Filter_Action note_filter_apply(Note_Filter *filter, const Note_Filter_Settings *settings,
+                                                const Midi_Message *message, uint64_t time_ns, uint64_t *due_ns)
+{
+    Note_State *note = &filter->notes[message->note & 0x7F];
+    *due_ns = time_ns;
+    
+    if (message->status == NOTE_OFF) {
+        if (!note->held) return(FILTER_DROP);
+
+        note->held = 0;
+        return(FILTER_PASS);
+    }
+
+    if (note->seen) {
+        int64_t elapsed_ns = (int64_t) (time_ns - note->last_on_ns);
+        
+        if (elapsed_ns < 0) {
+            filter->dropped += 1;
+            return(FILTER_DROP);
+        }
+        
+        if (elapsed_ns < settings->debounce_ms*1000000ll) {
+            filter->debounced += 1;
+            return(FILTER_DROP);
+        }
+
+        int64_t retrigger_ns = settings->retrigger_ms*1000000ll;
+        if (elapsed_ns < retrigger_ns) {
+            if (settings->retrigger_mode == RETRIGGER_DROP) {
+                filter->dropped += 1;
+                return(FILTER_DROP);
+            }
+
+            note->last_on_ns += retrigger_ns;
+            note->held = 1;
+            filter->delayed += 1;
+            *due_ns = note->last_on_ns;
+            
+            return(FILTER_DELAY);
+        }
+    }
+
+    note->last_on_ns = time_ns;
+    note->held = 1;
+    note->seen = 1;
+
+    return(FILTER_PASS);
+}
+
+#endif // FILTER_H
@@ -0,0 +1,160 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+// @Note: Config edits as an append-only log, so nothing made during a session
+// is lost if we crash or get killed. Every record says "these bytes of the
+// configs (or settings) now look like this", so replaying one that's already
+// in the snapshot doesn't hurt and a torn write at the end is just dropped.
+//
+// The UI thread diffs the configs against what it last logged and pushes
+// the changed range into a byte ring, a background thread (see main.cpp)
+// appends whole batches to the file and compacts it into config.dat once it
+// grows. Nothing on the UI side ever waits for the disk, if the ring is full
+// the edit simply stays "unlogged" and goes out on a later frame.
+//
+// File layout: a Config_File_Header with JOURNAL_MAGIC (so a journal from a
+// build with different struct sizes is ignored), then records.
+
+#define JOURNAL_MAGIC 0x4E524A4D // @Note: "MJRN"
+#define JOURNAL_RING_LEN (64*1024)
+
+enum Journal_Region {
+    JOURNAL_REGION_CONFIGS = 0,
+    JOURNAL_REGION_SETTINGS,
+    JOURNAL_REGION_COUNT,
+};
+
+struct Journal_Record {
+    uint32_t checksum; // @Note: Of everything after it, payload included.
+    uint16_t region;
+    uint16_t size;
+    uint32_t offset;
+};
+
+// @Note: Single producer (UI thread), single consumer (journal thread).
+struct Journal_Ring {
+    uint8_t data[JOURNAL_RING_LEN];
+    std::atomic<size_t> head; // @Note: Total bytes written, only the producer changes it.
+    std::atomic<size_t> tail; // @Note: Total bytes read, only the consumer changes it.
+};
+
+internal inline uint32_t journal_hash(uint32_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i])*16777619u;
+    }
+
+    return(hash);
+}
+
+internal inline uint32_t journal_checksum(const Journal_Record *record, const void *payload)
+{
+    uint32_t hash = journal_hash(2166136261u, &record->region, sizeof(*record) - sizeof(record->checksum));
+    return(journal_hash(hash, payload, record->size));
+}
+
+internal inline void journal_ring_write(Journal_Ring *ring, size_t at, const void *data, size_t size)
+{
+    size_t start = at % JOURNAL_RING_LEN;
+    size_t first = size < JOURNAL_RING_LEN - start ? size : JOURNAL_RING_LEN - start;
+
+    memcpy(ring->data + start, data, first);
+    memcpy(ring->data, (const uint8_t *) data + first, size - first);
+}
+
+internal inline void journal_ring_read(const Journal_Ring *ring, size_t at, void *data, size_t size)
+{
+    size_t start = at % JOURNAL_RING_LEN;
+    size_t first = size < JOURNAL_RING_LEN - start ? size : JOURNAL_RING_LEN - start;
+
+    memcpy(data, ring->data + start, first);
+    memcpy((uint8_t *) data + first, ring->data, size - first);
+}
+
+internal inline bool journal_ring_push(Journal_Ring *ring, int region, size_t offset, const void *payload, size_t size)
+{
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    size_t tail = ring->tail.load(std::memory_order_acquire);
+    if (JOURNAL_RING_LEN - (head - tail) < sizeof(Journal_Record) + size) return(false);
+
+    Journal_Record record = {0};
+    record.region = (uint16_t) region;
+    record.size = (uint16_t) size;
+    record.offset = (uint32_t) offset;
+    record.checksum = journal_checksum(&record, payload);
+
+    journal_ring_write(ring, head, &record, sizeof(record));
+    journal_ring_write(ring, head + sizeof(record), payload, size);
+    ring->head.store(head + sizeof(record) + size, std::memory_order_release);
+
+    return(true);
+}
+
+// @Note: 'payload' has to fit the largest region.
+internal inline bool journal_ring_pop(Journal_Ring *ring, Journal_Record *record, void *payload)
+{
+    size_t tail = ring->tail.load(std::memory_order_relaxed);
+    size_t head = ring->head.load(std::memory_order_acquire);
+    if (head == tail) return(false);
+
+    journal_ring_read(ring, tail, record, sizeof(*record));
+    journal_ring_read(ring, tail + sizeof(*record), payload, record->size);
+    ring->tail.store(tail + sizeof(*record) + record->size, std::memory_order_release);
+
+    return(true);
+}
+
+// @Note: Smallest [first, last) range where 'a' and 'b' differ, false if they don't.
+internal inline bool journal_diff(const void *a, const void *b, size_t size, size_t *first, size_t *last)
+{
+    const uint8_t *x = (const uint8_t *) a;
+    const uint8_t *y = (const uint8_t *) b;
+
+    size_t start = 0;
+    while (start < size && x[start] == y[start]) ++start;
+    if (start == size) return(false);
+
+    size_t end = size;
+    while (end > start && x[end - 1] == y[end - 1]) --end;
+
+    *first = start;
+    *last = end;
+    return(true);
+}
+
+// @Note: Applies every record in 'data' (a whole journal file) to the
+// regions, stops at the first one that's cut off or doesn't check out.
+// Returns how many were applied.
+internal inline size_t journal_replay(const uint8_t *data, size_t size, uint8_t *const *regions, const size_t *region_sizes)
+{
+    Config_File_Header header = {0};
+    if (size < sizeof(header)) return(0);
+
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != JOURNAL_MAGIC || header.version != CONFIG_FILE_VERSION ||
+        header.configs_size != region_sizes[JOURNAL_REGION_CONFIGS] ||
+        header.settings_size != region_sizes[JOURNAL_REGION_SETTINGS]) {
+        return(0);
+    }
+
+    size_t applied = 0;
+    for (size_t at = sizeof(header); at + sizeof(Journal_Record) <= size;) {
+        Journal_Record record = {0};
+        memcpy(&record, data + at, sizeof(record));
+
+        const uint8_t *payload = data + at + sizeof(record);
+        if (at + sizeof(record) + record.size > size) break;
+        if (record.region >= JOURNAL_REGION_COUNT) break;
+        if ((size_t) record.offset + record.size > region_sizes[record.region]) break;
+        if (journal_checksum(&record, payload) != record.checksum) break;
+
+        memcpy(regions[record.region] + record.offset, payload, record.size);
+        at += sizeof(record) + record.size;
+        applied += 1;
+    }
+
+    return(applied);
+}
+
+#endif // JOURNAL_H
@@ -0,0 +1,430 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+// @Note: An index of a song library, the MIDI files under a directory
+// with what's worth knowing about them before picking one: how long,
+// how fast, which channels, what range, and which transpose gets the most
+// of it onto the keyboard. Files go through the streaming reader (smf.h)
+// once, after that the index is all the UI looks at.
+//
+// File layout: a Library_File_Header, 'count' Library_Records, then the
+// paths as 'strings_len' bytes of null terminated strings. A record is keyed
+// by its path, file size and modification time, a rescan only reads the files
+// where one of those changed. Scanning is split over worker threads, each one
+// takes the next file with 'library_scan_work()'.
+
+#define LIBRARY_MAGIC 0x42494C4D // @Note: "MLIB"
+#define LIBRARY_VERSION 1
+#define LIBRARY_TRANSPOSE_RANGE 48 // @Note: Semitones either way, as far as anything can still fit.
+#define LIBRARY_PERCUSSION_CHANNEL 9 // @Note: Channel 10, drums, its notes aren't pitches.
+
+enum Library_Flags {
+    LIBRARY_BROKEN = 1 << 0, // @Note: Not a MIDI file, or cut off somewhere.
+};
+
+struct Library_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t strings_len;
+};
+
+struct Library_Record {
+    uint64_t mtime; // @Note: Whatever the platform's file time is, only ever compared.
+    uint64_t size;
+    uint64_t duration_ns;
+    uint32_t path; // @Note: Offset into the strings.
+    uint32_t note_ons;
+    uint32_t pitched; // @Note: Note ons that aren't percussion.
+    uint32_t fit; // @Note: Pitched note ons that land on the keyboard after 'transpose'.
+    uint32_t tempo; // @Note: The first one, microseconds per quarter note.
+    uint16_t tempo_changes;
+    uint16_t channels; // @Note: One bit per channel with notes on it.
+    uint8_t tracks;
+    uint8_t low; // @Note: Pitch range, percussion left out.
+    uint8_t high;
+    int8_t transpose;
+    uint8_t flags;
+    uint8_t reserved[3];
+};
+
+struct Library {
+    Library_Record *records;
+    size_t count;
+    size_t cap;
+
+    char *strings;
+    size_t strings_len;
+    size_t strings_cap;
+
+    // @Note: Path -> record + 1, open addressing, see 'library_build_lookup()'.
+    uint32_t *lookup;
+    size_t lookup_len;
+};
+
+internal inline void library_free(Library *library)
+{
+    free(library->records);
+    free(library->strings);
+    free(library->lookup);
+    memset(library, 0, sizeof(*library));
+}
+
+internal inline const char *library_path(const Library *library, const Library_Record *record)
+{
+    return(library->strings + record->path);
+}
+
+// @Note: Windows doesn't care about case in paths, so neither do we.
+internal inline uint32_t library_hash(const char *path)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *at = path; *at; ++at) {
+        char c = *at;
+        if (c >= 'A' && c <= 'Z') c = (char) (c - 'A' + 'a');
+        hash = (hash ^ (uint8_t) c)*16777619u;
+    }
+
+    return(hash);
+}
+
+internal inline bool library_same_path(const char *a, const char *b)
+{
+    for (;; ++a, ++b) {
+        char x = *a >= 'A' && *a <= 'Z' ? (char) (*a - 'A' + 'a') : *a;
+        char y = *b >= 'A' && *b <= 'Z' ? (char) (*b - 'A' + 'a') : *b;
+        if (x != y) return(false);
+        if (x == 0) return(true);
+    }
+}
+
+// @Note: Appends a record for 'path' with everything but the key zeroed, -1 if we're out of memory.
+internal inline int64_t library_add(Library *library, const char *path, uint64_t mtime, uint64_t size)
+{
+    size_t path_len = strlen(path) + 1;
+
+    if (library->count == library->cap) {
+        size_t cap = library->cap ? library->cap*2 : 256;
+        Library_Record *records = (Library_Record *) realloc(library->records, cap*sizeof(Library_Record));
+        if (records == 0) return(-1);
+
+        library->records = records;
+        library->cap = cap;
+    }
+
+    if (library->strings_len + path_len > library->strings_cap) {
+        size_t cap = library->strings_cap ? library->strings_cap*2 : 16*1024;
+        while (cap < library->strings_len + path_len) cap *= 2;
+
+        char *strings = (char *) realloc(library->strings, cap);
+        if (strings == 0) return(-1);
+
+        library->strings = strings;
+        library->strings_cap = cap;
+    }
+
+    Library_Record *record = &library->records[library->count];
+    memset(record, 0, sizeof(*record));
+    record->path = (uint32_t) library->strings_len;
+    record->mtime = mtime;
+    record->size = size;
+
+    memcpy(library->strings + library->strings_len, path, path_len);
+    library->strings_len += path_len;
+
+    return((int64_t) library->count++);
+}
+
+internal inline bool library_build_lookup(Library *library)
+{
+    size_t len = 64;
+    while (len < library->count*2) len *= 2;
+
+    uint32_t *lookup = (uint32_t *) calloc(len, sizeof(uint32_t));
+    if (lookup == 0) return(false);
+
+    for (size_t i = 0; i < library->count; ++i) {
+        size_t slot = library_hash(library_path(library, &library->records[i])) & (len - 1);
+        while (lookup[slot]) slot = (slot + 1) & (len - 1);
+        lookup[slot] = (uint32_t) i + 1;
+    }
+
+    free(library->lookup);
+    library->lookup = lookup;
+    library->lookup_len = len;
+
+    return(true);
+}
+
+internal inline const Library_Record *library_find(const Library *library, const char *path)
+{
+    if (library->lookup_len == 0) return(0);
+
+    size_t slot = library_hash(path) & (library->lookup_len - 1);
+    for (; library->lookup[slot]; slot = (slot + 1) & (library->lookup_len - 1)) {
+        const Library_Record *record = &library->records[library->lookup[slot] - 1];
+        if (library_same_path(library_path(library, record), path)) return(record);
+    }
+
+    return(0);
+}
+
+// @Note: Adds 'path' to 'library' with what 'old' already knows about it if
+// the file hasn't changed since. -1 if we're out of memory, otherwise whether
+// it still needs to be analyzed.
+internal inline int library_add_known(Library *library, const Library *old, const char *path, uint64_t mtime, uint64_t size, int64_t *index)
+{
+    *index = library_add(library, path, mtime, size);
+    if (*index == -1) return(-1);
+
+    const Library_Record *known = library_find(old, path);
+    if (known == 0 || known->mtime != mtime || known->size != size) return(1);
+
+    Library_Record *record = &library->records[*index];
+    uint32_t offset = record->path;
+    *record = *known;
+    record->path = offset;
+
+    return(0);
+}
+
+// @Note: The transpose that gets the most notes of 'histogram' between
+// NOTE_OFFSET and the top of the keyboard. Ties go to whole octaves, which
+// keep the song in its key, then to the smallest one.
+internal inline int library_best_transpose(const uint32_t histogram[128], uint32_t *fit)
+{
+    uint32_t below[129] = {0}; // @Note: Notes under each pitch.
+    for (int note = 0; note < 128; ++note) below[note + 1] = below[note] + histogram[note];
+
+    int best = 0;
+    *fit = 0;
+
+    for (int transpose = -LIBRARY_TRANSPOSE_RANGE; transpose <= LIBRARY_TRANSPOSE_RANGE; ++transpose) {
+        int low = NOTE_OFFSET - transpose;
+        int high = NOTE_OFFSET + MIDI_FULL_LEN - transpose;
+        if (low < 0) low = 0;
+        if (high > 128) high = 128;
+
+        uint32_t count = high > low ? below[high] - below[low] : 0;
+        int magnitude = transpose < 0 ? -transpose : transpose;
+        int best_magnitude = best < 0 ? -best : best;
+        bool octave = transpose % 12 == 0;
+        bool best_octave = best % 12 == 0;
+
+        if (count > *fit ||
+            (count == *fit && octave && !best_octave) ||
+            (count == *fit && octave == best_octave && magnitude < best_magnitude)) {
+            best = transpose;
+            *fit = count;
+        }
+    }
+
+    return(best);
+}
+
+// @Note: Fills in everything but the key. 'smf' is just scratch memory.
+internal inline void library_analyze(const uint8_t *data, size_t size, Smf *smf, Library_Record *record)
+{
+    record->flags = 0;
+    if (!smf_open(smf, data, size)) {
+        record->flags |= LIBRARY_BROKEN;
+        return;
+    }
+
+    uint32_t histogram[128] = {0};
+    uint64_t end_ns = 0;
+    uint16_t channels = 0;
+    uint32_t note_ons = 0;
+    uint32_t pitched = 0;
+    uint32_t tempo = SMF_DEFAULT_TEMPO;
+    uint32_t tempo_changes = 0;
+    int low = 127;
+    int high = 0;
+
+    Smf_Event event = {0};
+    while (smf_next(smf, &event)) {
+        end_ns = event.time_ns;
+
+        if (event.type == SMF_EVENT_TEMPO) {
+            // @Note: The reader ignores a tempo of 0, so do we.
+            if (event.data == 0) continue;
+            if (tempo_changes == 0) tempo = event.data;
+            tempo_changes += 1;
+            continue;
+        }
+
+        Midi_Message message = midi_decode(event.data);
+        if (message.status != NOTE_ON) continue;
+
+        note_ons += 1;
+        channels |= (uint16_t) (1 << message.channel);
+        if (message.channel == LIBRARY_PERCUSSION_CHANNEL) continue;
+
+        histogram[message.note] += 1;
+        pitched += 1;
+        if (message.note < low) low = message.note;
+        if (message.note > high) high = message.note;
+    }
+
+    record->duration_ns = end_ns;
+    record->note_ons = note_ons;
+    record->pitched = pitched;
+    record->tempo = tempo;
+    record->tempo_changes = (uint16_t) (tempo_changes < UINT16_MAX ? tempo_changes : UINT16_MAX);
+    record->channels = channels;
+    record->tracks = (uint8_t) (smf->tracks_len + smf->tracks_skipped < 255 ? smf->tracks_len + smf->tracks_skipped : 255);
+    record->low = (uint8_t) (low <= high ? low : 0);
+    record->high = (uint8_t) (low <= high ? high : 0);
+    record->transpose = (int8_t) library_best_transpose(histogram, &record->fit);
+    if (smf->broken) record->flags |= LIBRARY_BROKEN;
+}
+
+// @Note: Scratch memory for one scanning thread.
+struct Library_Worker {
+    Smf smf;
+    uint8_t *buffer;
+    size_t buffer_cap;
+};
+
+internal inline bool library_analyze_file(Library_Worker *worker, const char *path, Library_Record *record)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) return(false);
+
+    size_t len = 0;
+    bool result = fseek(file, 0, SEEK_END) == 0;
+    if (result) {
+        long end = ftell(file);
+        result = end >= 0 && fseek(file, 0, SEEK_SET) == 0;
+        len = result ? (size_t) end : 0;
+    }
+
+    if (result && len > worker->buffer_cap) {
+        uint8_t *buffer = (uint8_t *) realloc(worker->buffer, len);
+        result = buffer != 0;
+        if (result) {
+            worker->buffer = buffer;
+            worker->buffer_cap = len;
+        }
+    }
+
+    result = result && fread(worker->buffer, 1, len, file) == len;
+    fclose(file);
+
+    if (result) library_analyze(worker->buffer, len, &worker->smf, record);
+    else record->flags = LIBRARY_BROKEN;
+
+    return(result);
+}
+
+// @Note: The records in 'library' listed in 'jobs' still need to be analyzed.
+// Every thread that calls 'library_scan_work()' takes the next one until
+// there are none left, they only ever touch their own records.
+struct Library_Scan {
+    Library *library;
+    const uint32_t *jobs;
+    size_t jobs_len;
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+};
+
+internal inline void library_scan_work(Library_Scan *scan, Library_Worker *worker)
+{
+    for (;;) {
+        size_t job = scan->next.fetch_add(1, std::memory_order_relaxed);
+        if (job >= scan->jobs_len) break;
+
+        Library_Record *record = &scan->library->records[scan->jobs[job]];
+        library_analyze_file(worker, library_path(scan->library, record), record);
+        scan->done.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+internal inline bool library_write(const Library *library, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) return(false);
+
+    Library_File_Header header = {0};
+    header.magic = LIBRARY_MAGIC;
+    header.version = LIBRARY_VERSION;
+    header.record_size = sizeof(Library_Record);
+    header.count = library->count;
+    header.strings_len = library->strings_len;
+
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  (library->count == 0 || fwrite(library->records, sizeof(Library_Record), library->count, file) == library->count) &&
+                  (library->strings_len == 0 || fwrite(library->strings, 1, library->strings_len, file) == library->strings_len);
+
+    return(fclose(file) == 0 && result);
+}
+
+// @Note: False if there's no index or it isn't one we can read, 'library' is empty then.
+internal inline bool library_read(Library *library, const char *path)
+{
+    memset(library, 0, sizeof(*library));
+
+    FILE *file = fopen(path, "rb");
+    if (!file) return(false);
+
+    Library_File_Header header = {0};
+    bool result = fread(&header, sizeof(header), 1, file) == 1 &&
+                  header.magic == LIBRARY_MAGIC && header.version == LIBRARY_VERSION && header.record_size == sizeof(Library_Record) &&
+                  header.count < UINT32_MAX && header.strings_len > 0 && header.strings_len < UINT32_MAX;
+
+    if (result) {
+        library->records = (Library_Record *) malloc((size_t) header.count*sizeof(Library_Record) + 1);
+        library->strings = (char *) malloc((size_t) header.strings_len);
+        library->count = library->cap = (size_t) header.count;
+        library->strings_len = library->strings_cap = (size_t) header.strings_len;
+
+        result = library->records && library->strings &&
+                 fread(library->records, sizeof(Library_Record), library->count, file) == library->count &&
+                 fread(library->strings, 1, library->strings_len, file) == library->strings_len &&
+                 library->strings[library->strings_len - 1] == 0;
+    }
+
+    for (size_t i = 0; result && i < library->count; ++i) {
+        if (library->records[i].path >= library->strings_len) result = false;
+    }
+
+    fclose(file);
+    if (!result) library_free(library);
+
+    return(result);
+}
+
+internal inline bool library_is_song(const char *name)
+{
+    const char *extension = strrchr(name, '.');
+    if (extension == 0) return(false);
+
+    return(library_same_path(extension, ".mid") || library_same_path(extension, ".midi"));
+}
+
+// @Note: Case-insensitive, on the file name only.
+internal inline bool library_matches(const Library *library, const Library_Record *record, const char *search)
+{
+    if (search[0] == 0) return(true);
+
+    const char *name = library_path(library, record);
+    for (const char *at = name; *at; ++at) {
+        if (*at == '/' || *at == '\\') name = at + 1;
+    }
+
+    for (const char *start = name; *start; ++start) {
+        size_t i = 0;
+        for (; search[i]; ++i) {
+            char a = start[i] >= 'A' && start[i] <= 'Z' ? (char) (start[i] - 'A' + 'a') : start[i];
+            char b = search[i] >= 'A' && search[i] <= 'Z' ? (char) (search[i] - 'A' + 'a') : search[i];
+            if (a != b) break;
+        }
+        if (search[i] == 0) return(true);
+    }
+
+    return(false);
+}
+
+#endif // LIBRARY_H
@@ -0,0 +1,96 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdarg.h>
+
+// @Note: Every thread logs into the same ring of fixed-size records, and
+// whoever wants to see them (the UI's history, the log file writer) reads
+// at its own pace with its own 'Log_Reader'. Writing claims a slot with one
+// fetch_add and never waits for a reader, if a reader falls a whole ring
+// behind it skips what it missed and counts it.
+//
+// Every cell has a sequence number, 2*n + 1 while record n is being
+// written into it and 2*n + 2 once it's done. A reader copies the record
+// out and checks the sequence didn't move while it did (seqlock style).
+
+#define LOG_LEN 256 // @Note: Must be a power of two.
+#define LOG_TEXT_LEN 120
+
+struct Log_Record {
+    uint64_t time_ns;
+    char text[LOG_TEXT_LEN];
+};
+
+struct Log_Cell {
+    std::atomic<uint64_t> sequence;
+    Log_Record record;
+};
+
+struct Log {
+    Log_Cell cells[LOG_LEN];
+    std::atomic<uint64_t> head; // @Note: Records ever claimed.
+};
+
+struct Log_Reader {
+    uint64_t next;
+    uint64_t missed;
+};
+
+internal inline void log_pushv(Log *log, uint64_t time_ns, const char *format, va_list args)
+{
+    uint64_t index = log->head.fetch_add(1, std::memory_order_relaxed);
+    Log_Cell *cell = &log->cells[index & (LOG_LEN - 1)];
+
+    cell->sequence.store(2*index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    cell->record.time_ns = time_ns;
+    vsnprintf(cell->record.text, LOG_TEXT_LEN, format, args);
+
+    cell->sequence.store(2*index + 2, std::memory_order_release);
+}
+
+internal inline void log_push(Log *log, uint64_t time_ns, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_pushv(log, time_ns, format, args);
+    va_end(args);
+}
+
+// @Note: False when there's nothing new yet (or the next record is still being written).
+internal inline bool log_read(Log *log, Log_Reader *reader, Log_Record *record)
+{
+    for (;;) {
+        uint64_t head = log->head.load(std::memory_order_acquire);
+        if (reader->next >= head) return(false);
+
+        if (head - reader->next > LOG_LEN) {
+            reader->missed += head - LOG_LEN - reader->next;
+            reader->next = head - LOG_LEN;
+        }
+
+        const Log_Cell *cell = &log->cells[reader->next & (LOG_LEN - 1)];
+        uint64_t expected = 2*reader->next + 2;
+        uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+
+        if (sequence < expected) return(false);
+
+        if (sequence == expected) {
+            *record = cell->record;
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (cell->sequence.load(std::memory_order_relaxed) == expected) {
+                record->text[LOG_TEXT_LEN - 1] = 0;
+                reader->next += 1;
+                return(true);
+            }
+        }
+
+        // @Note: Overwritten under us, try again from wherever the ring is now.
+        reader->missed += 1;
+        reader->next += 1;
+    }
+}
+
+#endif // LOG_H
@@ -5,12 +5,31 @@
 
 #include <raylib/raylib.h>
 #include <raylib/raymath.h>
+#include <raylib/rlgl.h>
 
+#include "./base.h"
 #include "./font.h"
 #include "./vk.h"
-
-#define UNUSED(x) ((void)(x))
-#define ARR_SZ(arr) (sizeof(arr)/sizeof(arr[0]))
+#include "./timer.h"
+#include "./midi.h"
+#include "./config.h"
+#include "./config_text.h"
+#include "./profiler.h"
+#include "./queue.h"
+#include "./log.h"
+#include "./receive.h"
+#include "./filter.h"
+#include "./strum.h"
+#include "./timer_wheel.h"
+#include "./trace.h"
+#include "./note_roll.h"
+#include "./pipeline.h"
+#include "./smf.h"
+#include "./octave.h"
+#include "./voice.h"
+#include "./timeline.h"
+#include "./library.h"
+#include "./journal.h"
 
 // @Note: Please, if anyone has a better solution for this _without namespaces_
 // I'll gladly take it
@@ -30,26 +49,55 @@
 #undef ShowCursor
 #endif // _WIN32
 
-#define NOTE_ON 0x90
-#define NOTE_OFF 0x80
-#define NOTE_OFFSET 48
-
-#define internal static
-#define global static
-
 #define WIDTH 1280
 #define HEIGHT 720
 #define MIN_WIDTH 1100
 #define MIN_HEIGHT 700
 #define FPS 60
 
-#define WHITE_KEYS_LEN 22
-#define BLACK_KEYS_LEN 15
-#define MIDI_FULL_LEN (WHITE_KEYS_LEN + BLACK_KEYS_LEN)
-
 #define DEFAULT_CONFIG_FILE "config.dat"
-#define CONFIG_LEN 4
-#define CONFIG_NAME_LEN 32
+#define CONFIG_TEMP_FILE "config.dat.tmp"
+#define CONFIG_JOURNAL_FILE "config.journal"
+#define JOURNAL_BATCH_MS 50 // @Note: How long the journal thread lets edits pile up before a write + flush.
+#define JOURNAL_COMPACT_SIZE (256*1024)
+#define CONFIG_FILE_NAME_W L"config.dat" // @Note: What the config watcher compares against, relative to the working directory.
+#define DEFAULT_VELOCITY_THRESHOLD_1 96
+#define DEFAULT_VELOCITY_THRESHOLD_2 120
+#define PROFILER_TRACE_FILE "maidai_trace.json"
+#define PROFILES_TEXT_FILE "profiles.txt"
+#define PROFILES_TEXT_CAP (64*1024)
+
+#define KEYBOARD_QUADS_CAP 4096
+#define KEYBOARD_CORNER_SEGMENTS 4
+
+#define NOTE_ROLL_PIXELS_PER_SECOND 160.0f
+#define NOTE_ROLL_PLAYHEAD 0.6f // @Note: Where "now" is, as a fraction of the roll's height from the top.
+
+#define LOG_HISTORY_LEN 1024
+#define LOG_FILE "maidai.log"
+#define LOG_FILE_MAX_SIZE (1024*1024)
+#define LOG_FILE_BACKUPS 2 // @Note: maidai.log.1 is the newest.
+#define LOG_FILE_INTERVAL_MS 250
+
+#define TRACE_FILE "maidai.trace"
+#define TRACE_WRITE_INTERVAL_MS 100
+
+#define PLAYBACK_LEAD_MS 3000 // @Note: Time to switch over to the game after starting a timeline.
+#define PLAYBACK_PATH_LEN 260
+#define PLAYBACK_MIN_SPAN_NS 100000000ull // @Note: Taps are a few ms long, that's invisible on the note roll.
+#define PLAYBACK_SEEK_STEP_MS 5000
+#define PLAYBACK_MIN_LOOP_MS 500
+
+#define SETLIST_LEN 64
+
+#define LIBRARY_DIR "songs"
+#define LIBRARY_INDEX_FILE "maidai.library"
+#define LIBRARY_WORKERS_CAP 16
+#define LIBRARY_DEPTH_CAP 8
+#define LIBRARY_SEARCH_LEN 64
+
+#define SYSEX_BUFFERS_LEN 8
+#define SYSEX_BUFFER_SIZE 1024
 
 struct Note {
     Rectangle rect;
@@ -59,36 +107,496 @@ struct Note {
     bool hovered; // @Robustness: We should find a way to get rid of this boolean
 };
 
-struct Config {
-    char name[CONFIG_NAME_LEN];
-    int keys_map[MIDI_FULL_LEN];
+enum Settings_Page {
+    SETTINGS_PAGE_INPUT = 0,
+    SETTINGS_PAGE_OUTPUT,
+    SETTINGS_PAGE_VELOCITY,
+    SETTINGS_PAGE_CONTROLS,
+    SETTINGS_PAGE_COUNT,
+};
+
+global const char *const settings_page_names[SETTINGS_PAGE_COUNT] = { "Input", "Output", "Velocity", "Controls" };
+global const char *const receive_names[2] = { "Keep", "Drop" };
+global const char *const layer_names[VELOCITY_LAYERS_LEN + 1] = { "Base", "Layer 1", "Layer 2" };
+
+// @Note: Fixed set of buffers winmm fills with SysEx. The callback isn't
+// allowed to call back into winmm, so it only marks a buffer as returned and
+// the UI thread (which owns the device) hands it back with midiInAddBuffer().
+// Nothing is allocated after the device is opened.
+struct Sysex_Pool {
+    MIDIHDR headers[SYSEX_BUFFERS_LEN];
+    char data[SYSEX_BUFFERS_LEN][SYSEX_BUFFER_SIZE];
+    std::atomic<uint32_t> returned; // @Note: One bit per header.
+
+    std::atomic<uint32_t> messages;
+    std::atomic<uint32_t> errors; // @Note: Incomplete SysEx and invalid short messages.
+    std::atomic<uint32_t> backlog; // @Note: MIM_MOREDATA, i.e. we weren't keeping up with the driver.
+};
+
+// @Note: Watches the directory config.dat is in and reparses it in the
+// background when something else changes it. The reload is staged here and
+// handed to the UI thread, which owns 'state.configs'.
+struct Config_Watcher {
+    HANDLE thread;
+    HANDLE stop;
+    std::atomic<bool> ready;
+
+    Config configs[CONFIG_LEN];
+    Pipeline_Settings settings;
+    Mapping_Table *tables;
+};
+
+// @Note: See journal.h. 'shadow_*' is what the UI thread has logged so far,
+// 'configs'/'settings' is the journal thread's own copy, built up from the
+// records, which is what it compacts into config.dat.
+struct Config_Journal {
+    HANDLE thread;
+    HANDLE wakeup;
+    std::atomic<bool> running;
+    Journal_Ring ring;
+
+    Config shadow_configs[CONFIG_LEN];
+    Pipeline_Settings shadow_settings;
+    
+    Config configs[CONFIG_LEN];
+    Pipeline_Settings settings;
+    HANDLE file;
+    size_t file_size;
+    
+    std::atomic<uint32_t> snapshot_hash;
+};
+
+// @Note: The whole keyboard (keys, tooltips, labels) as one set of quads in
+// GPU buffers. Text is drawn straight from the font atlas, and everything
+// else samples a white texel in that same atlas, so nothing ever switches
+// textures. All of it is drawn into the keyboard's UI layer (see 'Ui_Layer')
+// when that's dirty, and on every frame only the keys that aren't in their
+// resting colour are drawn again on top of it, in a single draw call.
+struct Keyboard_Batch {
+    Vector2 positions[KEYBOARD_QUADS_CAP*4];
+    Vector2 texcoords[KEYBOARD_QUADS_CAP*4];
+    Color colors[KEYBOARD_QUADS_CAP*4];
+    int quads;
+    bool colors_dirty;
+
+    Note keys[MIDI_FULL_LEN]; // @Note: White keys first, they're drawn under the black ones.
+    int key_quads[MIDI_FULL_LEN]; // @Note: A key's quads run up to the next key's first one.
+    Vector2 white_texcoord;
+
+    unsigned int vao;
+    unsigned int position_vbo;
+    unsigned int texcoord_vbo;
+    unsigned int color_vbo;
+    unsigned int index_vbo;
+
+    // @Note: Same vertex buffers, indices for just the keys drawn this frame.
+    unsigned int dynamic_vao;
+    unsigned int dynamic_index_vbo;
+    unsigned short dynamic_indices[KEYBOARD_QUADS_CAP*6];
+
+    // @Note: What the layout was last built for.
+    bool built;
+    Rectangle rect;
+    int key_width;
+    int key_padding;
+};
+
+enum Ui_Layer_Id {
+    UI_LAYER_KEYBOARD = 0,
+    UI_LAYER_CONTROL_PANEL,
+    UI_LAYER_COUNT,
+};
+
+#define UI_LAYER_BIT(layer) (1 << (layer))
+#define UI_LAYERS_ALL (UI_LAYER_BIT(UI_LAYER_COUNT) - 1)
+
+// @Note: Parts of the window that only change on clicks and edits, drawn
+// into a texture once and copied to the screen every frame after that.
+// Whatever changes what a layer shows has to 'ui_invalidate()' it.
+struct Ui_Layer {
+    RenderTexture2D target;
+    Rectangle rect;
+    bool dirty;
+};
+
+// @Note: Live numbers shown on the control panel, it's redrawn when they move.
+struct Ui_Readout {
+    uint32_t dropped[MIDI_CLASS_COUNT];
+    uint32_t sysex[3];
+    uint64_t paced_events;
+    uint64_t paced_dropped;
+    size_t config_id;
+};
+
+// @Note: GPU side of the piano roll, one unit quad drawn once per slot of
+// the span ring. The vertex shader places every span from its times, so
+// scrolling is just a new 'now' uniform and nothing gets uploaded unless a
+// span was added or ended.
+struct Note_Roll_Renderer {
+    Shader shader;
+    int span_loc;
+    int now_loc;
+    int playhead_loc;
+    int scale_loc;
+    int bounds_loc;
+    int lanes_loc;
+    
+    unsigned int vao;
+    unsigned int quad_vbo;
+    unsigned int index_vbo;
+    unsigned int span_vbo;
+};
+
+// @Note: Lanes are (x, width, is black key, unused), times are in seconds.
+global const char *note_roll_vertex_shader =
+    "#version 330\n"
+    "in vec3 vertexPosition;\n"
+    "in vec4 span;\n"
+    "uniform mat4 mvp;\n"
+    "uniform float now;\n"
+    "uniform float playhead;\n"
+    "uniform float scale;\n"
+    "uniform vec2 bounds;\n"
+    "uniform vec4 lanes[%d];\n"
+    "out vec4 fragColor;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 lane = lanes[int(span.z)];\n"
+    "    float end = span.y < 0.0 ? now : span.y;\n"
+    "    float top = clamp(playhead - (end - now)*scale, bounds.x, bounds.y);\n"
+    "    float bottom = clamp(playhead - (span.x - now)*scale, bounds.x, bounds.y);\n"
+    "    vec2 position = vec2(lane.x + vertexPosition.x*lane.y, mix(top, bottom, vertexPosition.y));\n"
+    "    vec3 color = mix(vec3(0.20, 0.35, 0.80), vec3(0.35, 0.85, 1.00), span.w/127.0);\n"
+    "    if (lane.z > 0.5) color *= 0.7;\n"
+    "    fragColor = vec4(color, span.x > now ? 0.5 : 1.0);\n"
+    "    gl_Position = mvp*vec4(position, 0.0, 1.0);\n"
+    "}\n";
+
+global const char *note_roll_fragment_shader =
+    "#version 330\n"
+    "in vec4 fragColor;\n"
+    "out vec4 finalColor;\n"
+    "void main()\n"
+    "{\n"
+    "    finalColor = fragColor;\n"
+    "}\n";
+
+// @Note: What the UI has read from the log so far, newest last.
+struct Log_History {
+    Log_Reader reader;
+    Log_Record records[LOG_HISTORY_LEN];
+    size_t count; // @Note: Total ever read, the newest is at '(count - 1) % LOG_HISTORY_LEN'.
+    int scroll; // @Note: Lines back from the newest.
+    bool visible;
+};
+
+// @Note: Writes the log out on its own thread, so nobody who logs ever
+// touches the disk. Rotates to 'LOG_FILE.1', '.2' and so on when it gets big.
+struct Log_File {
+    HANDLE thread;
+    HANDLE stop;
+    Log_Reader reader;
+    HANDLE file;
+    size_t file_size;
+};
+
+// @Note: One trace buffer per thread that touches MIDI events, see trace.h.
+enum Trace_Thread {
+    TRACE_THREAD_CALLBACK = 0,
+    TRACE_THREAD_INJECTION,
+    TRACE_THREAD_COUNT,
+};
+
+struct Trace_Writer {
+    Trace_Buffer buffers[TRACE_THREAD_COUNT];
+    bool running;
+    HANDLE thread;
+    HANDLE stop;
+    HANDLE file;
+    uint64_t records;
+};
+
+enum Playback_State {
+    PLAYBACK_IDLE = 0,
+    PLAYBACK_STARTING, // @Note: Mapped by the UI thread, waiting for the injection thread to pick it up.
+    PLAYBACK_PLAYING,
+    PLAYBACK_STOPPING, // @Note: The UI thread wants it stopped, the injection thread lets go of the keys.
+    PLAYBACK_DONE, // @Note: The injection thread is done with it, the UI thread unmaps it.
+};
+
+// @Note: A compiled timeline (see timeline.h) replayed by the injection
+// thread. The UI thread maps the file and owns the mapping, the injection
+// thread owns the player, 'state' is how they hand it back and forth.
+struct Playback {
+    std::atomic<int> state;
+    std::atomic<size_t> position; // @Note: Records sent so far, for the UI.
+
+    HANDLE file;
+    HANDLE mapping;
+    const void *view;
+    Timeline compiled; // @Note: What 'records' points into when it's a setlist song instead of a file.
+    const Timeline_Record *records;
+    size_t count;
+    uint64_t duration_ns;
+    uint64_t start_ns; // @Note: When song time 0 is (or would have been), UI thread only once it's playing.
+    char path[PLAYBACK_PATH_LEN];
+    Timeline_Checkpoint *checkpoints;
+    size_t checkpoints_len;
+
+    // @Note: Loop region as the UI thread last asked for it, 'loop_end_ns' 0 for none.
+    uint64_t loop_start_ns;
+    uint64_t loop_end_ns;
+    uint64_t loop_mark_ns; // @Note: Where '[' was pressed, waiting for ']'.
+    bool loop_marked;
+
+    // @Note: A seek for the injection thread, the UI thread only fills it in
+    // while 'request' is false, the injection thread clears it once it's done.
+    std::atomic<bool> request;
+    uint64_t request_time_ns;
+    uint64_t request_at_ns;
+    uint64_t request_loop_start_ns;
+    uint64_t request_loop_end_ns;
+
+    size_t roll_cursor; // @Note: Next record to put on the note roll, UI thread only.
+    uint64_t roll_start_ns; // @Note: 'start_ns' for 'roll_cursor', it's ahead of 'start_ns' once the roll has looped.
+    Timeline_Player player;
+};
+
+enum Library_Scan_State {
+    LIBRARY_SCAN_IDLE = 0,
+    LIBRARY_SCAN_RUNNING, // @Note: The scan thread builds 'scanned' out of 'library', which nobody writes meanwhile.
+    LIBRARY_SCAN_DONE, // @Note: 'scanned' is ready, the UI thread swaps it in.
+};
+
+// @Note: The song library (F9), see library.h. The UI only ever lists what's
+// in the index, a rescan runs on its own thread and swaps in once it's done.
+struct Library_Browser {
+    Library library;
+    uint32_t *matches; // @Note: Records whose name matches 'search', in order.
+    size_t matches_len;
+    char search[LIBRARY_SEARCH_LEN];
+    int scroll;
+    bool visible;
+
+    std::atomic<int> scan_state;
+    HANDLE scan_thread;
+    Library scanned;
+    bool scan_ok;
+    Library_Scan scan;
+    uint32_t *jobs;
+    size_t jobs_len;
+    size_t jobs_cap;
+    char dir[PLAYBACK_PATH_LEN];
+};
+
+enum Setlist_State {
+    SETLIST_EMPTY = 0,
+    SETLIST_COMPILING, // @Note: The compile thread owns everything below 'state'.
+    SETLIST_READY, // @Note: Compiled, whoever gets to it first takes it (see 'check_setlist()').
+    SETLIST_FAILED,
+    SETLIST_TAKEN, // @Note: The injection thread is playing it from 'start_ns', the UI thread moves it into 'Playback'.
+};
+
+// @Note: Songs (MIDI files) played back to back. The UI thread owns the
+// queue. While one song plays, the next one is compiled (see timeline.h) on
+// its own thread, and the injection thread switches over to it right where
+// the current one ends, so there's nothing left to do in between but swap
+// two pointers.
+struct Setlist {
+    char paths[SETLIST_LEN][PLAYBACK_PATH_LEN];
+    int transposes[SETLIST_LEN];
+    size_t count;
+    size_t next; // @Note: Next one to compile.
+    bool discard; // @Note: Playback was stopped, whatever's being compiled isn't wanted anymore.
+
+    std::atomic<int> state;
+    HANDLE thread;
+    char path[PLAYBACK_PATH_LEN];
+    Mapping_Table table;
+    Timeline_Options options;
+    Timeline timeline;
+    Timeline_Checkpoint *checkpoints;
+    size_t checkpoints_len;
+    uint64_t start_ns;
 };
 
 struct Internal_State {
-    const char *log_message;
     int active_key = -1; // @Note: Means no active key at startup
+    int active_modifier; // @Note: Modifier held on its own while mapping, see 'check_key_assignment()'
+    int active_control = -1; // @Note: Control mapping waiting for a key, same as 'active_key'
 
     bool highlighted_notes[MIDI_FULL_LEN];
     Config configs[CONFIG_LEN];
-    size_t config_id;
+    
+    // @Note: Two sets of mapping tables, the injection thread reads the live
+    // one, the config watcher builds a reloaded config into the other. See
+    // 'acquire_tables()' for how they make sure they don't overlap.
+    Mapping_Table table_buffers[2][CONFIG_LEN];
+    std::atomic<Mapping_Table *> tables;
+    std::atomic<const Mapping_Table *> tables_in_use;
+    std::atomic<size_t> config_id;
+    int edit_layer;
+    int edit_control;
+    int settings_page;
+    
+    bool learning_control;
+    uint32_t learn_controls_seen;
 
     bool device_connected;
     HMIDIIN midi_handle;
+    Sysex_Pool sysex;
+
+    Receive_Filter receive_filter;
+    Midi_Queue midi_queue;
+    Pipeline pipeline;
+    Pipeline_Settings settings;
+    
+    HANDLE injection_thread;
+    HANDLE injection_wakeup;
+    HANDLE injection_timer;
+    std::atomic<bool> injection_running;
+
+    Config_Watcher watcher;
+    Config_Journal journal;
 
     Font font;
+    Keyboard_Batch keyboard;
+    Ui_Layer layers[UI_LAYER_COUNT];
+    Ui_Readout readout;
+
+    Note_Roll note_roll;
+    Note_Roll_Events note_roll_events;
+    Note_Roll_Renderer roll_renderer;
+
+    uint64_t start_ns;
+    Log log;
+    Log_History history;
+    Log_File log_file;
+    Trace_Writer trace;
+    Playback playback;
+    Setlist setlist;
+    Library_Browser browser;
 };
 
 // @Note: For all new programmers, I'm sorry but real life isn't how your CS professor wants it to be.
 // In real life you deal with globals and that's fine, as long as you know how to handle them and who
 // and when is going to touch them.
-global Internal_State state = {0};
+global Internal_State state = {};
+
+// @Note: From any thread, never blocks. See log.h.
+internal void log_print(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_pushv(&state.log, get_time_ns(), format, args);
+    va_end(args);
+}
 
 internal void draw_text_centered(const char *text, int x, int y, float font_size, Color color)
 {
+    PROFILE_ZONE(PROFILE_ZONE_TEXT);
+    
     Vector2 text_width = MeasureTextEx(state.font, text, (float) font_size, 1.0f);
     DrawTextEx(state.font, text, { x - text_width.x/2.0f, y - font_size/2.0f }, font_size, 1.0f, color);
 }
 
+internal void ui_invalidate(int layers)
+{
+    for (int i = 0; i < UI_LAYER_COUNT; ++i) {
+        if (layers & UI_LAYER_BIT(i)) state.layers[i].dirty = true;
+    }
+}
+
+// @Note: Returns true when the layer has to be redrawn, everything drawn
+// until 'ui_layer_end()' goes into its texture, in screen coordinates.
+// The texture is opaque ('background'), so it can be copied without blending.
+internal bool ui_layer_begin(int id, Rectangle rect, Color background)
+{
+    Ui_Layer *layer = &state.layers[id];
+    int width = (int) rect.width;
+    int height = (int) rect.height;
+    if (width <= 0 || height <= 0) return(false);
+
+    if (layer->target.id == 0 || layer->target.texture.width != width || layer->target.texture.height != height) {
+        if (layer->target.id != 0) UnloadRenderTexture(layer->target);
+        layer->target = LoadRenderTexture(width, height);
+        layer->dirty = true;
+    }
+    
+    if (rect.x != layer->rect.x || rect.y != layer->rect.y) layer->dirty = true;
+    layer->rect = rect;
+    if (!layer->dirty) return(false);
+
+    BeginTextureMode(layer->target);
+    ClearBackground(background);
+    
+    rlPushMatrix();
+    rlTranslatef(-rect.x, -rect.y, 0.0f);
+    
+    return(true);
+}
+
+internal void ui_layer_end(int id)
+{
+    rlPopMatrix();
+    EndTextureMode();
+    
+    state.layers[id].dirty = false;
+}
+
+internal void ui_layer_draw(int id)
+{
+    const Ui_Layer *layer = &state.layers[id];
+    if (layer->target.id == 0) return;
+
+    // @Note: Render textures come out upside down.
+    Rectangle source = { 0, 0, (float) layer->target.texture.width, (float) -layer->target.texture.height };
+    DrawTextureRec(layer->target.texture, source, { layer->rect.x, layer->rect.y }, WHITE);
+}
+
+internal void ui_unload_layers()
+{
+    for (int i = 0; i < UI_LAYER_COUNT; ++i) {
+        if (state.layers[i].target.id != 0) UnloadRenderTexture(state.layers[i].target);
+    }
+}
+
+// @Note: Everything that can change what the layers show without going
+// through a click or an edit, like the injection thread switching profiles
+// or the counters on the control panel moving.
+internal void ui_check_invalidation()
+{
+    Ui_Readout readout = {0};
+    for (int i = 0; i < MIDI_CLASS_COUNT; ++i) {
+        readout.dropped[i] = state.receive_filter.dropped[i].load(std::memory_order_relaxed);
+    }
+    
+    readout.sysex[0] = state.sysex.messages.load(std::memory_order_relaxed);
+    readout.sysex[1] = state.sysex.errors.load(std::memory_order_relaxed);
+    readout.sysex[2] = state.sysex.backlog.load(std::memory_order_relaxed);
+    readout.paced_events = state.pipeline.pacer.paced_events;
+    readout.paced_dropped = state.pipeline.pacer.dropped;
+    readout.config_id = state.config_id.load(std::memory_order_relaxed);
+
+    if (readout.config_id != state.readout.config_id) ui_invalidate(UI_LAYERS_ALL);
+    if (memcmp(&readout, &state.readout, sizeof(readout)) != 0) ui_invalidate(UI_LAYER_BIT(UI_LAYER_CONTROL_PANEL));
+    state.readout = readout;
+
+    // @Note: Hovering and clicking only ever touch the panel, the keyboard
+    // handles its own hover and highlights on top of its layer.
+    const Ui_Layer *panel = &state.layers[UI_LAYER_CONTROL_PANEL];
+    Vector2 mouse = GetMousePosition();
+    Vector2 delta = GetMouseDelta();
+    Vector2 last_mouse = { mouse.x - delta.x, mouse.y - delta.y };
+    
+    bool moved = delta.x != 0.0f || delta.y != 0.0f;
+    if (moved && (CheckCollisionPointRec(mouse, panel->rect) || CheckCollisionPointRec(last_mouse, panel->rect))) {
+        ui_invalidate(UI_LAYER_BIT(UI_LAYER_CONTROL_PANEL));
+    }
+    
+    if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) ui_invalidate(UI_LAYER_BIT(UI_LAYER_CONTROL_PANEL));
+}
+
 // @Robustness: Find a better way of figuring out the colour, possible
 // refactor of 'render_keyboard()'
 internal Color get_colour_from_state(int note_number, Color color)
@@ -99,211 +607,2434 @@ internal Color get_colour_from_state(int note_number, Color color)
     return(color);
 }
 
-internal void load_default_configs()
+internal void load_default_configs(Config *configs)
 {
-    strncpy(state.configs[0].name, "Default", CONFIG_NAME_LEN);
+    memset(configs, 0, sizeof(Config)*CONFIG_LEN);
+    
+    strncpy(configs[0].name, "Default", CONFIG_NAME_LEN);
     const char *keys_default = "Q2W3ER5T6Y7UI";
     
     for (size_t i = 0; i < strlen(keys_default); ++i) {
-        state.configs[0].keys_map[i + 12] = keys_default[i];
+        configs[0].keys_map[i + 12] = keys_default[i];
     }
 
-    strncpy(state.configs[1].name, "Genshin", CONFIG_NAME_LEN);
+    strncpy(configs[1].name, "Genshin", CONFIG_NAME_LEN);
     const char *keys_genshin = "QWERTYUASDFGHJZXCVBNM";
     size_t indices[] = { 0, 2, 4, 5, 7, 9, 11, 12, 14, 16, 17, 19, 21, 23, 24, 26, 28, 29, 31, 33, 35, 36 };
     for (size_t i = 0; i < ARR_SZ(indices); ++i) {
-        state.configs[1].keys_map[indices[i]] = keys_genshin[i];
+        configs[1].keys_map[indices[i]] = keys_genshin[i];
     }
     
-    strncpy(state.configs[2].name, "Custom_1", CONFIG_NAME_LEN);
+    strncpy(configs[2].name, "Custom_1", CONFIG_NAME_LEN);
+    for (size_t i = 0; i < MIDI_FULL_LEN; ++i) {
+        configs[2].keys_map[i] = 0;
+    }
+
+    strncpy(configs[3].name, "Custom_2", CONFIG_NAME_LEN);
     for (size_t i = 0; i < MIDI_FULL_LEN; ++i) {
-        state.configs[2].keys_map[i] = 0;
+        configs[3].keys_map[i] = 0;
+    }
+
+    for (size_t i = 0; i < CONFIG_LEN; ++i) {
+        configs[i].velocity_thresholds[0] = DEFAULT_VELOCITY_THRESHOLD_1;
+        configs[i].velocity_thresholds[1] = DEFAULT_VELOCITY_THRESHOLD_2;
+    }
+}
+
+// @Note: Has to be called every time a config's mappings or thresholds change,
+// the injection thread only ever looks at the LUT.
+internal void rebuild_mapping_table(size_t config_id)
+{
+    config_build_table(&state.configs[config_id], &state.tables.load(std::memory_order_relaxed)[config_id]);
+    ui_invalidate(UI_LAYERS_ALL);
+}
+
+// @Note: Fills in whatever 'file_path' has on top of what's already in
+// 'configs' and 'settings'. Returns false if there's no usable file.
+// 'file_hash' (optional) gets a hash of the raw file, see 'write_config_snapshot()'.
+internal bool read_config_file(const char *file_path, Config *configs, Pipeline_Settings *settings, uint32_t *file_hash)
+{
+    bool result = false;
+    int file_size = 0;
+    unsigned char *data = FileExists(file_path) ? LoadFileData(file_path, &file_size) : 0;
+
+    if (data != 0) {
+        if (file_hash) *file_hash = journal_hash(2166136261u, data, (size_t) file_size);
+        
+        Config_File_Header header = {0};
+        if ((size_t) file_size >= sizeof(header)) memcpy(&header, data, sizeof(header));
+
+        if (header.magic == CONFIG_FILE_MAGIC) {
+            size_t configs_end = sizeof(header) + header.configs_size;
+            size_t settings_end = configs_end + header.settings_size;
+            
+            // @Note: Files from older versions have smaller structs, whatever
+            // they do have is a prefix of ours and the rest keeps its default.
+            size_t config_stride = header.configs_size / CONFIG_LEN;
+            
+            if (config_stride <= sizeof(Config) && configs_end <= (size_t) file_size) {
+                for (size_t i = 0; i < CONFIG_LEN; ++i) {
+                    memcpy(&configs[i], data + sizeof(header) + i*config_stride, config_stride);
+                }
+                
+                result = true;
+            }
+            
+            if (header.settings_size <= sizeof(*settings) && settings_end <= (size_t) file_size) {
+                memcpy(settings, data + configs_end, header.settings_size);
+            }
+        } else if ((size_t) file_size >= sizeof(Config_V1)*CONFIG_LEN) {
+            for (size_t i = 0; i < CONFIG_LEN; ++i) {
+                const Config_V1 *old = &((Config_V1 *) data)[i];
+                memcpy(configs[i].name, old->name, sizeof(old->name));
+                memcpy(configs[i].keys_map, old->keys_map, sizeof(old->keys_map));
+            }
+            
+            result = true;
+        }
+
+        UnloadFileData(data);
+    }
+
+    return(result);
+}
+
+internal void load_configs(const char *file_path)
+{
+    load_default_configs(state.configs);
+    state.settings = default_pipeline_settings();
+    read_config_file(file_path, state.configs, &state.settings, 0);
+
+    for (size_t i = 0; i < CONFIG_LEN; ++i) {
+        rebuild_mapping_table(i);
+    }
+}
+
+// @Note: Written to a temp file, flushed and renamed over the old one, so
+// config.dat is always either the old or the new version, never half of each.
+// Returns the hash of what was written (0 if it failed), which is how the
+// config watcher tells our own writes apart.
+internal uint32_t write_config_snapshot(const char *file_path, const Config *configs, const Pipeline_Settings *settings)
+{
+    static unsigned char data[sizeof(Config_File_Header) + sizeof(Config)*CONFIG_LEN + sizeof(Pipeline_Settings)];
+    
+    Config_File_Header header = {0};
+    header.magic = CONFIG_FILE_MAGIC;
+    header.version = CONFIG_FILE_VERSION;
+    header.configs_size = (uint32_t) (sizeof(Config)*CONFIG_LEN);
+    header.settings_size = (uint32_t) sizeof(Pipeline_Settings);
+
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), configs, sizeof(Config)*CONFIG_LEN);
+    memcpy(data + sizeof(header) + sizeof(Config)*CONFIG_LEN, settings, sizeof(Pipeline_Settings));
+
+    HANDLE file = CreateFileA(CONFIG_TEMP_FILE, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE) return(0);
+
+    DWORD written = 0;
+    bool ok = WriteFile(file, data, sizeof(data), &written, 0) && written == sizeof(data) && FlushFileBuffers(file);
+    CloseHandle(file);
+
+    if (!ok) return(0);
+    
+    uint32_t hash = journal_hash(2166136261u, data, sizeof(data));
+    state.journal.snapshot_hash.store(hash, std::memory_order_release);
+    
+    if (!MoveFileExA(CONFIG_TEMP_FILE, file_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) return(0);
+
+    return(hash);
+}
+
+internal bool export_profiles_text(const char *file_path)
+{
+    static char text[PROFILES_TEXT_CAP];
+    size_t len = config_text_write(state.configs, CONFIG_LEN, text, sizeof(text));
+    if (len == 0) return(false);
+
+    return(SaveFileData(file_path, text, (int) len));
+}
+
+// @Note: The file is mapped instead of read, the parser works on it in place.
+// Profiles replace the configs in order, anything past CONFIG_LEN is ignored.
+internal void import_profiles_text(const char *file_path)
+{
+    HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE) {
+        log_print("Could not open %s", file_path);
+        return;
+    }
+
+    LARGE_INTEGER size = {0};
+    HANDLE mapping = 0;
+    const char *data = 0;
+    
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if (mapping) data = (const char *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (data) {
+        Config configs[CONFIG_LEN] = {0};
+        Config_Text_Result result = config_text_parse(data, (size_t) size.QuadPart, configs, CONFIG_LEN);
+        size_t imported = result.profiles < CONFIG_LEN ? result.profiles : CONFIG_LEN;
+
+        for (size_t i = 0; i < imported; ++i) {
+            state.configs[i] = configs[i];
+            rebuild_mapping_table(i);
+        }
+
+        if (result.errors > 0) {
+            log_print("Imported %zu profiles, %zu bad lines (first: %d)", imported, result.errors, result.first_error_line);
+        } else {
+            log_print("Imported %zu profiles", imported);
+        }
+        
+        state.active_key = -1;
+        state.active_control = -1;
+        
+        UnmapViewOfFile(data);
+    } else {
+        log_print("Could not open %s", file_path);
+    }
+
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+}
+
+internal void journal_open_file()
+{
+    Config_Journal *journal = &state.journal;
+    journal->file = CreateFileA(CONFIG_JOURNAL_FILE, GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    journal->file_size = 0;
+    if (journal->file == INVALID_HANDLE_VALUE) return;
+    
+    Config_File_Header header = {0};
+    header.magic = JOURNAL_MAGIC;
+    header.version = CONFIG_FILE_VERSION;
+    header.configs_size = (uint32_t) sizeof(journal->configs);
+    header.settings_size = (uint32_t) sizeof(journal->settings);
+
+    DWORD written = 0;
+    WriteFile(journal->file, &header, sizeof(header), &written, 0);
+    FlushFileBuffers(journal->file);
+    journal->file_size = written;
+}
+
+// @Note: Snapshot first, then start an empty journal. If we die in between,
+// the old journal gets replayed over the new snapshot, which is harmless.
+internal void journal_compact()
+{
+    Config_Journal *journal = &state.journal;
+    if (!write_config_snapshot(DEFAULT_CONFIG_FILE, journal->configs, &journal->settings)) return;
+
+    if (journal->file != INVALID_HANDLE_VALUE) CloseHandle(journal->file);
+    journal_open_file();
+}
+
+// @Note: Drains the ring, appends it in as few writes as fit in 'batch'
+// and flushes once at the end.
+internal void journal_flush()
+{
+    Config_Journal *journal = &state.journal;
+    static uint8_t batch[JOURNAL_RING_LEN];
+    static uint8_t payload[sizeof(Config)*CONFIG_LEN];
+    uint8_t *regions[JOURNAL_REGION_COUNT] = { (uint8_t *) journal->configs, (uint8_t *) &journal->settings };
+    bool wrote = false;
+
+    for (;;) {
+        size_t len = 0;
+        Journal_Record record = {0};
+        
+        while (len + sizeof(record) + sizeof(Config) <= sizeof(batch) && journal_ring_pop(&journal->ring, &record, payload)) {
+            memcpy(regions[record.region] + record.offset, payload, record.size);
+            memcpy(batch + len, &record, sizeof(record));
+            memcpy(batch + len + sizeof(record), payload, record.size);
+            len += sizeof(record) + record.size;
+        }
+
+        if (len == 0) break;
+        if (journal->file == INVALID_HANDLE_VALUE) continue;
+        
+        DWORD written = 0;
+        WriteFile(journal->file, batch, (DWORD) len, &written, 0);
+        journal->file_size += written;
+        wrote = true;
+    }
+
+    if (!wrote) return;
+    
+    FlushFileBuffers(journal->file);
+    if (journal->file_size > JOURNAL_COMPACT_SIZE) journal_compact();
+}
+
+internal DWORD WINAPI journal_thread_proc(LPVOID param)
+{
+    Config_Journal *journal = &state.journal;
+
+    // @Note: 'param' says whether startup replayed anything, only then is
+    // config.dat behind and worth rewriting.
+    if (param) journal_compact();
+    if (journal->file == INVALID_HANDLE_VALUE) journal_open_file();
+    
+    while (journal->running.load(std::memory_order_acquire)) {
+        WaitForSingleObject(journal->wakeup, INFINITE);
+
+        // @Note: Dragging a setting or mapping a bunch of keys comes in bursts,
+        // one flush for all of them instead of one each.
+        if (journal->running.load(std::memory_order_acquire)) Sleep(JOURNAL_BATCH_MS);
+        journal_flush();
+    }
+
+    journal_flush();
+    journal_compact();
+
+    return 0;
+}
+
+// @Note: Runs before the UI starts. Whatever the last session logged after
+// its last snapshot goes on top of config.dat, and the journal thread folds
+// it in.
+internal void start_config_journal()
+{
+    Config_Journal *journal = &state.journal;
+    size_t replayed = 0;
+    
+    int file_size = 0;
+    unsigned char *data = FileExists(CONFIG_JOURNAL_FILE) ? LoadFileData(CONFIG_JOURNAL_FILE, &file_size) : 0;
+    
+    if (data != 0) {
+        uint8_t *regions[JOURNAL_REGION_COUNT] = { (uint8_t *) state.configs, (uint8_t *) &state.settings };
+        size_t region_sizes[JOURNAL_REGION_COUNT] = { sizeof(state.configs), sizeof(state.settings) };
+        
+        replayed = journal_replay(data, (size_t) file_size, regions, region_sizes);
+        if (replayed > 0) {
+            for (size_t i = 0; i < CONFIG_LEN; ++i) rebuild_mapping_table(i);
+        }
+        
+        UnloadFileData(data);
+    }
+
+    memcpy(journal->shadow_configs, state.configs, sizeof(state.configs));
+    memcpy(journal->configs, state.configs, sizeof(state.configs));
+    journal->shadow_settings = state.settings;
+    journal->settings = state.settings;
+
+    journal->file = INVALID_HANDLE_VALUE;
+
+    journal->running.store(true);
+    journal->wakeup = CreateEvent(0, FALSE, FALSE, 0);
+    journal->thread = CreateThread(0, 0, journal_thread_proc, (LPVOID) (uintptr_t) (replayed > 0), 0, 0);
+    SetThreadPriority(journal->thread, THREAD_PRIORITY_BELOW_NORMAL);
+}
+
+internal void stop_config_journal()
+{
+    Config_Journal *journal = &state.journal;
+    journal->running.store(false, std::memory_order_release);
+    SetEvent(journal->wakeup);
+
+    WaitForSingleObject(journal->thread, INFINITE);
+    CloseHandle(journal->thread);
+    CloseHandle(journal->wakeup);
+    if (journal->file != INVALID_HANDLE_VALUE) CloseHandle(journal->file);
+}
+
+// @Note: Called once a frame, after everything that can edit a config. A
+// diff of a few KB is cheaper than remembering to log at every place that
+// changes something. If the ring is full, the shadow isn't updated and
+// the same range is tried again next frame.
+internal void journal_config_edits()
+{
+    Config_Journal *journal = &state.journal;
+    bool pushed = false;
+    size_t first = 0;
+    size_t last = 0;
+
+    for (size_t i = 0; i < CONFIG_LEN; ++i) {
+        uint8_t *shadow = (uint8_t *) &journal->shadow_configs[i];
+        const uint8_t *current = (const uint8_t *) &state.configs[i];
+        if (!journal_diff(shadow, current, sizeof(Config), &first, &last)) continue;
+
+        size_t offset = i*sizeof(Config) + first;
+        if (!journal_ring_push(&journal->ring, JOURNAL_REGION_CONFIGS, offset, current + first, last - first)) break;
+
+        memcpy(shadow + first, current + first, last - first);
+        pushed = true;
+    }
+
+    uint8_t *shadow = (uint8_t *) &journal->shadow_settings;
+    const uint8_t *current = (const uint8_t *) &state.settings;
+    if (journal_diff(shadow, current, sizeof(Pipeline_Settings), &first, &last) &&
+        journal_ring_push(&journal->ring, JOURNAL_REGION_SETTINGS, first, current + first, last - first)) {
+        memcpy(shadow + first, current + first, last - first);
+        pushed = true;
+    }
+
+    if (pushed) SetEvent(journal->wakeup);
+}
+
+internal void log_file_open()
+{
+    Log_File *log_file = &state.log_file;
+    log_file->file = CreateFileA(LOG_FILE, GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    log_file->file_size = 0;
+    if (log_file->file == INVALID_HANDLE_VALUE) return;
+
+    SYSTEMTIME now = {0};
+    GetLocalTime(&now);
+    
+    char line[96] = {0};
+    int len = snprintf(line, sizeof(line), "Session started %04d-%02d-%02d %02d:%02d:%02d\r\n",
+                       now.wYear, now.wMonth, now.wDay, now.wHour, now.wMinute, now.wSecond);
+
+    DWORD written = 0;
+    WriteFile(log_file->file, line, (DWORD) len, &written, 0);
+    log_file->file_size = written;
+}
+
+// @Note: maidai.log -> maidai.log.1 -> maidai.log.2, the oldest falls off the end.
+internal void log_file_rotate()
+{
+    Log_File *log_file = &state.log_file;
+    if (log_file->file != INVALID_HANDLE_VALUE) CloseHandle(log_file->file);
+
+    for (int i = LOG_FILE_BACKUPS; i > 0; --i) {
+        char from[64] = {0};
+        char to[64] = {0};
+        
+        if (i == 1) snprintf(from, sizeof(from), "%s", LOG_FILE);
+        else snprintf(from, sizeof(from), "%s.%d", LOG_FILE, i - 1);
+        snprintf(to, sizeof(to), "%s.%d", LOG_FILE, i);
+        
+        MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING);
+    }
+
+    log_file_open();
+}
+
+// @Note: Lines are stamped with seconds since startup, the session's
+// wall clock time is at the top of the file.
+internal void log_file_flush()
+{
+    Log_File *log_file = &state.log_file;
+    static char batch[LOG_LEN*(LOG_TEXT_LEN + 32)];
+    size_t len = 0;
+
+    Log_Record record = {0};
+    uint64_t missed = log_file->reader.missed;
+    
+    while (len + 2*(LOG_TEXT_LEN + 32) <= sizeof(batch) && log_read(&state.log, &log_file->reader, &record)) {
+        if (log_file->reader.missed != missed) {
+            len += (size_t) snprintf(batch + len, sizeof(batch) - len, "... %llu messages lost\r\n", (unsigned long long) (log_file->reader.missed - missed));
+            missed = log_file->reader.missed;
+        }
+
+        double seconds = (int64_t) (record.time_ns - state.start_ns)/1e9;
+        len += (size_t) snprintf(batch + len, sizeof(batch) - len, "[%10.3f] %s\r\n", seconds, record.text);
+    }
+
+    if (len == 0 || log_file->file == INVALID_HANDLE_VALUE) return;
+
+    DWORD written = 0;
+    WriteFile(log_file->file, batch, (DWORD) len, &written, 0);
+    log_file->file_size += written;
+
+    if (log_file->file_size > LOG_FILE_MAX_SIZE) log_file_rotate();
+}
+
+internal DWORD WINAPI log_file_thread_proc(LPVOID param)
+{
+    UNUSED(param);
+    Log_File *log_file = &state.log_file;
+
+    while (WaitForSingleObject(log_file->stop, LOG_FILE_INTERVAL_MS) == WAIT_TIMEOUT) {
+        log_file_flush();
+    }
+
+    log_file_flush();
+    return 0;
+}
+
+internal void start_log_file()
+{
+    Log_File *log_file = &state.log_file;
+    log_file_rotate();
+    
+    log_file->stop = CreateEventA(0, FALSE, FALSE, 0);
+    log_file->thread = CreateThread(0, 0, log_file_thread_proc, 0, 0, 0);
+}
+
+internal void stop_log_file()
+{
+    Log_File *log_file = &state.log_file;
+    SetEvent(log_file->stop);
+
+    WaitForSingleObject(log_file->thread, INFINITE);
+    CloseHandle(log_file->thread);
+    CloseHandle(log_file->stop);
+    if (log_file->file != INVALID_HANDLE_VALUE) CloseHandle(log_file->file);
+}
+
+internal void trace_flush()
+{
+    Trace_Writer *trace = &state.trace;
+    static Trace_Record batch[TRACE_BUFFER_LEN];
+
+    for (int i = 0; i < TRACE_THREAD_COUNT; ++i) {
+        size_t count = trace_drain(&trace->buffers[i], batch, ARR_SZ(batch));
+        if (count == 0 || trace->file == INVALID_HANDLE_VALUE) continue;
+
+        DWORD written = 0;
+        WriteFile(trace->file, batch, (DWORD) (count*sizeof(Trace_Record)), &written, 0);
+        trace->records += count;
+    }
+}
+
+internal DWORD WINAPI trace_thread_proc(LPVOID param)
+{
+    UNUSED(param);
+    Trace_Writer *trace = &state.trace;
+
+    while (WaitForSingleObject(trace->stop, TRACE_WRITE_INTERVAL_MS) == WAIT_TIMEOUT) {
+        trace_flush();
+    }
+
+    trace_flush();
+    return 0;
+}
+
+internal void start_trace()
+{
+    Trace_Writer *trace = &state.trace;
+    trace->file = CreateFileA(TRACE_FILE, GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if (trace->file == INVALID_HANDLE_VALUE) {
+        log_print("Could not open %s", TRACE_FILE);
+        return;
+    }
+
+    Trace_File_Header header = {0};
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(Trace_Record);
+    header.start_ns = get_time_ns();
+
+    DWORD written = 0;
+    WriteFile(trace->file, &header, sizeof(header), &written, 0);
+
+    // @Note: Anything left over from the last trace was written after it stopped, it goes.
+    for (int i = 0; i < TRACE_THREAD_COUNT; ++i) {
+        Trace_Buffer *buffer = &trace->buffers[i];
+        buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_release);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->enabled.store(true, std::memory_order_relaxed);
+    }
+
+    trace->records = 0;
+    trace->running = true;
+    trace->stop = CreateEventA(0, FALSE, FALSE, 0);
+    trace->thread = CreateThread(0, 0, trace_thread_proc, 0, 0, 0);
+    
+    log_print("Tracing to %s", TRACE_FILE);
+}
+
+internal void stop_trace()
+{
+    Trace_Writer *trace = &state.trace;
+    if (!trace->running) return;
+
+    uint32_t dropped = 0;
+    for (int i = 0; i < TRACE_THREAD_COUNT; ++i) {
+        trace->buffers[i].enabled.store(false, std::memory_order_relaxed);
+        dropped += trace->buffers[i].dropped.load(std::memory_order_relaxed);
+    }
+
+    SetEvent(trace->stop);
+    WaitForSingleObject(trace->thread, INFINITE);
+    CloseHandle(trace->thread);
+    CloseHandle(trace->stop);
+    CloseHandle(trace->file);
+
+    trace->running = false;
+    log_print("Saved %s, %llu records (%u dropped)", TRACE_FILE, (unsigned long long) trace->records, dropped);
+}
+
+internal void unmap_playback()
+{
+    Playback *playback = &state.playback;
+
+    if (playback->view) UnmapViewOfFile(playback->view);
+    if (playback->mapping) CloseHandle(playback->mapping);
+    if (playback->file && playback->file != INVALID_HANDLE_VALUE) CloseHandle(playback->file);
+    free(playback->checkpoints);
+    timeline_free(&playback->compiled);
+
+    playback->checkpoints = 0;
+    playback->checkpoints_len = 0;
+    playback->view = 0;
+    playback->mapping = 0;
+    playback->file = 0;
+    playback->records = 0;
+    playback->count = 0;
+}
+
+internal void begin_playback(const char *file_path, uint64_t start_ns);
+
+// @Note: The file stays mapped for as long as it plays, the injection thread
+// reads the records straight out of it.
+internal void start_playback(const char *file_path)
+{
+    Playback *playback = &state.playback;
+    if (playback->state.load(std::memory_order_acquire) != PLAYBACK_IDLE) {
+        log_print("Stop the current timeline first (F8)");
+        return;
+    }
+
+    playback->file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+
+    LARGE_INTEGER size = {0};
+    if (playback->file != INVALID_HANDLE_VALUE && GetFileSizeEx(playback->file, &size) && size.QuadPart > 0) {
+        playback->mapping = CreateFileMappingA(playback->file, 0, PAGE_READONLY, 0, 0, 0);
+        if (playback->mapping) playback->view = MapViewOfFile(playback->mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (!playback->view || !timeline_view(playback->view, (size_t) size.QuadPart, &playback->records, &playback->count, &playback->duration_ns)) {
+        log_print("%s isn't a timeline", file_path);
+        unmap_playback();
+        return;
+    }
+
+    if (!timeline_build_checkpoints(playback->records, playback->count, &playback->checkpoints, &playback->checkpoints_len)) {
+        log_print("Out of memory, seeking is off");
+    }
+
+    begin_playback(file_path, get_time_ns() + PLAYBACK_LEAD_MS*1000000ull);
+    log_print("Playing %s in %d s", file_path, PLAYBACK_LEAD_MS/1000);
+}
+
+// @Note: Whatever 'records' points to, from 'start_ns' on.
+internal void begin_playback(const char *file_path, uint64_t start_ns)
+{
+    Playback *playback = &state.playback;
+    if (file_path != playback->path) snprintf(playback->path, sizeof(playback->path), "%s", file_path);
+    
+    playback->start_ns = start_ns;
+    playback->loop_start_ns = 0;
+    playback->loop_end_ns = 0;
+    playback->loop_marked = false;
+    playback->request.store(false, std::memory_order_relaxed);
+    playback->roll_cursor = 0;
+    playback->roll_start_ns = playback->start_ns;
+    playback->position.store(0, std::memory_order_relaxed);
+    playback->state.store(PLAYBACK_STARTING, std::memory_order_release);
+    SetEvent(state.injection_wakeup);
+}
+
+internal void stop_playback()
+{
+    Playback *playback = &state.playback;
+    int current = playback->state.load(std::memory_order_acquire);
+    if (current != PLAYBACK_STARTING && current != PLAYBACK_PLAYING) return;
+
+    // @Note: If the injection thread is just finishing, it'll see STOPPING instead and finish that way.
+    playback->state.store(PLAYBACK_STOPPING, std::memory_order_release);
+    SetEvent(state.injection_wakeup);
+
+    // @Note: Stopping stops the whole set.
+    Setlist *setlist = &state.setlist;
+    int compiling = setlist->state.load(std::memory_order_acquire);
+    setlist->discard = compiling == SETLIST_COMPILING || compiling == SETLIST_READY || compiling == SETLIST_FAILED;
+    setlist->count = 0;
+    setlist->next = 0;
+}
+
+// @Note: Runs on its own thread, one song at a time.
+internal DWORD WINAPI setlist_compile_proc(LPVOID param)
+{
+    UNUSED(param);
+    Setlist *setlist = &state.setlist;
+    bool result = false;
+
+    FILE *file = fopen(setlist->path, "rb");
+    if (file) {
+        uint8_t *data = 0;
+        long size = -1;
+        if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+        if (size > 0 && fseek(file, 0, SEEK_SET) == 0) data = (uint8_t *) malloc((size_t) size);
+
+        result = data && fread(data, 1, (size_t) size, file) == (size_t) size &&
+                 timeline_compile(data, (size_t) size, &setlist->table, &setlist->options, &setlist->timeline) &&
+                 timeline_build_checkpoints(setlist->timeline.records, setlist->timeline.count, &setlist->checkpoints, &setlist->checkpoints_len);
+
+        free(data);
+        fclose(file);
+    }
+
+    setlist->state.store(result ? SETLIST_READY : SETLIST_FAILED, std::memory_order_release);
+    SetEvent(state.injection_wakeup);
+
+    return(0);
+}
+
+// @Note: With the profile and settings as they are now, later changes don't apply to it.
+internal void start_setlist_compile()
+{
+    Setlist *setlist = &state.setlist;
+    size_t song = setlist->next++;
+
+    snprintf(setlist->path, sizeof(setlist->path), "%s", setlist->paths[song]);
+    setlist->table = state.tables.load(std::memory_order_acquire)[state.config_id.load(std::memory_order_relaxed)];
+    setlist->options = default_timeline_options();
+    setlist->options.settings = state.settings;
+    setlist->options.transpose = setlist->transposes[song];
+    memset(&setlist->timeline, 0, sizeof(setlist->timeline));
+    setlist->checkpoints = 0;
+    setlist->checkpoints_len = 0;
+
+    setlist->state.store(SETLIST_COMPILING, std::memory_order_release);
+    setlist->thread = CreateThread(0, 0, setlist_compile_proc, 0, 0, 0);
+
+    if (setlist->thread) {
+        SetThreadPriority(setlist->thread, THREAD_PRIORITY_BELOW_NORMAL);
+    } else {
+        log_print("Could not compile %s", setlist->path);
+        setlist->state.store(SETLIST_EMPTY, std::memory_order_release);
+    }
+}
+
+internal void finish_setlist_compile()
+{
+    Setlist *setlist = &state.setlist;
+    if (setlist->thread == 0) return;
+
+    WaitForSingleObject(setlist->thread, INFINITE);
+    CloseHandle(setlist->thread);
+    setlist->thread = 0;
+}
+
+// @Note: 'transpose' is whatever the library thinks fits best, the octaves are planned on top of that.
+internal void add_to_setlist(const char *path, int transpose)
+{
+    Setlist *setlist = &state.setlist;
+    if (setlist->count == SETLIST_LEN) {
+        log_print("The setlist is full");
+        return;
+    }
+
+    // @Note: Whatever's been played already makes room.
+    if (setlist->next > 0 && setlist->next == setlist->count) {
+        setlist->next = 0;
+        setlist->count = 0;
+    }
+
+    snprintf(setlist->paths[setlist->count], PLAYBACK_PATH_LEN, "%s", path);
+    setlist->transposes[setlist->count] = transpose;
+    setlist->count += 1;
+
+    log_print("Setlist: %s (%zu to go)", path, setlist->count - setlist->next);
+}
+
+// @Note: Moves the compiled song into 'Playback', the timeline and
+// checkpoints change hands, nothing's copied.
+internal void take_setlist_song()
+{
+    Setlist *setlist = &state.setlist;
+    Playback *playback = &state.playback;
+
+    playback->compiled = setlist->timeline;
+    playback->records = setlist->timeline.records;
+    playback->count = setlist->timeline.count;
+    playback->duration_ns = setlist->timeline.duration_ns;
+    playback->checkpoints = setlist->checkpoints;
+    playback->checkpoints_len = setlist->checkpoints_len;
+
+    memset(&setlist->timeline, 0, sizeof(setlist->timeline));
+    setlist->checkpoints = 0;
+    setlist->checkpoints_len = 0;
+}
+
+internal void free_setlist_song()
+{
+    Setlist *setlist = &state.setlist;
+
+    timeline_free(&setlist->timeline);
+    free(setlist->checkpoints);
+    setlist->checkpoints = 0;
+    setlist->checkpoints_len = 0;
+}
+
+// @Note: UI thread side of 'Setlist', after 'check_playback()'.
+internal void check_setlist()
+{
+    Setlist *setlist = &state.setlist;
+    Playback *playback = &state.playback;
+    int current = setlist->state.load(std::memory_order_acquire);
+
+    if (current == SETLIST_TAKEN) {
+        // @Note: The injection thread let go of the last song's records before it took this one.
+        finish_setlist_compile();
+        unmap_playback();
+        take_setlist_song();
+
+        snprintf(playback->path, sizeof(playback->path), "%s", setlist->path);
+        playback->start_ns = setlist->start_ns;
+        playback->loop_start_ns = 0;
+        playback->loop_end_ns = 0;
+        playback->loop_marked = false;
+        playback->roll_cursor = 0;
+        playback->roll_start_ns = playback->start_ns;
+
+        log_print("Playing %s", setlist->path);
+        setlist->discard = false;
+        setlist->state.store(SETLIST_EMPTY, std::memory_order_release);
+        current = SETLIST_EMPTY;
+    }
+
+    if (current == SETLIST_FAILED || (current == SETLIST_READY && setlist->discard)) {
+        finish_setlist_compile();
+        if (current == SETLIST_FAILED && !setlist->discard) log_print("%s isn't a MIDI file", setlist->path);
+
+        free_setlist_song();
+        setlist->discard = false;
+        setlist->state.store(SETLIST_EMPTY, std::memory_order_release);
+        current = SETLIST_EMPTY;
+    }
+
+    // @Note: Nothing playing to follow, it starts like a file would.
+    if (current == SETLIST_READY && playback->state.load(std::memory_order_acquire) == PLAYBACK_IDLE) {
+        finish_setlist_compile();
+        take_setlist_song();
+        setlist->state.store(SETLIST_EMPTY, std::memory_order_release);
+        current = SETLIST_EMPTY;
+
+        begin_playback(setlist->path, get_time_ns() + PLAYBACK_LEAD_MS*1000000ull);
+        log_print("Playing %s in %d s", setlist->path, PLAYBACK_LEAD_MS/1000);
+    }
+
+    if (current == SETLIST_EMPTY && setlist->next < setlist->count) start_setlist_compile();
+}
+
+// @Note: Song time at 'now_ns', loops included. Negative during the lead-in.
+internal int64_t playback_position_ns(uint64_t now_ns)
+{
+    const Playback *playback = &state.playback;
+    int64_t position = (int64_t) (now_ns - playback->start_ns);
+
+    if (playback->loop_end_ns > 0 && position >= (int64_t) playback->loop_end_ns) {
+        int64_t loop_start = (int64_t) playback->loop_start_ns;
+        position = loop_start + (position - loop_start) % (int64_t) (playback->loop_end_ns - playback->loop_start_ns);
+    }
+
+    return(position);
+}
+
+// @Note: Upcoming key presses go on the note roll as soon as they'd scroll
+// into view. With a loop, the roll goes around it ahead of the player.
+internal void add_playback_spans()
+{
+    Playback *playback = &state.playback;
+    uint64_t lookahead_ns = (uint64_t) (GetScreenHeight()*NOTE_ROLL_PLAYHEAD/NOTE_ROLL_PIXELS_PER_SECOND*1e9);
+    uint64_t until_ns = get_time_ns() + lookahead_ns;
+    bool looping = playback->loop_end_ns > 0;
+
+    for (;;) {
+        if (looping && (playback->roll_cursor >= playback->count || playback->records[playback->roll_cursor].time_ns >= playback->loop_end_ns)) {
+            uint64_t next_start_ns = playback->roll_start_ns + (playback->loop_end_ns - playback->loop_start_ns);
+            if (next_start_ns + playback->loop_start_ns > until_ns) break;
+
+            uint8_t keys[256];
+            playback->roll_start_ns = next_start_ns;
+            playback->roll_cursor = timeline_seek(playback->records, playback->count, playback->checkpoints, playback->checkpoints_len,
+                                                  playback->loop_start_ns, keys);
+            continue;
+        }
+        if (playback->roll_cursor >= playback->count) break;
+
+        const Timeline_Record *record = &playback->records[playback->roll_cursor];
+        uint64_t down_ns = playback->roll_start_ns + record->time_ns;
+        if (down_ns > until_ns) break;
+
+        playback->roll_cursor += 1;
+        if (record->lane < 0 || (record->flags & KEY_EVENT_UP)) continue;
+
+        uint64_t up_ns = looping ? playback->roll_start_ns + playback->loop_end_ns : down_ns;
+        for (size_t i = playback->roll_cursor; i < playback->count; ++i) {
+            const Timeline_Record *up = &playback->records[i];
+            if (looping && up->time_ns >= playback->loop_end_ns) break;
+            
+            if (up->vk == record->vk && (up->flags & KEY_EVENT_UP)) {
+                up_ns = playback->roll_start_ns + up->time_ns;
+                break;
+            }
+        }
+
+        if (up_ns < down_ns + PLAYBACK_MIN_SPAN_NS) up_ns = down_ns + PLAYBACK_MIN_SPAN_NS;
+        note_roll_add_span(&state.note_roll, record->lane, down_ns, up_ns, 100);
+    }
+}
+
+// @Note: Jumps to 'time_ns' of the song and loops between 'loop_start_ns' and
+// 'loop_end_ns' from there on (0 for no loop). False while the injection
+// thread hasn't picked up the last one yet.
+internal bool seek_playback(uint64_t time_ns, uint64_t loop_start_ns, uint64_t loop_end_ns)
+{
+    Playback *playback = &state.playback;
+    if (playback->state.load(std::memory_order_acquire) != PLAYBACK_PLAYING || playback->checkpoints_len == 0) return(false);
+    if (playback->request.load(std::memory_order_acquire)) return(false);
+
+    if (time_ns > playback->duration_ns) time_ns = playback->duration_ns;
+    uint64_t now_ns = get_time_ns();
+
+    playback->request_time_ns = time_ns;
+    playback->request_at_ns = now_ns;
+    playback->request_loop_start_ns = loop_start_ns;
+    playback->request_loop_end_ns = loop_end_ns;
+    playback->request.store(true, std::memory_order_release);
+    SetEvent(state.injection_wakeup);
+
+    playback->start_ns = now_ns - time_ns;
+    playback->loop_start_ns = loop_start_ns;
+    playback->loop_end_ns = loop_end_ns;
+
+    // @Note: The lookahead on the note roll is for where we were going, it starts over from here.
+    uint8_t keys[256];
+    note_roll_cut(&state.note_roll, now_ns);
+    playback->roll_start_ns = playback->start_ns;
+    playback->roll_cursor = timeline_seek(playback->records, playback->count, playback->checkpoints, playback->checkpoints_len, time_ns, keys);
+
+    return(true);
+}
+
+// @Note: Left/Right seek, '[' marks where a loop starts, ']' where it ends
+// (and jumps back to its start), '\' plays on without it.
+internal void check_playback_seek()
+{
+    Playback *playback = &state.playback;
+    if (playback->state.load(std::memory_order_acquire) != PLAYBACK_PLAYING || state.browser.visible) return;
+
+    int64_t position_ns = playback_position_ns(get_time_ns());
+    if (position_ns < 0) position_ns = 0;
+    uint64_t position = (uint64_t) position_ns;
+    uint64_t step_ns = PLAYBACK_SEEK_STEP_MS*1000000ull;
+
+    if (IsKeyPressed(KEY_LEFT) || IsKeyPressed(KEY_RIGHT)) {
+        uint64_t target_ns = 0;
+        if (IsKeyPressed(KEY_RIGHT)) target_ns = position + step_ns;
+        else if (position > step_ns) target_ns = position - step_ns;
+
+        // @Note: Seeking out of the loop means we're done with it.
+        bool in_loop = target_ns >= playback->loop_start_ns && target_ns < playback->loop_end_ns;
+        if (in_loop) seek_playback(target_ns, playback->loop_start_ns, playback->loop_end_ns);
+        else seek_playback(target_ns, 0, 0);
+    }
+
+    if (IsKeyPressed(KEY_LEFT_BRACKET)) {
+        playback->loop_mark_ns = position;
+        playback->loop_marked = true;
+        log_print("Loop from %d:%02d, ']' where it ends", (int) (position/60000000000ull), (int) (position/1000000000ull % 60));
+    }
+
+    if (IsKeyPressed(KEY_RIGHT_BRACKET) && playback->loop_marked) {
+        if (position >= playback->loop_mark_ns + PLAYBACK_MIN_LOOP_MS*1000000ull &&
+            seek_playback(playback->loop_mark_ns, playback->loop_mark_ns, position)) {
+            playback->loop_marked = false;
+            log_print("Looping, '\\' to play on");
+        }
+    }
+
+    if (IsKeyPressed(KEY_BACKSLASH) && playback->loop_end_ns > 0) seek_playback(position, 0, 0);
+}
+
+internal void check_playback()
+{
+    Playback *playback = &state.playback;
+    
+    if (IsFileDropped()) {
+        FilePathList files = LoadDroppedFiles();
+        for (unsigned int i = 0; i < files.count; ++i) {
+            if (library_is_song(files.paths[i])) add_to_setlist(files.paths[i], 0);
+            else if (i == 0) start_playback(files.paths[i]);
+        }
+        UnloadDroppedFiles(files);
+    }
+
+    if (IsKeyPressed(KEY_F8)) {
+        int current = playback->state.load(std::memory_order_acquire);
+        if (current == PLAYBACK_STARTING || current == PLAYBACK_PLAYING) stop_playback();
+        else if (current == PLAYBACK_IDLE && library_is_song(playback->path)) add_to_setlist(playback->path, 0);
+        else if (current == PLAYBACK_IDLE && playback->path[0]) start_playback(playback->path);
+    }
+
+    check_playback_seek();
+
+    int current = playback->state.load(std::memory_order_acquire);
+    if (current == PLAYBACK_STARTING || current == PLAYBACK_PLAYING) add_playback_spans();
+
+    if (current == PLAYBACK_DONE) {
+        bool finished = playback->position.load(std::memory_order_relaxed) >= playback->count;
+        log_print("%s %s", finished ? "Finished" : "Stopped", playback->path);
+
+        unmap_playback();
+        playback->state.store(PLAYBACK_IDLE, std::memory_order_release);
+    }
+}
+
+// @Note: Runs on the scan thread, adds every song under 'dir' to 'scanned'
+// and queues the ones the index doesn't know yet. False if we ran out of memory.
+internal bool library_walk(const char *dir, int depth)
+{
+    Library_Browser *browser = &state.browser;
+    char pattern[PLAYBACK_PATH_LEN] = {0};
+    snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+
+    WIN32_FIND_DATAA found = {0};
+    HANDLE find = FindFirstFileA(pattern, &found);
+    if (find == INVALID_HANDLE_VALUE) return(true);
+
+    bool result = true;
+    do {
+        if (found.cFileName[0] == '.') continue;
+
+        char path[PLAYBACK_PATH_LEN] = {0};
+        int len = snprintf(path, sizeof(path), "%s\\%s", dir, found.cFileName);
+        if (len < 0 || len >= (int) sizeof(path)) continue;
+
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (depth < LIBRARY_DEPTH_CAP) result = library_walk(path, depth + 1);
+            continue;
+        }
+        if (!library_is_song(found.cFileName)) continue;
+
+        uint64_t mtime = ((uint64_t) found.ftLastWriteTime.dwHighDateTime << 32) | found.ftLastWriteTime.dwLowDateTime;
+        uint64_t size = ((uint64_t) found.nFileSizeHigh << 32) | found.nFileSizeLow;
+        int64_t index = 0;
+
+        int added = library_add_known(&browser->scanned, &browser->library, path, mtime, size, &index);
+        if (added == -1) result = false;
+        if (added != 1) continue;
+
+        if (browser->jobs_len == browser->jobs_cap) {
+            size_t cap = browser->jobs_cap ? browser->jobs_cap*2 : 256;
+            uint32_t *jobs = (uint32_t *) realloc(browser->jobs, cap*sizeof(uint32_t));
+            if (jobs == 0) {
+                result = false;
+                continue;
+            }
+
+            browser->jobs = jobs;
+            browser->jobs_cap = cap;
+        }
+        browser->jobs[browser->jobs_len++] = (uint32_t) index;
+    } while (result && FindNextFileA(find, &found));
+
+    FindClose(find);
+    return(result);
+}
+
+internal DWORD WINAPI library_worker_proc(LPVOID param)
+{
+    library_scan_work(&state.browser.scan, (Library_Worker *) param);
+    return(0);
+}
+
+// @Note: Walks the directory, then reads whatever changed on every core,
+// this thread included.
+internal DWORD WINAPI library_scan_thread_proc(LPVOID param)
+{
+    UNUSED(param);
+    Library_Browser *browser = &state.browser;
+    Library_Scan *scan = &browser->scan;
+    uint64_t start_ns = get_time_ns();
+
+    browser->jobs_len = 0;
+    bool result = library_walk(browser->dir, 0);
+
+    scan->library = &browser->scanned;
+    scan->jobs = browser->jobs;
+    scan->jobs_len = result ? browser->jobs_len : 0;
+    scan->next.store(0, std::memory_order_relaxed);
+    scan->done.store(0, std::memory_order_relaxed);
+
+    SYSTEM_INFO system_info = {0};
+    GetSystemInfo(&system_info);
+    size_t workers_len = system_info.dwNumberOfProcessors;
+    if (workers_len > LIBRARY_WORKERS_CAP) workers_len = LIBRARY_WORKERS_CAP;
+    if (workers_len > scan->jobs_len) workers_len = scan->jobs_len;
+    if (workers_len == 0) workers_len = 1;
+
+    Library_Worker *workers = (Library_Worker *) calloc(workers_len, sizeof(Library_Worker));
+    HANDLE threads[LIBRARY_WORKERS_CAP] = {0};
+    DWORD threads_len = 0;
+
+    if (workers) {
+        for (size_t i = 1; i < workers_len; ++i) {
+            HANDLE thread = CreateThread(0, 0, library_worker_proc, &workers[i], 0, 0);
+            if (thread) threads[threads_len++] = thread;
+        }
+
+        library_scan_work(scan, &workers[0]);
+        if (threads_len > 0) WaitForMultipleObjects(threads_len, threads, TRUE, INFINITE);
+
+        for (DWORD i = 0; i < threads_len; ++i) CloseHandle(threads[i]);
+        for (size_t i = 0; i < workers_len; ++i) free(workers[i].buffer);
+        free(workers);
+    } else {
+        result = false;
+    }
+
+    if (result && !library_write(&browser->scanned, LIBRARY_INDEX_FILE)) {
+        log_print("Could not write %s", LIBRARY_INDEX_FILE);
+    }
+
+    if (result) {
+        log_print("Library: %zu songs, %zu read in %llu ms", browser->scanned.count, scan->jobs_len,
+                  (unsigned long long) ((get_time_ns() - start_ns)/1000000));
+    } else {
+        log_print("Could not scan %s, out of memory", browser->dir);
+    }
+
+    browser->scan_ok = result;
+    browser->scan_state.store(LIBRARY_SCAN_DONE, std::memory_order_release);
+    return(0);
+}
+
+internal void filter_library()
+{
+    Library_Browser *browser = &state.browser;
+    browser->matches_len = 0;
+    browser->scroll = 0;
+
+    for (size_t i = 0; i < browser->library.count; ++i) {
+        if (library_matches(&browser->library, &browser->library.records[i], browser->search)) {
+            browser->matches[browser->matches_len++] = (uint32_t) i;
+        }
+    }
+}
+
+// @Note: Takes over 'library', the old one (if any) is freed.
+internal void set_library(Library *library)
+{
+    Library_Browser *browser = &state.browser;
+    uint32_t *matches = (uint32_t *) malloc(library->count*sizeof(uint32_t) + 1);
+    if (matches == 0) {
+        library_free(library);
+        return;
+    }
+
+    library_free(&browser->library);
+    free(browser->matches);
+
+    browser->library = *library;
+    browser->matches = matches;
+    memset(library, 0, sizeof(*library));
+    filter_library();
+}
+
+internal void start_library_scan()
+{
+    Library_Browser *browser = &state.browser;
+    if (browser->scan_state.load(std::memory_order_acquire) != LIBRARY_SCAN_IDLE) return;
+
+    // @Note: Without the lookup every file is just read again.
+    library_build_lookup(&browser->library);
+    memset(&browser->scanned, 0, sizeof(browser->scanned));
+
+    browser->scan_state.store(LIBRARY_SCAN_RUNNING, std::memory_order_release);
+    browser->scan_thread = CreateThread(0, 0, library_scan_thread_proc, 0, 0, 0);
+
+    if (browser->scan_thread) {
+        SetThreadPriority(browser->scan_thread, THREAD_PRIORITY_BELOW_NORMAL);
+    } else {
+        browser->scan_state.store(LIBRARY_SCAN_IDLE, std::memory_order_release);
+    }
+}
+
+internal void finish_library_scan()
+{
+    Library_Browser *browser = &state.browser;
+    if (browser->scan_thread == 0) return;
+
+    WaitForSingleObject(browser->scan_thread, INFINITE);
+    CloseHandle(browser->scan_thread);
+    browser->scan_thread = 0;
+
+    if (browser->scan_ok) set_library(&browser->scanned);
+    else library_free(&browser->scanned);
+
+    browser->scan_state.store(LIBRARY_SCAN_IDLE, std::memory_order_release);
+}
+
+// @Note: Whatever the index had last time shows up right away, the scan catches up after.
+internal void load_library(const char *dir)
+{
+    Library_Browser *browser = &state.browser;
+    snprintf(browser->dir, sizeof(browser->dir), "%s", dir);
+
+    Library library = {0};
+    if (library_read(&library, LIBRARY_INDEX_FILE)) set_library(&library);
+
+    start_library_scan();
+}
+
+internal void check_library()
+{
+    Library_Browser *browser = &state.browser;
+
+    if (IsKeyPressed(KEY_F9)) {
+        browser->visible = !browser->visible;
+        if (browser->visible) start_library_scan();
+    }
+
+    if (browser->scan_state.load(std::memory_order_acquire) == LIBRARY_SCAN_DONE) finish_library_scan();
+    if (!browser->visible) return;
+
+    size_t len = strlen(browser->search);
+    bool changed = false;
+
+    for (int c = GetCharPressed(); c > 0; c = GetCharPressed()) {
+        if (c < 32 || c > 126 || len + 1 >= sizeof(browser->search)) continue;
+
+        browser->search[len++] = (char) c;
+        browser->search[len] = 0;
+        changed = true;
+    }
+
+    if ((IsKeyPressed(KEY_BACKSPACE) || IsKeyPressedRepeat(KEY_BACKSPACE)) && len > 0) {
+        browser->search[--len] = 0;
+        changed = true;
+    }
+
+    if (changed) filter_library();
+}
+
+// @Note: Modifiers go in a small line above the key name, the name itself
+// gets cut down to 3 characters so it fits on the key.
+internal void format_key_label(int key, char *name, char *modifiers)
+{
+    const char *translation = vk_translation[KEY_VK(key)];
+    
+    // @Note: snprintf() causes weird behaviour that I don't want to investigate right now,
+    // plus this approach is fine here.
+    size_t len = strlen(translation) > 3 ? 3 : strlen(translation);
+    memcpy(name, translation, len);
+    name[len] = 0;
+
+    int mods = KEY_MODS(key);
+    size_t at = 0;
+    if (mods & KEY_MOD_SHIFT) { memcpy(modifiers + at, "Sh ", 3); at += 3; }
+    if (mods & KEY_MOD_CTRL) { memcpy(modifiers + at, "Ct ", 3); at += 3; }
+    if (mods & KEY_MOD_ALT) { memcpy(modifiers + at, "Al ", 3); at += 3; }
+    modifiers[at > 0 ? at - 1 : 0] = 0;
+}
+
+internal void batch_push_quad(Keyboard_Batch *batch, Vector2 a, Vector2 b, Vector2 c, Vector2 d, Vector2 uv_a, Vector2 uv_b, Vector2 uv_c, Vector2 uv_d, Color color)
+{
+    if (batch->quads >= KEYBOARD_QUADS_CAP) return;
+    
+    Vector2 *positions = &batch->positions[batch->quads*4];
+    Vector2 *texcoords = &batch->texcoords[batch->quads*4];
+    positions[0] = a; positions[1] = b; positions[2] = c; positions[3] = d;
+    texcoords[0] = uv_a; texcoords[1] = uv_b; texcoords[2] = uv_c; texcoords[3] = uv_d;
+    
+    for (int i = 0; i < 4; ++i) batch->colors[batch->quads*4 + i] = color;
+    batch->quads += 1;
+}
+
+internal void batch_push_rect(Keyboard_Batch *batch, Rectangle rect, Color color)
+{
+    Vector2 uv = batch->white_texcoord;
+    batch_push_quad(batch, { rect.x, rect.y }, { rect.x, rect.y + rect.height }, { rect.x + rect.width, rect.y + rect.height },
+                    { rect.x + rect.width, rect.y }, uv, uv, uv, uv, color);
+}
+
+// @Note: Same shape as DrawRectangleRounded(), three rectangles plus a fan
+// per corner. Fan triangles go in as quads with the last corner doubled up.
+internal void batch_push_rounded_rect(Keyboard_Batch *batch, Rectangle rect, float roundness, Color color)
+{
+    float radius = (rect.width < rect.height ? rect.width : rect.height)*roundness/2.0f;
+    Vector2 uv = batch->white_texcoord;
+    
+    batch_push_rect(batch, { rect.x + radius, rect.y, rect.width - 2.0f*radius, rect.height }, color);
+    batch_push_rect(batch, { rect.x, rect.y + radius, radius, rect.height - 2.0f*radius }, color);
+    batch_push_rect(batch, { rect.x + rect.width - radius, rect.y + radius, radius, rect.height - 2.0f*radius }, color);
+
+    Vector2 centers[4] = {
+        { rect.x + radius, rect.y + radius },
+        { rect.x + rect.width - radius, rect.y + radius },
+        { rect.x + rect.width - radius, rect.y + rect.height - radius },
+        { rect.x + radius, rect.y + rect.height - radius },
+    };
+    const float start_angles[4] = { PI, 1.5f*PI, 0.0f, 0.5f*PI };
+    const float step = 0.5f*PI/KEYBOARD_CORNER_SEGMENTS;
+
+    for (int corner = 0; corner < 4; ++corner) {
+        for (int i = 0; i < KEYBOARD_CORNER_SEGMENTS; ++i) {
+            float angle = start_angles[corner] + i*step;
+            Vector2 p0 = { centers[corner].x + cosf(angle)*radius, centers[corner].y + sinf(angle)*radius };
+            Vector2 p1 = { centers[corner].x + cosf(angle + step)*radius, centers[corner].y + sinf(angle + step)*radius };
+            
+            batch_push_quad(batch, centers[corner], p0, p1, p1, uv, uv, uv, uv, color);
+        }
+    }
+}
+
+// @Note: Lays glyphs out the way DrawTextEx() does (spacing 1), centered like 'draw_text_centered()'.
+internal void batch_push_text(Keyboard_Batch *batch, const char *text, float x, float y, float font_size, Color color)
+{
+    const Font *font = &state.font;
+    float scale = font_size/font->baseSize;
+    float padding = (float) font->glyphPadding;
+    
+    Vector2 size = MeasureTextEx(*font, text, font_size, 1.0f);
+    Vector2 position = { x - size.x/2.0f, y - font_size/2.0f };
+    
+    for (const char *c = text; *c; ++c) {
+        int index = GetGlyphIndex(*font, *c);
+        Rectangle src = font->recs[index];
+        GlyphInfo glyph = font->glyphs[index];
+
+        if (*c != ' ' && *c != '\t') {
+            src = { src.x - padding, src.y - padding, src.width + 2.0f*padding, src.height + 2.0f*padding };
+            Rectangle dst = { position.x + glyph.offsetX*scale - padding*scale, position.y + glyph.offsetY*scale - padding*scale, src.width*scale, src.height*scale };
+
+            float tw = (float) font->texture.width;
+            float th = (float) font->texture.height;
+            Vector2 uv0 = { src.x/tw, src.y/th };
+            Vector2 uv1 = { (src.x + src.width)/tw, (src.y + src.height)/th };
+
+            batch_push_quad(batch, { dst.x, dst.y }, { dst.x, dst.y + dst.height }, { dst.x + dst.width, dst.y + dst.height }, { dst.x + dst.width, dst.y },
+                            uv0, { uv0.x, uv1.y }, uv1, { uv1.x, uv0.y }, color);
+        }
+
+        position.x += (glyph.advanceX == 0 ? src.width : (float) glyph.advanceX)*scale + 1.0f;
+    }
+}
+
+// @Note: Needs the font, so it's done on the first frame. Buffers are
+// allocated once at full size, rebuilds only upload what's in use.
+internal void keyboard_batch_init(Keyboard_Batch *batch)
+{
+    // @Note: raylib 5 keeps a 3x3 white block in the bottom right corner of
+    // generated atlases for exactly this, it's rewritten here so it doesn't
+    // matter where the font came from.
+    Texture2D texture = state.font.texture;
+    unsigned char white[64];
+    memset(white, 255, sizeof(white));
+    UpdateTextureRec(texture, { (float) texture.width - 3.0f, (float) texture.height - 3.0f, 3.0f, 3.0f }, white);
+    batch->white_texcoord = { (texture.width - 1.5f)/texture.width, (texture.height - 1.5f)/texture.height };
+
+    static unsigned short indices[KEYBOARD_QUADS_CAP*6];
+    for (int i = 0; i < KEYBOARD_QUADS_CAP; ++i) {
+        const unsigned short quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int j = 0; j < 6; ++j) indices[i*6 + j] = (unsigned short) (i*4 + quad[j]);
+    }
+    
+    int *locs = rlGetShaderLocsDefault();
+    batch->vao = rlLoadVertexArray();
+    rlEnableVertexArray(batch->vao);
+
+    batch->position_vbo = rlLoadVertexBuffer(batch->positions, sizeof(batch->positions), true);
+    rlSetVertexAttribute(locs[RL_SHADER_LOC_VERTEX_POSITION], 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(locs[RL_SHADER_LOC_VERTEX_POSITION]);
+    
+    batch->texcoord_vbo = rlLoadVertexBuffer(batch->texcoords, sizeof(batch->texcoords), true);
+    rlSetVertexAttribute(locs[RL_SHADER_LOC_VERTEX_TEXCOORD01], 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(locs[RL_SHADER_LOC_VERTEX_TEXCOORD01]);
+    
+    batch->color_vbo = rlLoadVertexBuffer(batch->colors, sizeof(batch->colors), true);
+    rlSetVertexAttribute(locs[RL_SHADER_LOC_VERTEX_COLOR], 4, RL_UNSIGNED_BYTE, true, 0, 0);
+    rlEnableVertexAttribute(locs[RL_SHADER_LOC_VERTEX_COLOR]);
+
+    batch->index_vbo = rlLoadVertexBufferElement(indices, sizeof(indices), false);
+    rlDisableVertexArray();
+
+    batch->dynamic_vao = rlLoadVertexArray();
+    rlEnableVertexArray(batch->dynamic_vao);
+
+    const unsigned int vbos[3] = { batch->position_vbo, batch->texcoord_vbo, batch->color_vbo };
+    const int attributes[3] = { RL_SHADER_LOC_VERTEX_POSITION, RL_SHADER_LOC_VERTEX_TEXCOORD01, RL_SHADER_LOC_VERTEX_COLOR };
+    for (int i = 0; i < 3; ++i) {
+        bool colors = attributes[i] == RL_SHADER_LOC_VERTEX_COLOR;
+        
+        rlEnableVertexBuffer(vbos[i]);
+        rlSetVertexAttribute(locs[attributes[i]], colors ? 4 : 2, colors ? RL_UNSIGNED_BYTE : RL_FLOAT, colors, 0, 0);
+        rlEnableVertexAttribute(locs[attributes[i]]);
+    }
+
+    batch->dynamic_index_vbo = rlLoadVertexBufferElement(batch->dynamic_indices, sizeof(batch->dynamic_indices), true);
+    rlDisableVertexArray();
+}
+
+internal void keyboard_batch_unload(Keyboard_Batch *batch)
+{
+    if (batch->vao == 0) return;
+    
+    rlUnloadVertexBuffer(batch->position_vbo);
+    rlUnloadVertexBuffer(batch->texcoord_vbo);
+    rlUnloadVertexBuffer(batch->color_vbo);
+    rlUnloadVertexBuffer(batch->index_vbo);
+    rlUnloadVertexBuffer(batch->dynamic_index_vbo);
+    rlUnloadVertexArray(batch->vao);
+    rlUnloadVertexArray(batch->dynamic_vao);
+}
+
+// @Note: By default we render 'regular/extended' ffxiv keyboard.
+internal void keyboard_batch_layout(Keyboard_Batch *batch, Rectangle rect, int key_width, int key_padding)
+{
+    Rectangle white_key = {0};
+    white_key.width = (float) key_width;
+    white_key.height = rect.height;
+    white_key.x = 0;
+    white_key.y = rect.y;
+
+    Rectangle black_key = {0};
+    black_key.width = (float) key_width;
+    black_key.height = rect.height/2.0f;
+    black_key.x = (key_width + key_padding)/2.0f;
+    black_key.y = rect.y;
+
+    Note *white_keys = batch->keys;
+    Note *black_keys = batch->keys + WHITE_KEYS_LEN;
+    
+    for (int i = 0, j = 0, note_number = 0; i < WHITE_KEYS_LEN; ++i) {
+        white_keys[i].rect = white_key;
+        white_keys[i].note_number = note_number;
+        white_keys[i].color = WHITE;
+        note_number += 1;
+        
+        // @Robustness: Change this, it's just ugly.
+        if (i != WHITE_KEYS_LEN - 1 && (i % 7 != 6 && i % 7 != 2)) {
+            black_keys[j].rect = black_key;
+            black_keys[j].note_number = note_number;
+            black_keys[j].color = BLACK;
+            note_number += 1;
+            j += 1;
+        }
+
+        white_key.x += key_width + key_padding;
+        black_key.x += key_width + key_padding;
+    }
+}
+
+internal void keyboard_batch_build(Keyboard_Batch *batch, Rectangle rect, int key_width)
+{
+    const float tooltip_padding = 2.0f;
+    const Config *current_config = &state.configs[state.config_id];
+    
+    Rectangle tooltip = {0};
+    tooltip.width = key_width - tooltip_padding*2.0f;
+    tooltip.height = rect.height * 0.25f;
+
+    batch->quads = 0;
+    
+    for (int i = 0; i < MIDI_FULL_LEN; ++i) {
+        const Note *note = &batch->keys[i];
+        batch->key_quads[i] = batch->quads;
+        batch_push_rect(batch, note->rect, note->color);
+
+        // @Note: Keys that fall back to a lower velocity layer are drawn dimmed.
+        int key = config_effective_key(current_config, state.edit_layer, note->note_number);
+        bool inherited = config_layer_key(current_config, state.edit_layer, note->note_number) == 0;
+        if (key == 0) continue;
+        
+        tooltip.x = note->rect.x + tooltip_padding;
+        tooltip.y = rect.y + note->rect.height - tooltip.height - tooltip_padding;
+        batch_push_rounded_rect(batch, tooltip, 0.4f, inherited ? Color{ 90, 90, 90, 255 } : Color{ 50, 50, 50, 255 });
+
+        char name[4] = {0};
+        char modifiers[12] = {0};
+        format_key_label(key, name, modifiers);
+
+        float center_x = tooltip.x + tooltip.width / 2.0f;
+        batch_push_text(batch, name, center_x, tooltip.y + tooltip.height / 2.0f, 26, inherited ? LIGHTGRAY : WHITE);
+        if (modifiers[0] != 0) {
+            batch_push_text(batch, modifiers, center_x, tooltip.y - 10.0f, 16, GRAY);
+        }
+    }
+
+    rlUpdateVertexBuffer(batch->position_vbo, batch->positions, batch->quads*4*sizeof(Vector2), 0);
+    rlUpdateVertexBuffer(batch->texcoord_vbo, batch->texcoords, batch->quads*4*sizeof(Vector2), 0);
+    batch->colors_dirty = true;
+}
+
+internal void keyboard_batch_set_color(Keyboard_Batch *batch, int key, Color color)
+{
+    Color *colors = &batch->colors[batch->key_quads[key]*4];
+    if (memcmp(colors, &color, sizeof(color)) == 0) return;
+        
+    for (int i = 0; i < 4; ++i) colors[i] = color;
+    batch->colors_dirty = true;
+}
+
+internal void keyboard_batch_draw(Keyboard_Batch *batch, unsigned int vao, int quads)
+{
+    if (batch->colors_dirty) {
+        rlUpdateVertexBuffer(batch->color_vbo, batch->colors, batch->quads*4*sizeof(Color), 0);
+        batch->colors_dirty = false;
+    }
+
+    // @Note: Whatever raylib has batched so far has to go out first to keep the draw order.
+    rlDrawRenderBatchActive();
+    
+    int *locs = rlGetShaderLocsDefault();
+    const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    const int texture_slot = 0;
+
+    // @Note: rlgl applies pushed transforms on the CPU, so they're not part of the modelview.
+    Matrix mvp = MatrixMultiply(MatrixMultiply(rlGetMatrixTransform(), rlGetMatrixModelview()), rlGetMatrixProjection());
+    
+    rlEnableShader(rlGetShaderIdDefault());
+    rlSetUniformMatrix(locs[RL_SHADER_LOC_MATRIX_MVP], mvp);
+    rlSetUniform(locs[RL_SHADER_LOC_COLOR_DIFFUSE], white, RL_SHADER_UNIFORM_VEC4, 1);
+    rlSetUniform(locs[RL_SHADER_LOC_MAP_DIFFUSE], &texture_slot, RL_SHADER_UNIFORM_INT, 1);
+    
+    rlActiveTextureSlot(0);
+    rlEnableTexture(state.font.texture.id);
+    rlDisableBackfaceCulling();
+
+    rlEnableVertexArray(vao);
+    rlDrawVertexArrayElements(0, quads*6, 0);
+    rlDisableVertexArray();
+
+    rlEnableBackfaceCulling();
+    rlDisableTexture();
+    rlDisableShader();
+}
+
+// @Note: Indices for key 'key' and everything drawn with it (tooltip, labels).
+internal int keyboard_batch_push_key(Keyboard_Batch *batch, int key, int at)
+{
+    int first = batch->key_quads[key];
+    int last = key + 1 < MIDI_FULL_LEN ? batch->key_quads[key + 1] : batch->quads;
+    
+    for (int quad = first; quad < last; ++quad) {
+        const unsigned short corners[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int i = 0; i < 6; ++i) batch->dynamic_indices[at*6 + i] = (unsigned short) (quad*4 + corners[i]);
+        at += 1;
+    }
+
+    return(at);
+}
+
+internal void render_keyboard(Rectangle rect, int key_width, int key_padding)
+{
+    PROFILE_ZONE(PROFILE_ZONE_RENDER_KEYBOARD);
+
+    Keyboard_Batch *batch = &state.keyboard;
+    if (batch->vao == 0) keyboard_batch_init(batch);
+    
+    bool layout_changed = !batch->built || memcmp(&rect, &batch->rect, sizeof(rect)) != 0 ||
+                          key_width != batch->key_width || key_padding != batch->key_padding;
+    
+    if (layout_changed) {
+        keyboard_batch_layout(batch, rect, key_width, key_padding);
+        ui_invalidate(UI_LAYER_BIT(UI_LAYER_KEYBOARD));
+        
+        batch->built = true;
+        batch->rect = rect;
+        batch->key_width = key_width;
+        batch->key_padding = key_padding;
+    }
+
+    // @Note: The layer has every key in its resting colour.
+    if (ui_layer_begin(UI_LAYER_KEYBOARD, rect, { 20, 20, 20, 255 })) {
+        keyboard_batch_build(batch, rect, key_width);
+        keyboard_batch_draw(batch, batch->vao, batch->quads);
+        
+        ui_layer_end(UI_LAYER_KEYBOARD);
+    }
+    
+    ui_layer_draw(UI_LAYER_KEYBOARD);
+
+    // @Note: Black keys sit on top of the white ones, so they get the mouse first.
+    int hovered = -1;
+    for (int i = MIDI_FULL_LEN - 1; i >= 0 && hovered == -1; --i) {
+        if (CheckCollisionPointRec(GetMousePosition(), batch->keys[i].rect)) hovered = i;
+    }
+
+    if (hovered != -1 && IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
+        state.active_key = batch->keys[hovered].note_number;
+        state.active_control = -1;
+        log_print("Press keyboard key to finish mapping");
+    }
+
+    // @Note: Keys that aren't resting are drawn again, together with the
+    // black keys lying on top of them.
+    bool lit[MIDI_FULL_LEN] = {0};
+    
+    for (int i = 0; i < MIDI_FULL_LEN; ++i) {
+        const Note *note = &batch->keys[i];
+        Color c = get_colour_from_state(note->note_number, note->color);
+        if (i == hovered && !state.highlighted_notes[note->note_number]) c = RED;
+
+        keyboard_batch_set_color(batch, i, c);
+        lit[i] = memcmp(&c, &note->color, sizeof(c)) != 0;
+    }
+
+    int quads = 0;
+    for (int i = 0; i < WHITE_KEYS_LEN; ++i) {
+        if (lit[i]) quads = keyboard_batch_push_key(batch, i, quads);
+    }
+
+    for (int i = WHITE_KEYS_LEN; i < MIDI_FULL_LEN; ++i) {
+        bool covers_lit = false;
+        for (int j = 0; j < WHITE_KEYS_LEN && !covers_lit; ++j) {
+            covers_lit = lit[j] && CheckCollisionRecs(batch->keys[i].rect, batch->keys[j].rect);
+        }
+        
+        if (lit[i] || covers_lit) quads = keyboard_batch_push_key(batch, i, quads);
+    }
+
+    if (quads > 0) {
+        rlUpdateVertexBufferElements(batch->dynamic_index_vbo, batch->dynamic_indices, quads*6*sizeof(unsigned short), 0);
+        keyboard_batch_draw(batch, batch->dynamic_vao, quads);
+    }
+}
+
+internal void note_roll_renderer_init(Note_Roll_Renderer *renderer)
+{
+    char vertex_shader[2048] = {0};
+    snprintf(vertex_shader, sizeof(vertex_shader), note_roll_vertex_shader, MIDI_FULL_LEN);
+    
+    renderer->shader = LoadShaderFromMemory(vertex_shader, note_roll_fragment_shader);
+    renderer->span_loc = GetShaderLocationAttrib(renderer->shader, "span");
+    renderer->now_loc = GetShaderLocation(renderer->shader, "now");
+    renderer->playhead_loc = GetShaderLocation(renderer->shader, "playhead");
+    renderer->scale_loc = GetShaderLocation(renderer->shader, "scale");
+    renderer->bounds_loc = GetShaderLocation(renderer->shader, "bounds");
+    renderer->lanes_loc = GetShaderLocation(renderer->shader, "lanes");
+
+    const float quad[12] = { 0, 0, 0,  0, 1, 0,  1, 1, 0,  1, 0, 0 };
+    const unsigned short indices[6] = { 0, 1, 2, 0, 2, 3 };
+    
+    renderer->vao = rlLoadVertexArray();
+    rlEnableVertexArray(renderer->vao);
+
+    renderer->quad_vbo = rlLoadVertexBuffer(quad, sizeof(quad), false);
+    rlSetVertexAttribute(renderer->shader.locs[SHADER_LOC_VERTEX_POSITION], 3, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(renderer->shader.locs[SHADER_LOC_VERTEX_POSITION]);
+
+    renderer->span_vbo = rlLoadVertexBuffer(state.note_roll.spans, sizeof(state.note_roll.spans), true);
+    rlSetVertexAttribute(renderer->span_loc, 4, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(renderer->span_loc);
+    rlSetVertexAttributeDivisor(renderer->span_loc, 1);
+
+    renderer->index_vbo = rlLoadVertexBufferElement(indices, sizeof(indices), false);
+    rlDisableVertexArray();
+}
+
+internal void note_roll_renderer_unload(Note_Roll_Renderer *renderer)
+{
+    if (renderer->vao == 0) return;
+
+    rlUnloadVertexBuffer(renderer->quad_vbo);
+    rlUnloadVertexBuffer(renderer->index_vbo);
+    rlUnloadVertexBuffer(renderer->span_vbo);
+    rlUnloadVertexArray(renderer->vao);
+    UnloadShader(renderer->shader);
+}
+
+// @Note: Falling notes above the keyboard, every lane lines up with its
+// key. Upcoming notes come down from the top, played ones keep going down
+// past the playhead until they run into the keyboard.
+internal void render_note_roll(Rectangle rect)
+{
+    PROFILE_ZONE(PROFILE_ZONE_RENDER_NOTE_ROLL);
+
+    Note_Roll *roll = &state.note_roll;
+    Note_Roll_Renderer *renderer = &state.roll_renderer;
+    if (renderer->vao == 0) note_roll_renderer_init(renderer);
+
+    note_roll_drain(roll, &state.note_roll_events);
+    
+    if (roll->dirty_first <= roll->dirty_last) {
+        int count = roll->dirty_last - roll->dirty_first + 1;
+        rlUpdateVertexBuffer(renderer->span_vbo, &roll->spans[roll->dirty_first], count*sizeof(Note_Span), roll->dirty_first*sizeof(Note_Span));
+        
+        roll->dirty_first = NOTE_ROLL_LEN;
+        roll->dirty_last = -1;
+    }
+
+    // @Note: Lanes come straight from the keyboard's layout, it's drawn first.
+    float lanes[MIDI_FULL_LEN*4] = {0};
+    for (int i = 0; i < MIDI_FULL_LEN; ++i) {
+        const Note *key = &state.keyboard.keys[i];
+        float *lane = &lanes[key->note_number*4];
+        
+        lane[0] = key->rect.x;
+        lane[1] = key->rect.width;
+        lane[2] = i >= WHITE_KEYS_LEN ? 1.0f : 0.0f;
+    }
+
+    float now = note_roll_seconds(roll, get_time_ns());
+    float playhead = rect.y + rect.height*NOTE_ROLL_PLAYHEAD;
+    float scale = NOTE_ROLL_PIXELS_PER_SECOND;
+    float bounds[2] = { rect.y, rect.y + rect.height };
+
+    DrawLineEx({ rect.x, playhead }, { rect.x + rect.width, playhead }, 1.0f, { 60, 60, 60, 255 });
+    rlDrawRenderBatchActive();
+
+    rlEnableShader(renderer->shader.id);
+    rlSetUniformMatrix(renderer->shader.locs[SHADER_LOC_MATRIX_MVP], MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection()));
+    rlSetUniform(renderer->now_loc, &now, RL_SHADER_UNIFORM_FLOAT, 1);
+    rlSetUniform(renderer->playhead_loc, &playhead, RL_SHADER_UNIFORM_FLOAT, 1);
+    rlSetUniform(renderer->scale_loc, &scale, RL_SHADER_UNIFORM_FLOAT, 1);
+    rlSetUniform(renderer->bounds_loc, bounds, RL_SHADER_UNIFORM_VEC2, 1);
+    rlSetUniform(renderer->lanes_loc, lanes, RL_SHADER_UNIFORM_VEC4, MIDI_FULL_LEN);
+
+    rlDisableBackfaceCulling();
+    rlEnableVertexArray(renderer->vao);
+    rlDrawVertexArrayElementsInstanced(0, 6, 0, NOTE_ROLL_LEN);
+    rlDisableVertexArray();
+    
+    rlEnableBackfaceCulling();
+    rlDisableShader();
+}
+
+internal void draw_text_left(const char *text, int x, int y, float font_size, Color color)
+{
+    PROFILE_ZONE(PROFILE_ZONE_TEXT);
+    
+    DrawTextEx(state.font, text, { (float) x, y - font_size/2.0f }, font_size, 1.0f, color);
+}
+
+// @Note: One line of "label   < value >", clicking the arrows steps the value.
+// 'value' is printed with 'format', unless 'value_names' is given for
+// settings that are really an enum.
+internal void render_setting(Rectangle rect, const char *label, int *value, int step, int min, int max, const char *format, const char *const *value_names)
+{
+    const float arrow_width = 24.0f;
+    const float value_width = 80.0f;
+    const float font_size = 22.0f;
+    int center_y = (int) (rect.y + rect.height/2.0f);
+    
+    draw_text_left(label, (int) rect.x, center_y, font_size, LIGHTGRAY);
+
+    Rectangle right_arrow = { rect.x + rect.width - arrow_width, rect.y, arrow_width, rect.height };
+    Rectangle left_arrow = { right_arrow.x - value_width - arrow_width, rect.y, arrow_width, rect.height };
+
+    Rectangle arrows[2] = { left_arrow, right_arrow };
+    for (int i = 0; i < 2; ++i) {
+        Color c = { 50, 50, 50, 255 };
+        
+        if (CheckCollisionPointRec(GetMousePosition(), arrows[i])) {
+            c = { 70, 70, 70, 255 };
+            
+            if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
+                *value += i == 0 ? -step : step;
+                
+                if (*value < min) *value = min;
+                if (*value > max) *value = max;
+            }
+        }
+        
+        DrawRectangleRounded(arrows[i], 0.4f, 0, c);
+        draw_text_centered(i == 0 ? "<" : ">", (int) (arrows[i].x + arrow_width/2.0f), center_y, font_size, WHITE);
+    }
+
+    char text[32] = {0};
+    if (value_names) {
+        snprintf(text, sizeof(text), "%s", value_names[*value]);
+    } else {
+        snprintf(text, sizeof(text), format, *value);
+    }
+    
+    draw_text_centered(text, (int) (left_arrow.x + arrow_width + value_width/2.0f), center_y, font_size, WHITE);
+}
+
+internal bool render_button(Rectangle rect, const char *text, Color color)
+{
+    bool clicked = false;
+    Color c = { 50, 50, 50, 255 };
+    
+    if (CheckCollisionPointRec(GetMousePosition(), rect)) {
+        c = { 70, 70, 70, 255 };
+        clicked = IsMouseButtonReleased(MOUSE_BUTTON_LEFT);
+    }
+
+    DrawRectangleRounded(rect, 0.4f, 0, c);
+    draw_text_centered(text, (int) (rect.x + rect.width/2.0f), (int) (rect.y + rect.height/2.0f), 22.0f, color);
+
+    return(clicked);
+}
+
+// @Note: Picks up whatever CC/pitch bend/program change came in last for
+// the control mapping being edited, the injection thread records it.
+internal void check_control_learn()
+{
+    uint32_t seen = state.pipeline.controls_seen.load(std::memory_order_acquire);
+    if (!state.learning_control || seen == state.learn_controls_seen) return;
+
+    uint32_t last = state.pipeline.last_control.load(std::memory_order_relaxed);
+    Control_Mapping *control = &state.configs[state.config_id].controls[state.edit_control];
+    
+    uint8_t status = last & 0xFF;
+    if (status == CONTROL_CHANGE) control->source = CONTROL_CC;
+    else if (status == PITCH_BEND) control->source = CONTROL_PITCH_BEND;
+    else control->source = CONTROL_PROGRAM_CHANGE;
+    
+    control->number = (last >> 8) & 0x7F;
+    rebuild_mapping_table(state.config_id);
+
+    state.learning_control = false;
+    log_print("Control learned");
+}
+
+internal void render_control_panel(Rectangle rect, int button_padding)
+{
+    PROFILE_ZONE(PROFILE_ZONE_RENDER_CONTROL_PANEL);
+    
+    DrawRectangleRec(rect, { 25, 25, 25, 255 });
+
+    Rectangle button_rect = {0};
+    button_rect.width = rect.width - 2.0f*button_padding;
+    button_rect.height = 50.0f;
+    button_rect.x = rect.x + button_padding;
+    button_rect.y = rect.y + button_padding;
+    
+    Vector2 text_center = {0};
+    text_center.x = button_rect.x + button_rect.width/2.0f;
+    text_center.y = button_rect.y + button_rect.height/2.0f;
+
+    for (size_t i = 0; i < CONFIG_LEN; ++i) {
+        if (CheckCollisionPointRec(GetMousePosition(), button_rect)) {
+            if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
+                state.config_id = i;
+                state.active_key = -1;
+                state.active_control = -1;
+                log_print("Loaded %s", state.configs[i].name);
+            }
+            
+            DrawRectangleRounded(button_rect, 0.4f, 0, { 70, 70, 70, 255 });
+        } else {
+            DrawRectangleRounded(button_rect, 0.4f, 0, { 50, 50, 50, 255 });
+        }
+
+        draw_text_centered(state.configs[i].name, (int) text_center.x, (int) text_center.y, 32, WHITE);
+        
+        button_rect.y += button_rect.height + button_padding;
+        text_center.y = button_rect.y + button_rect.height/2.0f;
+    }
+
+    Rectangle setting_rect = button_rect;
+    setting_rect.height = 30.0f;
+    setting_rect.y += button_padding;
+    
+    const float setting_step = setting_rect.height + button_padding/2;
+
+    render_setting(setting_rect, "Settings", &state.settings_page, 1, 0, SETTINGS_PAGE_COUNT - 1, 0, settings_page_names);
+    setting_rect.y += setting_step + button_padding/2;
+
+    if (state.settings_page == SETTINGS_PAGE_INPUT) {
+        Note_Filter_Settings *filter = &state.settings.filter;
+        render_setting(setting_rect, "Debounce", &filter->debounce_ms, 1, 0, 50, "%d ms", 0);
+        setting_rect.y += setting_step;
+    
+        render_setting(setting_rect, "Re-trigger", &filter->retrigger_ms, 10, 0, 500, "%d ms", 0);
+        setting_rect.y += setting_step;
+    
+        render_setting(setting_rect, "Too fast", &filter->retrigger_mode, 1, 0, RETRIGGER_MODE_COUNT - 1, 0, retrigger_mode_names);
+        setting_rect.y += setting_step;
+
+        // @Note: Both kinds of aftertouch share a row, nobody wants just one of them.
+        const int receive_rows[3] = {
+            MIDI_CLASS_BIT(MIDI_CLASS_CLOCK),
+            MIDI_CLASS_BIT(MIDI_CLASS_ACTIVE_SENSING),
+            MIDI_CLASS_BIT(MIDI_CLASS_POLY_PRESSURE) | MIDI_CLASS_BIT(MIDI_CLASS_CHANNEL_PRESSURE),
+        };
+        const char *const receive_labels[3] = { "Clock", "Sensing", "Aftertouch" };
+        
+        int receive_drop = state.settings.receive_drop;
+        uint32_t shed = 0;
+        
+        for (int i = 0; i < 3; ++i) {
+            int drop = (receive_drop & receive_rows[i]) != 0;
+            render_setting(setting_rect, receive_labels[i], &drop, 1, 0, 1, 0, receive_names);
+            setting_rect.y += setting_step;
+            
+            receive_drop = drop ? receive_drop | receive_rows[i] : receive_drop & ~receive_rows[i];
+        }
+        
+        if (receive_drop != state.settings.receive_drop) {
+            state.settings.receive_drop = receive_drop;
+            receive_filter_set(&state.receive_filter, receive_drop);
+        }
+
+        for (int i = 0; i < MIDI_CLASS_COUNT; ++i) {
+            shed += state.receive_filter.dropped[i].load(std::memory_order_relaxed);
+        }
+
+        if (shed > 0) {
+            char text[96] = {0};
+            snprintf(text, sizeof(text), "Dropped %u (clock %u, sensing %u)", shed,
+                     state.receive_filter.dropped[MIDI_CLASS_CLOCK].load(std::memory_order_relaxed),
+                     state.receive_filter.dropped[MIDI_CLASS_ACTIVE_SENSING].load(std::memory_order_relaxed));
+            draw_text_left(text, (int) setting_rect.x, (int) (setting_rect.y + setting_rect.height/2.0f), 20.0f, GRAY);
+            setting_rect.y += 24.0f;
+        }
+
+        uint32_t sysex = state.sysex.messages.load(std::memory_order_relaxed);
+        uint32_t errors = state.sysex.errors.load(std::memory_order_relaxed);
+        uint32_t backlog = state.sysex.backlog.load(std::memory_order_relaxed);
+        if (sysex > 0 || errors > 0 || backlog > 0) {
+            char text[96] = {0};
+            snprintf(text, sizeof(text), "SysEx %u, errors %u, backlog %u", sysex, errors, backlog);
+            draw_text_left(text, (int) setting_rect.x, (int) (setting_rect.y + setting_rect.height/2.0f), 20.0f, GRAY);
+        }
+    } else if (state.settings_page == SETTINGS_PAGE_OUTPUT) {
+        render_setting(setting_rect, "Keys", &state.settings.key_mode, 1, 0, KEY_MODE_COUNT - 1, 0, key_mode_names);
+        setting_rect.y += setting_step;
+        
+        int key_gap_ms = state.settings.key_gap_ms;
+        render_setting(setting_rect, "Key gap", &state.settings.key_gap_ms, 1, 0, 100, "%d ms", 0);
+        setting_rect.y += setting_step;
+
+        // @Note: The injection thread might be asleep until the next paced
+        // event, which doesn't have to wait anymore with pacing off.
+        if (state.settings.key_gap_ms != key_gap_ms) SetEvent(state.injection_wakeup);
+
+        render_setting(setting_rect, "Max delay", &state.settings.key_delay_max_ms, 50, 50, 2000, "%d ms", 0);
+        setting_rect.y += setting_step;
+
+        Strum_Settings *strum = &state.settings.strum;
+        render_setting(setting_rect, "Strum", &strum->window_ms, 5, 0, 100, "%d ms", 0);
+        setting_rect.y += setting_step;
+    
+        render_setting(setting_rect, "Strum step", &strum->offset_ms, 5, 0, 200, "%d ms", 0);
+        setting_rect.y += setting_step;
+
+        render_setting(setting_rect, "Strum dir", &strum->direction, 1, 0, STRUM_DIRECTION_COUNT - 1, 0, strum_direction_names);
+        setting_rect.y += setting_step;
+
+        // @Note: Written by the injection thread, a stale read here just means
+        // the numbers are a frame behind.
+        const Pacer *pacer = &state.pipeline.pacer;
+        if (state.settings.key_gap_ms > 0 && pacer->paced_events > 0) {
+            char text[96] = {0};
+            snprintf(text, sizeof(text), "Paced +%.1f ms (max %.1f), %llu dropped", pacer->last_delay_ns/1e6, pacer->max_delay_ns/1e6,
+                     (unsigned long long) pacer->dropped);
+            draw_text_left(text, (int) setting_rect.x, (int) (setting_rect.y + setting_rect.height/2.0f), 20.0f, GRAY);
+        }
+    } else if (state.settings_page == SETTINGS_PAGE_VELOCITY) {
+        int edit_layer = state.edit_layer;
+        render_setting(setting_rect, "Editing", &state.edit_layer, 1, 0, VELOCITY_LAYERS_LEN, 0, layer_names);
+        setting_rect.y += setting_step;
+
+        if (edit_layer != state.edit_layer) ui_invalidate(UI_LAYER_BIT(UI_LAYER_KEYBOARD));
+
+        Config *config = &state.configs[state.config_id];
+        for (int i = 0; i < VELOCITY_LAYERS_LEN; ++i) {
+            char label[32] = {0};
+            snprintf(label, sizeof(label), "%s from", layer_names[i + 1]);
+            
+            int threshold = config->velocity_thresholds[i];
+            render_setting(setting_rect, label, &config->velocity_thresholds[i], 4, 0, 127, "%d", 0);
+            setting_rect.y += setting_step;
+
+            if (threshold != config->velocity_thresholds[i]) rebuild_mapping_table(state.config_id);
+        }
+    } else if (state.settings_page == SETTINGS_PAGE_CONTROLS) {
+        render_setting(setting_rect, "Mapping", &state.edit_control, 1, 0, CONTROLS_LEN - 1, "#%d", 0);
+        setting_rect.y += setting_step;
+        
+        Config *config = &state.configs[state.config_id];
+        Control_Mapping *control = &config->controls[state.edit_control];
+        Control_Mapping before = *control;
+        
+        render_setting(setting_rect, "Source", &control->source, 1, 0, CONTROL_SOURCE_COUNT - 1, 0, control_source_names);
+        setting_rect.y += setting_step;
+        
+        render_setting(setting_rect, "Number", &control->number, 1, 0, 127, "%d", 0);
+        setting_rect.y += setting_step;
+        
+        render_setting(setting_rect, "Threshold", &control->threshold, 4, -64, 127, "%d", 0);
+        setting_rect.y += setting_step;
+        
+        render_setting(setting_rect, "Hysteresis", &control->hysteresis, 1, 0, 64, "%d", 0);
+        setting_rect.y += setting_step;
+        
+        render_setting(setting_rect, "Action", &control->action, 1, 0, ACTION_COUNT - 1, 0, control_action_names);
+        setting_rect.y += setting_step;
+
+        // @Note: 'param' means something else for every action.
+        if (control->action != before.action) control->param = 0;
+
+        if (control->action == ACTION_KEY) {
+            char name[8] = {0};
+            char modifiers[16] = {0};
+            char text[32] = "Click to map";
+            
+            if (state.active_control == state.edit_control) {
+                snprintf(text, sizeof(text), "Press a key");
+            } else if (control->param != 0) {
+                format_key_label(control->param, name, modifiers);
+                snprintf(text, sizeof(text), "%s%s%s", modifiers, modifiers[0] ? " " : "", name);
+            }
+            
+            if (render_button(setting_rect, text, WHITE)) {
+                state.active_control = state.edit_control;
+                state.active_key = -1;
+                log_print("Press keyboard key to finish mapping");
+            }
+        } else if (control->action == ACTION_PROFILE) {
+            const char *config_names[CONFIG_LEN] = {0};
+            for (size_t i = 0; i < CONFIG_LEN; ++i) config_names[i] = state.configs[i].name;
+            
+            render_setting(setting_rect, "Profile", &control->param, 1, 0, CONFIG_LEN - 1, 0, config_names);
+        }
+        setting_rect.y += setting_step;
+
+        if (render_button(setting_rect, state.learning_control ? "Move a control..." : "Learn", state.learning_control ? ORANGE : WHITE)) {
+            state.learning_control = !state.learning_control;
+            state.learn_controls_seen = state.pipeline.controls_seen.load(std::memory_order_acquire);
+        }
+        setting_rect.y += setting_step;
+
+        if (memcmp(&before, control, sizeof(before)) != 0) rebuild_mapping_table(state.config_id);
+    }
+}
+
+// @Note: This thing is so poorly document it's like John Microsoft doesn't want us
+// to develop things for their system.
+//
+// @Note: This runs on a winmm thread and shouldn't do anything that can take
+// a while, it timestamps the message, hands it to the injection thread and leaves.
+internal void CALLBACK midi_callback(HMIDIIN handle, UINT msg, DWORD_PTR instance, DWORD_PTR arg0, DWORD_PTR arg1)
+{    
+    UNUSED(arg1);
+    UNUSED(handle);
+    
+    switch (msg) {
+    case MIM_MOREDATA:
+    case MIM_DATA: {
+        Trace_Buffer *trace = &state.trace.buffers[TRACE_THREAD_CALLBACK];
+        int note = (int) ((arg0 >> 8) & 0x7F);
+        
+        if (!receive_filter_accept(&state.receive_filter, (uint32_t) arg0)) {
+            trace_emit(trace, TRACE_RECEIVE, TRACE_DROPPED, note, (uint32_t) arg0, 0, 0);
+            return;
+        }
+
+        Midi_Event event = {0};
+        event.time_ns = get_time_ns();
+        event.packed = (uint32_t) arg0;
+        event.device = (uint32_t) instance;
+
+        // @Note: MIM_MOREDATA means the driver has more queued up behind this
+        // one, the injection thread drains the whole queue per wakeup anyway.
+        if (msg == MIM_MOREDATA) state.sysex.backlog.fetch_add(1, std::memory_order_relaxed);
+        
+        bool queued = midi_queue_push(&state.midi_queue, &event);
+        trace_emit(trace, TRACE_RECEIVE, queued ? TRACE_OK : TRACE_QUEUE_FULL, note, event.packed, event.time_ns, 0);
+        
+        if (queued) SetEvent(state.injection_wakeup);
+    } break;
+
+    case MIM_LONGERROR:
+    case MIM_LONGDATA: {
+        MIDIHDR *header = (MIDIHDR *) arg0;
+        
+        // @Note: Nothing uses SysEx yet, but it's counted (or shed) like everything
+        // else. Empty buffers are what midiInReset() hands back on close.
+        if (header->dwBytesRecorded > 0 && receive_filter_accept(&state.receive_filter, 0xF0)) {
+            if (msg == MIM_LONGERROR) state.sysex.errors.fetch_add(1, std::memory_order_relaxed);
+            else state.sysex.messages.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        state.sysex.returned.fetch_or(1u << header->dwUser, std::memory_order_release);
+    } break;
+
+    case MIM_ERROR: {
+        state.sysex.errors.fetch_add(1, std::memory_order_relaxed);
+    } break;
+    }
+}
+
+internal bool send_key_event(const Key_Event *event)
+{
+    INPUT input = {0};
+    input.type = INPUT_KEYBOARD;
+    input.ki.wVk = event->vk;
+    
+    if (event->flags & KEY_EVENT_UP) {
+        input.ki.dwFlags |= KEYEVENTF_KEYUP;
+    }
+
+    return(SendInput(1, &input, sizeof(INPUT)) == 1);
+}
+
+// @Note: Sleeps until new MIDI arrives or 'due_ns', whichever comes first.
+// With a high resolution waitable timer (Windows 10 1803+) that's accurate to
+// well under a millisecond, otherwise we're stuck with the 1ms wait timeout.
+internal void injection_wait(uint64_t due_ns)
+{
+    uint64_t now = get_time_ns();
+    
+    if (due_ns == UINT64_MAX) {
+        WaitForSingleObject(state.injection_wakeup, INFINITE);
+    } else if (due_ns <= now) {
+        return;
+    } else if (state.injection_timer) {
+        LARGE_INTEGER due_time = {0};
+        due_time.QuadPart = -(LONGLONG) ((due_ns - now + 99)/100); // @Note: Relative, in 100ns units.
+        SetWaitableTimer(state.injection_timer, &due_time, 0, 0, 0, FALSE);
+
+        HANDLE handles[2] = { state.injection_wakeup, state.injection_timer };
+        WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+    } else {
+        WaitForSingleObject(state.injection_wakeup, (DWORD) ((due_ns - now + 999999)/1000000));
+    }
+}
+
+// @Note: Hazard pointer, the injection thread announces which tables it's
+// about to read and checks they're still the live ones afterwards. Once
+// that check passes the watcher won't touch them until they're released.
+internal const Mapping_Table *acquire_tables()
+{
+    const Mapping_Table *tables = 0;
+    
+    do {
+        tables = state.tables.load(std::memory_order_acquire);
+        state.tables_in_use.store(tables, std::memory_order_seq_cst);
+    } while (tables != state.tables.load(std::memory_order_seq_cst));
+
+    return(tables);
+}
+
+internal void playback_send(const Key_Event *key)
+{
+    bool sent = send_key_event(key);
+    trace_emit(state.pipeline.trace, TRACE_INJECT, sent ? TRACE_OK : TRACE_FAILED, 0, key->vk | (key->flags << 16), 0, key->time_ns);
+}
+
+internal uint64_t playback_next_due()
+{
+    int current = state.playback.state.load(std::memory_order_acquire);
+    if (current == PLAYBACK_STARTING || current == PLAYBACK_STOPPING) return(0);
+    if (current != PLAYBACK_PLAYING) return(UINT64_MAX);
+
+    return(timeline_player_next_due(&state.playback.player));
+}
+
+// @Note: Injection thread side of 'Playback'. Playing is nothing but sending
+// whatever's due, everything else was done when the timeline was compiled.
+internal void playback_update(uint64_t now_ns)
+{
+    Playback *playback = &state.playback;
+    Timeline_Player *player = &playback->player;
+    int current = playback->state.load(std::memory_order_acquire);
+
+    if (current == PLAYBACK_STARTING) {
+        timeline_player_start(player, playback->records, playback->count, playback->checkpoints, playback->checkpoints_len, playback->start_ns);
+        playback->state.compare_exchange_strong(current, PLAYBACK_PLAYING, std::memory_order_acq_rel);
+        current = playback->state.load(std::memory_order_acquire);
+    }
+
+    Key_Event key = {0};
+    
+    if (current == PLAYBACK_STOPPING) {
+        while (timeline_player_release(player, &key)) playback_send(&key);
+        playback->state.store(PLAYBACK_DONE, std::memory_order_release);
+        return;
+    }
+
+    if (current != PLAYBACK_PLAYING) return;
+
+    if (playback->request.load(std::memory_order_acquire)) {
+        timeline_player_loop(player, playback->request_loop_start_ns, playback->request_loop_end_ns);
+        timeline_player_seek(player, playback->request_time_ns, playback->request_at_ns);
+        playback->request.store(false, std::memory_order_release);
+    }
+
+    while (timeline_player_pop_due(player, now_ns, &key)) playback_send(&key);
+    playback->position.store(player->cursor, std::memory_order_relaxed);
+
+    if (!timeline_player_done(player)) return;
+
+    // @Note: The next song of the set starts where this one ends, on the dot
+    // unless it's still being compiled, then as soon as it's there.
+    Setlist *setlist = &state.setlist;
+    int next = setlist->state.load(std::memory_order_acquire);
+    if (next == SETLIST_COMPILING) return;
+
+    if (next == SETLIST_READY) {
+        uint64_t start_ns = player->start_ns + playback->duration_ns;
+        if (start_ns < now_ns) start_ns = now_ns;
+
+        while (timeline_player_release(player, &key)) playback_send(&key);
+        timeline_player_start(player, setlist->timeline.records, setlist->timeline.count, setlist->checkpoints, setlist->checkpoints_len, start_ns);
+
+        setlist->start_ns = start_ns;
+        playback->position.store(0, std::memory_order_relaxed);
+        setlist->state.store(SETLIST_TAKEN, std::memory_order_release);
+        return;
+    }
+
+    playback->state.compare_exchange_strong(current, PLAYBACK_DONE, std::memory_order_acq_rel);
+}
+
+// @Note: Owns the pipeline, it's the only thread that pops the MIDI queue
+// and the only one that calls SendInput. It sleeps until either new MIDI
+// arrives or the next scheduled key event is due.
+internal DWORD WINAPI injection_thread_proc(LPVOID param)
+{
+    UNUSED(param);
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+    
+    while (state.injection_running.load(std::memory_order_relaxed)) {
+        uint64_t due_ns = pipeline_next_due(&state.pipeline, &state.settings);
+        uint64_t playback_due_ns = playback_next_due();
+        injection_wait(playback_due_ns < due_ns ? playback_due_ns : due_ns);
+
+        // @Note: The UI thread can change these at any point, we just want
+        // a consistent copy for the whole batch.
+        Pipeline_Settings settings = state.settings;
+        const Mapping_Table *tables = acquire_tables();
+
+        Midi_Event event = {0};
+        while (midi_queue_pop(&state.midi_queue, &event)) {
+            pipeline_process(&state.pipeline, tables, &settings, &event);
+        }
+
+        state.tables_in_use.store(0, std::memory_order_release);
+
+        pipeline_update(&state.pipeline, &settings, get_time_ns());
+        
+        Key_Event key = {0};
+        while (pipeline_pop_due(&state.pipeline, &settings, get_time_ns(), &key)) {
+            bool sent = send_key_event(&key);
+            trace_emit(state.pipeline.trace, TRACE_INJECT, sent ? TRACE_OK : TRACE_FAILED, 0, key.vk | (key.flags << 16), 0, key.time_ns);
+        }
+
+        playback_update(get_time_ns());
     }
 
-    strncpy(state.configs[3].name, "Custom_2", CONFIG_NAME_LEN);
-    for (size_t i = 0; i < MIDI_FULL_LEN; ++i) {
-        state.configs[3].keys_map[i] = 0;
+    // @Note: Don't leave the game with keys stuck down.
+    if (state.playback.state.load(std::memory_order_acquire) == PLAYBACK_PLAYING) {
+        Key_Event key = {0};
+        while (timeline_player_release(&state.playback.player, &key)) playback_send(&key);
     }
+
+    return 0;
 }
 
-internal void render_set_of_keys(Rectangle rect, Note *keys, size_t size, int key_width)
+// @Note: Runs on the watcher thread. Everything slow (reading, parsing,
+// building the tables) happens here, the UI thread only copies the result.
+internal void stage_config_reload()
 {
-    const int tooltip_padding = 2;
-    
-    Rectangle tooltip = {0};
-    tooltip.width = key_width - tooltip_padding*2.0f;
-    tooltip.height = rect.height * 0.25f;
+    Config_Watcher *watcher = &state.watcher;
     
-    for (int i = 0; i < size; ++i) {        
-        Color c = keys[i].color;
-        
-        if (keys[i].hovered) {
-            if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
-                state.active_key = keys[i].note_number;
-                state.log_message = "Press keyboard key to finish mapping";
-            }
-            
-            if (!state.highlighted_notes[keys[i].note_number]) {
-                c = RED;
-            }
-        }
-        
-        DrawRectangleRec(keys[i].rect, c);
+    load_default_configs(watcher->configs);
+    watcher->settings = default_pipeline_settings();
+    uint32_t file_hash = 0;
+    if (!read_config_file(DEFAULT_CONFIG_FILE, watcher->configs, &watcher->settings, &file_hash)) return;
 
-        Config current_config = state.configs[state.config_id];
-        if (current_config.keys_map[keys[i].note_number] != 0) {
-            tooltip.x = keys[i].rect.x + tooltip_padding;
-            tooltip.y = rect.y + keys[i].rect.height - tooltip.height - tooltip_padding;
-            DrawRectangleRounded(tooltip, 0.4f, 0, { 50, 50, 50, 255 });
+    // @Note: That's the journal compacting into config.dat, not somebody else editing it.
+    if (file_hash == state.journal.snapshot_hash.load(std::memory_order_acquire)) return;
 
-            Vector2 text_center = {0};
-            text_center.x = tooltip.x + tooltip.width / 2.0f;
-            text_center.y = tooltip.y + tooltip.height / 2.0f;
+    // @Note: Only the UI thread swaps the live tables, and it doesn't while 'ready' is false.
+    Mapping_Table *live = state.tables.load(std::memory_order_acquire);
+    watcher->tables = live == state.table_buffers[0] ? state.table_buffers[1] : state.table_buffers[0];
 
-            int index = current_config.keys_map[keys[i].note_number];
-            if (strlen(vk_translation[index]) > 3) {
-                // @Note: snprintf() causes weird behaviour that I don't want to investigate right now,
-                // plus this approach is fine here.
-                char text[4] = { vk_translation[index][0], vk_translation[index][1], vk_translation[index][2], 0 };
-                draw_text_centered(text, (int) text_center.x, (int) text_center.y, 26, WHITE);
-            } else {
-                draw_text_centered(vk_translation[index], (int) text_center.x, (int) text_center.y, 26, WHITE);
-            }
-        }
+    // @Note: The injection thread might still be finishing a batch with these from before the last swap.
+    while (state.tables_in_use.load(std::memory_order_seq_cst) == watcher->tables) Sleep(0);
+    
+    for (size_t i = 0; i < CONFIG_LEN; ++i) {
+        config_build_table(&watcher->configs[i], &watcher->tables[i]);
     }
+
+    watcher->ready.store(true, std::memory_order_release);
 }
 
-// @Note: By default we render 'regular/extended' ffxiv keyboard.
-internal void render_keyboard(Rectangle rect, int key_width, int key_padding)
+// @Note: Editors tend to save in a couple of steps (truncate, write, rename),
+// so we wait for things to settle before reading the file.
+internal DWORD WINAPI config_watcher_proc(LPVOID param)
 {
-    Rectangle white_key = {0};
-    white_key.width = (float) key_width;
-    white_key.height = rect.height;
-    white_key.x = 0;
-    white_key.y = rect.y;
-
-    Rectangle black_key = {0};
-    black_key.width = (float) key_width;
-    black_key.height = rect.height/2.0f;
-    black_key.x = (key_width + key_padding)/2.0f;
-    black_key.y = rect.y;
+    UNUSED(param);
+    
+    Config_Watcher *watcher = &state.watcher;
+    const DWORD settle_ms = 150;
+    
+    HANDLE directory = CreateFileW(L".", FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                   0, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0);
+    if (directory == INVALID_HANDLE_VALUE) return 0;
 
-    // @Note: I needed to decouple rendering from logic
-    // handling, because rectangles overlap each-other.
-    // I wanted to solve this problem with z-index or something similar
-    // but raylib (afaik) doesn't provide anything like that (nor layers etc.)
-    Note white_keys[WHITE_KEYS_LEN] = {0};
-    Note black_keys[BLACK_KEYS_LEN] = {0};
-    bool hovered = false;
+    OVERLAPPED overlapped = {0};
+    overlapped.hEvent = CreateEvent(0, TRUE, FALSE, 0);
     
-    for (int i = 0, j = 0, note_number = 0; i < WHITE_KEYS_LEN; ++i) {
-        white_keys[i].rect = white_key;
-        white_keys[i].note_number = note_number;
-        white_keys[i].color = get_colour_from_state(note_number, WHITE);
-        note_number += 1;
-        
-        // @Robustness: Change this, it's just ugly.
-        if (i != WHITE_KEYS_LEN - 1 && (i % 7 != 6 && i % 7 != 2)) {
-            black_keys[j].rect = black_key;
-            black_keys[j].note_number = note_number;
-            black_keys[j].color = get_colour_from_state(note_number, BLACK);
-            note_number += 1;
+    alignas(DWORD) static BYTE changes[4096];
+    bool running = true;
+    
+    while (running) {
+        ResetEvent(overlapped.hEvent);
+        BOOL started = ReadDirectoryChangesW(directory, changes, sizeof(changes), FALSE,
+                                             FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, 0, &overlapped, 0);
+        if (!started) break;
+
+        HANDLE handles[2] = { watcher->stop, overlapped.hEvent };
+        if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0) {
+            CancelIoEx(directory, &overlapped);
+            break;
+        }
 
-            // @Note: This is some of the worst code I've ever written...
-            if (!hovered && CheckCollisionPointRec(GetMousePosition(), black_keys[j].rect)) {
-                hovered = true;
-                black_keys[j].hovered = true;
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE)) continue;
+
+        // @Note: 0 bytes means the buffer overflowed, which could include our file.
+        bool changed = bytes == 0;
+        for (BYTE *at = changes; bytes > 0;) {
+            FILE_NOTIFY_INFORMATION *info = (FILE_NOTIFY_INFORMATION *) at;
+            
+            if (info->FileNameLength == sizeof(CONFIG_FILE_NAME_W) - sizeof(WCHAR) &&
+                _wcsnicmp(info->FileName, CONFIG_FILE_NAME_W, info->FileNameLength/sizeof(WCHAR)) == 0) {
+                changed = true;
             }
             
-            j += 1;
+            if (info->NextEntryOffset == 0) break;
+            at += info->NextEntryOffset;
         }
 
-        if (!hovered && CheckCollisionPointRec(GetMousePosition(), white_keys[i].rect)) {
-            hovered = true;
-            white_keys[i].hovered = true;
+        if (!changed) continue;
+        
+        // @Note: The UI thread hasn't picked up the last reload yet,
+        // it will by the next frame.
+        while (running && watcher->ready.load(std::memory_order_acquire)) {
+            running = WaitForSingleObject(watcher->stop, 1) != WAIT_OBJECT_0;
         }
         
-        white_key.x += key_width + key_padding;
-        black_key.x += key_width + key_padding;
+        if (running) running = WaitForSingleObject(watcher->stop, settle_ms) != WAIT_OBJECT_0;
+        if (running) stage_config_reload();
     }
 
-    render_set_of_keys(rect, white_keys, WHITE_KEYS_LEN, key_width);
-    render_set_of_keys(rect, black_keys, BLACK_KEYS_LEN, key_width);
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(directory);
+
+    return 0;
 }
 
-internal void render_control_panel(Rectangle rect, int button_padding)
+internal void start_config_watcher()
 {
-    DrawRectangleRec(rect, { 25, 25, 25, 255 });
+    state.watcher.stop = CreateEvent(0, TRUE, FALSE, 0);
+    state.watcher.thread = CreateThread(0, 0, config_watcher_proc, 0, 0, 0);
+    SetThreadPriority(state.watcher.thread, THREAD_PRIORITY_BELOW_NORMAL);
+}
 
-    Rectangle button_rect = {0};
-    button_rect.width = rect.width - 2.0f*button_padding;
-    button_rect.height = 50.0f;
-    button_rect.x = rect.x + button_padding;
-    button_rect.y = rect.y + button_padding;
+internal void stop_config_watcher()
+{
+    SetEvent(state.watcher.stop);
+    WaitForSingleObject(state.watcher.thread, INFINITE);
     
-    Vector2 text_center = {0};
-    text_center.x = button_rect.x + button_rect.width/2.0f;
-    text_center.y = button_rect.y + button_rect.height/2.0f;
+    CloseHandle(state.watcher.thread);
+    CloseHandle(state.watcher.stop);
+}
 
-    for (size_t i = 0; i < CONFIG_LEN; ++i) {
-        if (CheckCollisionPointRec(GetMousePosition(), button_rect)) {
-            if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT)) {
-                state.config_id = i;
-                state.active_key = -1;
-                state.log_message = "Loaded config";
-            }
-            
-            DrawRectangleRounded(button_rect, 0.4f, 0, { 70, 70, 70, 255 });
-        } else {
-            DrawRectangleRounded(button_rect, 0.4f, 0, { 50, 50, 50, 255 });
-        }
+// @Note: Called once a frame. Swapping the table pointer is all the
+// injection thread sees, MIDI keeps flowing the whole time.
+internal void check_config_reload()
+{
+    Config_Watcher *watcher = &state.watcher;
+    if (!watcher->ready.load(std::memory_order_acquire)) return;
 
-        draw_text_centered(state.configs[i].name, (int) text_center.x, (int) text_center.y, 32, WHITE);
-        
-        button_rect.y += button_rect.height + button_padding;
-        text_center.y = button_rect.y + button_rect.height/2.0f;
-    }
+    memcpy(state.configs, watcher->configs, sizeof(state.configs));
+    state.settings = watcher->settings;
+    state.tables.store(watcher->tables, std::memory_order_release);
+    receive_filter_set(&state.receive_filter, state.settings.receive_drop);
+
+    state.active_key = -1;
+    state.active_control = -1;
+    log_print("Config reloaded");
+    ui_invalidate(UI_LAYERS_ALL);
+    
+    watcher->ready.store(false, std::memory_order_release);
 }
 
-// @Note: This thing is so poorly document it's like John Microsoft doesn't want us
-// to develop things for their system.
-internal void CALLBACK midi_callback(HMIDIIN handle, UINT msg, DWORD_PTR instance, DWORD_PTR arg0, DWORD_PTR arg1)
-{    
-    UNUSED(arg1);
-    UNUSED(handle);
-    UNUSED(instance);
+internal void start_injection_thread()
+{
+    receive_filter_set(&state.receive_filter, state.settings.receive_drop);
+    midi_queue_init(&state.midi_queue);
+    pipeline_init(&state.pipeline, get_time_ns());
+    state.pipeline.highlighted_notes = state.highlighted_notes;
+    state.pipeline.log = &state.log;
+    state.pipeline.config_id = &state.config_id;
+    state.pipeline.note_roll = &state.note_roll_events;
+    state.pipeline.trace = &state.trace.buffers[TRACE_THREAD_INJECTION];
+
+    // @Note: Default timer resolution is ~15ms, which is way too coarse for delayed key events.
+    timeBeginPeriod(1);
     
-    if (msg != MIM_DATA) return;
+    state.injection_running.store(true);
+    state.injection_wakeup = CreateEvent(0, FALSE, FALSE, 0);
+    state.injection_timer = CreateWaitableTimerExW(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    state.injection_thread = CreateThread(0, 0, injection_thread_proc, 0, 0, 0);
+}
+
+internal void stop_injection_thread()
+{
+    state.injection_running.store(false);
+    SetEvent(state.injection_wakeup);
     
-    unsigned int midi_message = arg0 & 0xFF;
-    unsigned int note = (arg0 >> 8) & 0xFF;
+    WaitForSingleObject(state.injection_thread, INFINITE);
+    CloseHandle(state.injection_thread);
+    CloseHandle(state.injection_wakeup);
+    if (state.injection_timer) CloseHandle(state.injection_timer);
     
-    int index = note - NOTE_OFFSET;
-    if (midi_message == NOTE_ON) {
-        if (index >= 0 && index < MIDI_FULL_LEN) {
-            state.highlighted_notes[index] = true;
+    timeEndPeriod(1);
+}
 
-            if (state.configs[state.config_id].keys_map[index] != 0) {
-                INPUT input = {0};
-                input.type = INPUT_KEYBOARD;
-                input.ki.wVk = (WORD) state.configs[state.config_id].keys_map[index];
-                
-                SendInput(1, &input, sizeof(INPUT));
-                input.ki.dwFlags |= KEYEVENTF_KEYUP;
-                SendInput(1, &input, sizeof(INPUT));
-            }
-        } else {
-            state.log_message = "Note is outside the visible range";
-        }
-    } else if (midi_message == NOTE_OFF) {
-        if (index >= 0 && index < MIDI_FULL_LEN) {
-            state.highlighted_notes[index] = false;
-        }
+internal void open_midi_device()
+{
+    // @Note: MIDI_IO_STATUS is what gets us MIM_MOREDATA.
+    MMRESULT result = midiInOpen(&state.midi_handle, 0, (DWORD_PTR) midi_callback, 0, CALLBACK_FUNCTION | MIDI_IO_STATUS);
+    if (result != MMSYSERR_NOERROR) return;
+    
+    state.sysex.returned.store(0);
+    
+    for (uint32_t i = 0; i < SYSEX_BUFFERS_LEN; ++i) {
+        MIDIHDR *header = &state.sysex.headers[i];
+        memset(header, 0, sizeof(*header));
+        header->lpData = state.sysex.data[i];
+        header->dwBufferLength = SYSEX_BUFFER_SIZE;
+        header->dwUser = i;
+        
+        midiInPrepareHeader(state.midi_handle, header, sizeof(*header));
+        midiInAddBuffer(state.midi_handle, header, sizeof(*header));
+    }
+
+    state.device_connected = true;
+    midiInStart(state.midi_handle);
+}
+
+internal void close_midi_device()
+{
+    // @Note: Reset hands every buffer back through the callback, after that
+    // they're ours again and can be unprepared.
+    midiInStop(state.midi_handle);
+    midiInReset(state.midi_handle);
+
+    for (uint32_t i = 0; i < SYSEX_BUFFERS_LEN; ++i) {
+        midiInUnprepareHeader(state.midi_handle, &state.sysex.headers[i], sizeof(MIDIHDR));
+    }
+    
+    state.sysex.returned.store(0);
+    midiInClose(state.midi_handle);
+}
+
+internal void recycle_sysex_buffers()
+{
+    uint32_t returned = state.sysex.returned.exchange(0, std::memory_order_acquire);
+    
+    for (uint32_t i = 0; i < SYSEX_BUFFERS_LEN; ++i) {
+        if ((returned & (1u << i)) == 0) continue;
+        
+        MIDIHDR *header = &state.sysex.headers[i];
+        header->dwBytesRecorded = 0;
+        midiInAddBuffer(state.midi_handle, header, sizeof(*header));
     }
 }
 
 internal void check_midi_controller()
 {
+    PROFILE_ZONE(PROFILE_ZONE_MIDI_CONTROLLER);
+    
     // @ToDo: We're selecting the first connected device, we should
     // give the user an option to select which device they want to
     // select/map.
@@ -313,61 +3044,313 @@ internal void check_midi_controller()
     MMRESULT device_result = midiInGetDevCaps(0, &midi_info, sizeof(MIDIINCAPS));
     
     if (device_result == MMSYSERR_NOERROR && !state.device_connected) {
-        device_result = midiInOpen(&state.midi_handle, 0, (DWORD_PTR) midi_callback, 0, CALLBACK_FUNCTION);
-        
-        if (device_result == MMSYSERR_NOERROR) {
-            state.device_connected = true;
-            midiInStart(state.midi_handle);
-        }
-    } else if (device_result != MMSYSERR_NOERROR) {
+        open_midi_device();
+    } else if (device_result == MMSYSERR_NOERROR) {
+        recycle_sysex_buffers();
+    } else {
         state.device_connected = false;
 
         for (size_t i = 0; i < MIDI_FULL_LEN; ++i) {
             state.highlighted_notes[i] = 0;
         }
         
-        midiInStop(state.midi_handle);
-        midiInClose(state.midi_handle);
+        close_midi_device();
     }
 }
 
+internal bool is_modifier_key(int vk)
+{
+    return(vk == VK_SHIFT || vk == VK_CONTROL || vk == VK_MENU || (vk >= VK_LSHIFT && vk <= VK_RMENU));
+}
+
+// @Note: Maps into whichever velocity layer is being edited. Modifiers held
+// together with a key become part of the mapping (e.g. Shift+Q), a modifier
+// pressed and released on its own gets mapped as a plain key.
 internal void check_key_assignment()
 {
-    if (IsKeyPressed(KEY_ESCAPE) && state.active_key != -1) {
-        if (state.configs[state.config_id].keys_map[state.active_key] != 0) {
-            state.log_message = "Key unmapped";
-            state.configs[state.config_id].keys_map[state.active_key] = 0;
+    PROFILE_ZONE(PROFILE_ZONE_KEY_ASSIGNMENT);
+
+    // @Note: Either a piano key or a control mapping can be waiting for a key, never both.
+    int *target = 0;
+    if (state.active_key != -1) {
+        target = &config_layer_keys(&state.configs[state.config_id], state.edit_layer)[state.active_key];
+    } else if (state.active_control != -1) {
+        target = &state.configs[state.config_id].controls[state.active_control].param;
+    }
+    
+    if (IsKeyPressed(KEY_ESCAPE) && target) {
+        if (*target != 0) {
+            log_print("Key unmapped");
+            *target = 0;
+            rebuild_mapping_table(state.config_id);
         } else {
-            state.log_message = "Mapping stopped";
+            log_print("Mapping stopped");
         }
+
+        ui_invalidate(UI_LAYER_BIT(UI_LAYER_CONTROL_PANEL));
         
         state.active_key = -1;
-    } else if (state.active_key != -1) {
+        state.active_control = -1;
+        state.active_modifier = 0;
+    } else if (target) {
         int key_code = -1;
+        int held_modifier = 0;
+        int modifiers = 0;
+
+        if (GetAsyncKeyState(VK_SHIFT) & 0x8000) { modifiers |= KEY_MOD_SHIFT; held_modifier = VK_SHIFT; }
+        if (GetAsyncKeyState(VK_CONTROL) & 0x8000) { modifiers |= KEY_MOD_CTRL; held_modifier = VK_CONTROL; }
+        if (GetAsyncKeyState(VK_MENU) & 0x8000) { modifiers |= KEY_MOD_ALT; held_modifier = VK_MENU; }
 
         // @Note: We're starting from 0x08 because previous values
         // map to mouse input.
         for (int i = 8; i < 256; ++i) {
             if (i == VK_ESCAPE) continue; // @Note: Lazy fix for ESC spamming
+            if (is_modifier_key(i)) continue;
             
             if (GetAsyncKeyState(i) & 0x8000) {
-                key_code = i;
+                key_code = KEY_COMBO(i, modifiers);
                 break;
             }
         }
 
+        if (key_code == -1 && held_modifier == 0 && state.active_modifier != 0) {
+            key_code = state.active_modifier;
+        }
+        
         if (key_code != -1) {
-            state.configs[state.config_id].keys_map[state.active_key] = key_code;
+            *target = key_code;
+            rebuild_mapping_table(state.config_id);
+            
             state.active_key = -1;
-            state.log_message = "Key mapped";
+            state.active_control = -1;
+            state.active_modifier = 0;
+            log_print("Key mapped");
+        } else if (held_modifier != 0) {
+            state.active_modifier = held_modifier;
+        }
+    }
+}
+
+// @Note: Pulls whatever was logged since last frame into the history.
+internal void check_log_history()
+{
+    Log_History *history = &state.history;
+    Log_Record record = {0};
+
+    while (log_read(&state.log, &history->reader, &record)) {
+        history->records[history->count % LOG_HISTORY_LEN] = record;
+        history->count += 1;
+
+        // @Note: Scrolled back, the lines being looked at stay where they are.
+        if (history->scroll > 0) history->scroll += 1;
+    }
+
+    if (IsKeyPressed(KEY_F2)) {
+        history->visible = !history->visible;
+        history->scroll = 0;
+    }
+}
+
+internal const char *log_history_latest()
+{
+    const Log_History *history = &state.history;
+    if (history->count == 0) return("");
+
+    return(history->records[(history->count - 1) % LOG_HISTORY_LEN].text);
+}
+
+// @Note: One line per song: name, length, tempo, range, and the transpose that fits it best.
+internal void render_library(Rectangle rect)
+{
+    Library_Browser *browser = &state.browser;
+    const Library *library = &browser->library;
+    const float font_size = 18.0f;
+    const float line_height = font_size + 2.0f;
+
+    int lines = (int) ((rect.height - 50.0f)/line_height);
+    int max_scroll = (int) browser->matches_len - lines;
+
+    if (CheckCollisionPointRec(GetMousePosition(), rect)) {
+        browser->scroll -= (int) (GetMouseWheelMove()*3.0f);
+    }
+
+    if (browser->scroll > max_scroll) browser->scroll = max_scroll;
+    if (browser->scroll < 0) browser->scroll = 0;
+
+    DrawRectangleRec(rect, { 0, 0, 0, 200 });
+
+    char line[PLAYBACK_PATH_LEN + 64] = {0};
+    snprintf(line, sizeof(line), "Search: %s_", browser->search);
+    DrawTextEx(state.font, line, { rect.x + 10, rect.y + 8 }, font_size + 4, 1.0f, WHITE);
+
+    if (browser->scan_state.load(std::memory_order_acquire) == LIBRARY_SCAN_RUNNING) {
+        snprintf(line, sizeof(line), "%zu of %zu songs, scanning (%zu read)  [F9: close]", browser->matches_len, library->count,
+                 browser->scan.done.load(std::memory_order_relaxed));
+    } else {
+        snprintf(line, sizeof(line), "%zu of %zu songs, click to add to the setlist  [F9: close]", browser->matches_len, library->count);
+    }
+
+    Vector2 size = MeasureTextEx(state.font, line, font_size, 1.0f);
+    DrawTextEx(state.font, line, { rect.x + rect.width - size.x - 10, rect.y + 10 }, font_size, 1.0f, GRAY);
+
+    const float columns[5] = { 0.0f, 0.55f, 0.64f, 0.74f, 0.87f };
+    float width = rect.width - 20.0f;
+    Vector2 position = { rect.x + 10, rect.y + 40 };
+
+    for (int i = 0; i < lines && (size_t) (browser->scroll + i) < browser->matches_len; ++i) {
+        const Library_Record *record = &library->records[browser->matches[browser->scroll + i]];
+        const char *name = library_path(library, record);
+        for (const char *at = name; *at; ++at) {
+            if (*at == '\\' || *at == '/') name = at + 1;
+        }
+
+        Rectangle row = { rect.x, position.y, rect.width, line_height };
+        bool hovered = CheckCollisionPointRec(GetMousePosition(), row);
+        if (hovered) DrawRectangleRec(row, { 255, 255, 255, 30 });
+        if (hovered && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) add_to_setlist(library_path(library, record), record->transpose);
+
+        DrawTextEx(state.font, name, { position.x + columns[0]*width, position.y }, font_size, 1.0f,
+                   record->flags & LIBRARY_BROKEN ? GRAY : WHITE);
+
+        if (record->pitched > 0) {
+            int seconds = (int) (record->duration_ns/1000000000ull);
+            snprintf(line, sizeof(line), "%d:%02d", seconds/60, seconds % 60);
+            DrawTextEx(state.font, line, { position.x + columns[1]*width, position.y }, font_size, 1.0f, LIGHTGRAY);
+
+            snprintf(line, sizeof(line), "%.0f bpm%s", 60000000.0/record->tempo, record->tempo_changes > 1 ? "~" : "");
+            DrawTextEx(state.font, line, { position.x + columns[2]*width, position.y }, font_size, 1.0f, LIGHTGRAY);
+
+            snprintf(line, sizeof(line), "%s%d-%s%d", config_text_notes[record->low % 12], record->low/12 - 1,
+                     config_text_notes[record->high % 12], record->high/12 - 1);
+            DrawTextEx(state.font, line, { position.x + columns[3]*width, position.y }, font_size, 1.0f, LIGHTGRAY);
+
+            snprintf(line, sizeof(line), "%+d  %3.0f%%", record->transpose, 100.0*record->fit/record->pitched);
+            DrawTextEx(state.font, line, { position.x + columns[4]*width, position.y }, font_size, 1.0f,
+                       record->fit == record->pitched ? GREEN : ORANGE);
+        }
+
+        position.y += line_height;
+    }
+}
+
+internal void render_log_history(Rectangle rect)
+{
+    Log_History *history = &state.history;
+    const float font_size = 18.0f;
+    const float line_height = font_size + 2.0f;
+    
+    size_t available = history->count < LOG_HISTORY_LEN ? history->count : LOG_HISTORY_LEN;
+    int lines = (int) ((rect.height - 20.0f)/line_height);
+    int max_scroll = (int) available - lines;
+    
+    if (CheckCollisionPointRec(GetMousePosition(), rect)) {
+        history->scroll += (int) (GetMouseWheelMove()*3.0f);
+    }
+    
+    if (history->scroll > max_scroll) history->scroll = max_scroll;
+    if (history->scroll < 0) history->scroll = 0;
+
+    DrawRectangleRec(rect, { 0, 0, 0, 200 });
+    
+    // @Note: Newest at the bottom, like a console.
+    Vector2 position = { rect.x + 10, rect.y + rect.height - 10 - line_height };
+    char line[LOG_TEXT_LEN + 32] = {0};
+    
+    for (int i = 0; i < lines && (size_t) (history->scroll + i) < available; ++i) {
+        const Log_Record *record = &history->records[(history->count - 1 - history->scroll - i) % LOG_HISTORY_LEN];
+        double seconds = (int64_t) (record->time_ns - state.start_ns)/1e9;
+        
+        snprintf(line, sizeof(line), "[%9.3f] %s", seconds, record->text);
+        DrawTextEx(state.font, line, position, font_size, 1.0f, i == 0 && history->scroll == 0 ? WHITE : LIGHTGRAY);
+        position.y -= line_height;
+    }
+
+    if (history->reader.missed > 0) {
+        snprintf(line, sizeof(line), "%llu lost  [F2: close]", (unsigned long long) history->reader.missed);
+    } else {
+        snprintf(line, sizeof(line), "[F2: close]");
+    }
+    
+    Vector2 size = MeasureTextEx(state.font, line, font_size, 1.0f);
+    DrawTextEx(state.font, line, { rect.x + rect.width - size.x - 10, rect.y + 6 }, font_size, 1.0f, GRAY);
+}
+
+// @Note: The overlay itself is drawn outside of any zone, so it doesn't
+// show up in its own numbers (it ends up in 'other').
+internal void render_profiler_overlay()
+{
+    const Color zone_colors[PROFILE_ZONE_COUNT] = { SKYBLUE, PURPLE, ORANGE, GOLD, LIME, PINK };
+    const float font_size = 20.0f;
+    const float graph_height = 100.0f;
+    const float graph_budget_ms = 1000.0f / FPS;
+    
+    Rectangle panel = {0};
+    panel.x = 10;
+    panel.y = 50;
+    panel.width = PROFILER_FRAMES_LEN*2.0f + 20.0f;
+    panel.height = 30.0f + (PROFILE_ZONE_COUNT + 2)*font_size + graph_height + 20.0f;
+    DrawRectangleRec(panel, { 0, 0, 0, 200 });
+
+    Vector2 position = { panel.x + 10, panel.y + 10 };
+    char line[128] = {0};
+    
+    double frame_ms = profiler_average_ms(-1, FPS);
+    snprintf(line, sizeof(line), "frame %6.2f ms (%5.1f FPS)  [F4: save trace]", frame_ms, frame_ms > 0.0 ? 1000.0/frame_ms : 0.0);
+    DrawTextEx(state.font, line, position, font_size, 1.0f, WHITE);
+    position.y += font_size + 4;
+
+    double zones_ms = 0.0;
+    for (int i = 0; i < PROFILE_ZONE_COUNT; ++i) {
+        double zone_ms = profiler_average_ms(i, FPS);
+        if (i != PROFILE_ZONE_TEXT) zones_ms += zone_ms;
+        
+        snprintf(line, sizeof(line), "%-22s %6.3f ms", profile_zone_names[i], zone_ms);
+        DrawTextEx(state.font, line, position, font_size, 1.0f, zone_colors[i]);
+        position.y += font_size;
+    }
+
+    // @Note: Text is drawn from inside the render zones, so it isn't subtracted twice.
+    snprintf(line, sizeof(line), "%-22s %6.3f ms", "other (incl. vsync)", frame_ms - zones_ms);
+    DrawTextEx(state.font, line, position, font_size, 1.0f, GRAY);
+    position.y += font_size + 10;
+
+    // @Note: Rolling graph, newest frame on the right, one stacked bar per frame.
+    Rectangle graph = { position.x, position.y, PROFILER_FRAMES_LEN*2.0f, graph_height };
+    DrawRectangleRec(graph, { 30, 30, 30, 255 });
+
+    float budget_y = graph.y + graph.height - graph.height*0.5f;
+    DrawLine((int) graph.x, (int) budget_y, (int) (graph.x + graph.width), (int) budget_y, DARKGRAY);
+    
+    float ms_to_px = graph.height*0.5f / graph_budget_ms;
+    for (size_t age = 0; age < profiler.frames_recorded; ++age) {
+        const Profile_Frame *frame = profiler_get_frame(age);
+        float x = graph.x + graph.width - (float) (age + 1)*2.0f;
+        float y = graph.y + graph.height;
+
+        float frame_px = Clamp((float) (frame->duration_ns/1e6)*ms_to_px, 0.0f, graph.height);
+        DrawRectangleV({ x, y - frame_px }, { 2.0f, frame_px }, { 80, 80, 80, 255 });
+
+        for (int i = 0; i < PROFILE_ZONE_COUNT; ++i) {
+            if (i == PROFILE_ZONE_TEXT) continue;
+            
+            float zone_px = (float) (frame->zone_ns[i]/1e6)*ms_to_px;
+            zone_px = Clamp(zone_px, 0.0f, y - graph.y);
+            y -= zone_px;
+            DrawRectangleV({ x, y }, { 2.0f, zone_px }, zone_colors[i]);
         }
     }
 }
 
 int main(int argc, char **argv)
 {
-    UNUSED(argc);
-    UNUSED(argv);
+    bool trace = false;
+    const char *play = 0;
+    const char *library_dir = LIBRARY_DIR;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--trace") == 0) trace = true;
+        else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc) play = argv[++i];
+        else if (strcmp(argv[i], "--library") == 0 && i + 1 < argc) library_dir = argv[++i];
+    }
 
     SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_MSAA_4X_HINT);
     
@@ -377,28 +3360,26 @@ int main(int argc, char **argv)
     
     SetTargetFPS(FPS);
     
-    if (FileExists(DEFAULT_CONFIG_FILE)) {
-        int file_size = 0;
-        unsigned char *config_data = LoadFileData(DEFAULT_CONFIG_FILE, &file_size);
-
-        if (config_data == 0 || file_size < sizeof(state.configs)) {
-            load_default_configs();
-        } else {
-            for (size_t i = 0; i < CONFIG_LEN; ++i) {
-                state.configs[i] = ((Config *) config_data)[i];
-            }
-
-            UnloadFileData(config_data);
-        }
-    } else {
-        load_default_configs();
-    }
+    state.start_ns = get_time_ns();
+    start_log_file();
+    
+    state.tables.store(state.table_buffers[0]);
+    note_roll_init(&state.note_roll, get_time_ns());
+    load_configs(DEFAULT_CONFIG_FILE);
+    start_config_journal();
+    start_injection_thread();
+    start_config_watcher();
+    if (trace) start_trace();
+    if (play) start_playback(play);
+    load_library(library_dir);
     
     state.font = LoadFontFromMemory(".otf", g_font, g_font_size, 128, 0, 0);
     SetTextureFilter(state.font.texture, TEXTURE_FILTER_BILINEAR);
-    state.log_message = "Select a piano key to begin mapping";
+    log_print("Select a piano key to begin mapping");
     
     while (!WindowShouldClose()) {
+        profiler_begin_frame();
+        
         const int key_width = (int) (GetScreenWidth() * 0.032f);
         const int key_padding = 5;
         
@@ -420,28 +3401,138 @@ int main(int argc, char **argv)
 
         check_key_assignment();
         check_midi_controller();
+        check_control_learn();
+        check_config_reload();
+        check_log_history();
+        check_playback();
+        check_setlist();
+        check_library();
+
+        if (IsKeyPressed(KEY_F5)) {
+            if (export_profiles_text(PROFILES_TEXT_FILE)) log_print("Exported %s", PROFILES_TEXT_FILE);
+            else log_print("Could not export profiles");
+        }
+        if (IsKeyPressed(KEY_F6)) import_profiles_text(PROFILES_TEXT_FILE);
+        
+        if (IsKeyPressed(KEY_F7)) {
+            if (state.trace.running) stop_trace();
+            else start_trace();
+        }
+
+        if (IsKeyPressed(KEY_F3)) profiler.visible = !profiler.visible;
+        if (profiler.visible && IsKeyPressed(KEY_F4)) {
+            if (profiler_export_chrome_trace(PROFILER_TRACE_FILE)) {
+                log_print("Saved profiler trace");
+            } else {
+                log_print("Could not save profiler trace");
+            }
+        }
+
+        ui_check_invalidation();
 
         BeginDrawing();
         ClearBackground({ 20, 20, 20, 255 });
         
         render_keyboard(keyboard_rect, key_width, key_padding);
-        render_control_panel(control_panel_rect, 20);
+        render_note_roll({ 0, 0, keyboard_rect.width, keyboard_rect.y });
 
-        draw_text_centered(state.log_message, (int) text_center.x, (int) text_center.y, 42, WHITE);
+        if (ui_layer_begin(UI_LAYER_CONTROL_PANEL, control_panel_rect, { 25, 25, 25, 255 })) {
+            render_control_panel(control_panel_rect, 20);
+            ui_layer_end(UI_LAYER_CONTROL_PANEL);
+        }
+        ui_layer_draw(UI_LAYER_CONTROL_PANEL);
 
-        if (state.device_connected) {
-            DrawTextEx(state.font, "MIDI device connected", { 10, 10 }, 32, 1.0f, GREEN);
+        if (state.browser.visible) {
+            render_library({ 10, 80, keyboard_rect.width - 20, keyboard_rect.y - 90 });
+        } else if (state.history.visible) {
+            render_log_history({ 10, 80, keyboard_rect.width - 20, keyboard_rect.y - 90 });
         } else {
-            DrawTextEx(state.font, "MIDI device not connected", { 10, 10 }, 32, 1.0f, RED);
+            draw_text_centered(log_history_latest(), (int) text_center.x, (int) text_center.y, 42, WHITE);
+        }
+
+        {
+            PROFILE_ZONE(PROFILE_ZONE_TEXT);
+            
+            if (state.device_connected) {
+                DrawTextEx(state.font, "MIDI device connected", { 10, 10 }, 32, 1.0f, GREEN);
+            } else {
+                DrawTextEx(state.font, "MIDI device not connected", { 10, 10 }, 32, 1.0f, RED);
+            }
+
+            if (state.trace.running) {
+                const char *text = "Tracing (F7 to stop)";
+                Vector2 size = MeasureTextEx(state.font, text, 24, 1.0f);
+                DrawTextEx(state.font, text, { keyboard_rect.width - size.x - 10, 10 }, 24, 1.0f, RED);
+            }
+
+            int playback_state = state.playback.state.load(std::memory_order_acquire);
+            if (playback_state == PLAYBACK_STARTING || playback_state == PLAYBACK_PLAYING) {
+                char text[64] = {0};
+                int64_t elapsed_ms = playback_position_ns(get_time_ns())/1000000;
+                int total_s = (int) (state.playback.duration_ns/1000000000ull);
+                
+                if (elapsed_ms < 0) {
+                    snprintf(text, sizeof(text), "Playing in %d (F8 to stop)", (int) (-elapsed_ms/1000) + 1);
+                } else {
+                    int elapsed_s = (int) (elapsed_ms/1000);
+                    snprintf(text, sizeof(text), "Playing %d:%02d / %d:%02d (F8 to stop)", elapsed_s/60, elapsed_s % 60, total_s/60, total_s % 60);
+
+                    if (state.playback.loop_end_ns > 0) {
+                        int from_s = (int) (state.playback.loop_start_ns/1000000000ull);
+                        int to_s = (int) (state.playback.loop_end_ns/1000000000ull);
+                        snprintf(text, sizeof(text), "Looping %d:%02d in %d:%02d-%d:%02d (F8 to stop)", elapsed_s/60, elapsed_s % 60,
+                                 from_s/60, from_s % 60, to_s/60, to_s % 60);
+                    }
+                }
+                
+                Vector2 size = MeasureTextEx(state.font, text, 24, 1.0f);
+                DrawTextEx(state.font, text, { keyboard_rect.width - size.x - 10, 40 }, 24, 1.0f, SKYBLUE);
+            }
+
+            const Setlist *setlist = &state.setlist;
+            int setlist_state = setlist->state.load(std::memory_order_acquire);
+            size_t waiting = setlist->count - setlist->next;
+            if (setlist_state == SETLIST_COMPILING || setlist_state == SETLIST_READY) waiting += 1;
+
+            if (waiting > 0) {
+                char text[64] = {0};
+                snprintf(text, sizeof(text), "Setlist: %zu more%s", waiting, setlist_state == SETLIST_COMPILING ? ", compiling the next one" : "");
+                Vector2 size = MeasureTextEx(state.font, text, 20, 1.0f);
+                DrawTextEx(state.font, text, { keyboard_rect.width - size.x - 10, 68 }, 20, 1.0f, SKYBLUE);
+            }
+
+            int octave_shift = state.pipeline.octave_shift;
+            if (octave_shift != 0) {
+                char text[32] = {0};
+                snprintf(text, sizeof(text), "Octave %+d", octave_shift);
+                DrawTextEx(state.font, text, { 10, 46 }, 24, 1.0f, ORANGE);
+            }
         }
 
+        if (profiler.visible) render_profiler_overlay();
+
         EndDrawing();
+        journal_config_edits();
+        profiler_end_frame();
     }
 
-    SaveFileData(DEFAULT_CONFIG_FILE, state.configs, sizeof(state.configs));
+    // @Note: The journal does a last compaction on its way out.
+    journal_config_edits();
+    stop_config_watcher();
+    stop_config_journal();
     
-    midiInStop(state.midi_handle);
-    midiInClose(state.midi_handle);
+    if (state.device_connected) close_midi_device();
+    stop_injection_thread();
+    unmap_playback();
+    finish_setlist_compile();
+    free_setlist_song();
+    finish_library_scan();
+    stop_trace();
+    stop_log_file();
+    
+    keyboard_batch_unload(&state.keyboard);
+    ui_unload_layers();
+    note_roll_renderer_unload(&state.roll_renderer);
     UnloadFont(state.font);
     CloseWindow();
     
@@ -0,0 +1,66 @@
+#ifndef MIDI_H
+#define MIDI_H
+
+// @Note: Everything here is on the MIDI callback's hot path, it shouldn't
+// touch the OS or raylib so it can be benchmarked on its own (see bench.cpp).
+
+#define NOTE_OFF 0x80
+#define NOTE_ON 0x90
+#define CONTROL_CHANGE 0xB0
+#define PROGRAM_CHANGE 0xC0
+#define PITCH_BEND 0xE0
+#define NOTE_OFFSET 48
+
+#define SUSTAIN_CC 64
+
+#define WHITE_KEYS_LEN 22
+#define BLACK_KEYS_LEN 15
+#define MIDI_FULL_LEN (WHITE_KEYS_LEN + BLACK_KEYS_LEN)
+
+// @Note: Short messages come packed into a single DWORD in MIM_DATA,
+// status byte first, then up to two data bytes. 'note' and 'velocity' are
+// just the two data bytes, for CC that's the controller and its value, for
+// program change the program, for pitch bend the low and high 7 bits.
+//
+// Channel messages are decoded without their channel, we listen on all of them.
+struct Midi_Message {
+    uint8_t status;
+    uint8_t channel;
+    uint8_t note;
+    uint8_t velocity;
+};
+
+internal inline Midi_Message midi_decode(uint32_t packed)
+{
+    Midi_Message message = {0};
+    uint8_t status = (uint8_t) (packed & 0xFF);
+    
+    if (status < 0xF0) {
+        message.status = (uint8_t) (status & 0xF0);
+        message.channel = (uint8_t) (status & 0x0F);
+    } else {
+        message.status = status;
+    }
+    
+    message.note = (uint8_t) ((packed >> 8) & 0xFF);
+    message.velocity = (uint8_t) ((packed >> 16) & 0xFF);
+
+    // @Note: Lots of controllers send NOTE_ON with zero velocity instead of
+    // NOTE_OFF, as far as the spec is concerned they're the same thing.
+    if (message.status == NOTE_ON && message.velocity == 0) {
+        message.status = NOTE_OFF;
+    }
+
+    return(message);
+}
+
+// @Note: Returns -1 when the note doesn't land on the visible keyboard.
+internal inline int midi_note_to_index(int note, int offset)
+{
+    int index = note - offset;
+    if (index < 0 || index >= MIDI_FULL_LEN) return(-1);
+
+    return(index);
+}
+
+#endif // MIDI_H
@@ -0,0 +1,174 @@
+#ifndef NOTE_ROLL_H
+#define NOTE_ROLL_H
+
+// @Note: Data behind the piano roll drawn above the keyboard. Every note
+// is a span on one lane (a key of the visible keyboard), the last
+// NOTE_ROLL_LEN of them live in a ring that's laid out exactly like the GPU
+// instance buffer, so the UI only ever uploads the slots that changed and
+// draws all of them at once (see 'render_note_roll()' in main.cpp).
+//
+// Live notes come from the pipeline on the injection thread through a small
+// single-producer/single-consumer event queue, spans that haven't been
+// played yet (playback lookahead) are added on the UI thread directly.
+// Times are seconds since 'epoch_ns', floats are plenty for what's on screen.
+
+#define NOTE_ROLL_LEN 4096
+#define NOTE_ROLL_EVENTS_LEN 1024 // @Note: Must be a power of two.
+
+// @Note: One GPU instance, keep it four floats.
+struct Note_Span {
+    float start;
+    float end; // @Note: Negative while the note is still sounding.
+    float lane;
+    float velocity;
+};
+
+struct Note_Roll_Event {
+    uint64_t time_ns;
+    int8_t lane;
+    uint8_t velocity; // @Note: 0 is a note off.
+};
+
+// @Note: Producer is the pipeline (injection thread), consumer is the UI thread.
+struct Note_Roll_Events {
+    Note_Roll_Event events[NOTE_ROLL_EVENTS_LEN];
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<uint32_t> dropped;
+};
+
+struct Note_Roll {
+    Note_Span spans[NOTE_ROLL_LEN];
+    size_t count; // @Note: Total spans ever added, the next one goes into 'count % NOTE_ROLL_LEN'.
+    int open[MIDI_FULL_LEN]; // @Note: Slot of the span still sounding on each lane, -1 if none.
+    uint64_t epoch_ns;
+
+    // @Note: Slots written since the last upload, [first, last], empty when first > last.
+    int dirty_first;
+    int dirty_last;
+};
+
+internal inline void note_roll_init(Note_Roll *roll, uint64_t now_ns)
+{
+    memset(roll->spans, 0, sizeof(roll->spans));
+    roll->count = 0;
+    roll->epoch_ns = now_ns;
+
+    for (int i = 0; i < MIDI_FULL_LEN; ++i) roll->open[i] = -1;
+
+    roll->dirty_first = 0;
+    roll->dirty_last = NOTE_ROLL_LEN - 1;
+}
+
+internal inline bool note_roll_events_push(Note_Roll_Events *queue, uint64_t time_ns, int lane, int velocity)
+{
+    size_t head = queue->head.load(std::memory_order_relaxed);
+    size_t tail = queue->tail.load(std::memory_order_acquire);
+
+    if (head - tail >= NOTE_ROLL_EVENTS_LEN) {
+        queue->dropped.store(queue->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return(false);
+    }
+
+    Note_Roll_Event *event = &queue->events[head & (NOTE_ROLL_EVENTS_LEN - 1)];
+    event->time_ns = time_ns;
+    event->lane = (int8_t) lane;
+    event->velocity = (uint8_t) velocity;
+    queue->head.store(head + 1, std::memory_order_release);
+
+    return(true);
+}
+
+internal inline bool note_roll_events_pop(Note_Roll_Events *queue, Note_Roll_Event *event)
+{
+    size_t tail = queue->tail.load(std::memory_order_relaxed);
+    size_t head = queue->head.load(std::memory_order_acquire);
+    if (head == tail) return(false);
+
+    *event = queue->events[tail & (NOTE_ROLL_EVENTS_LEN - 1)];
+    queue->tail.store(tail + 1, std::memory_order_release);
+
+    return(true);
+}
+
+internal inline float note_roll_seconds(const Note_Roll *roll, uint64_t time_ns)
+{
+    return((float) ((int64_t) (time_ns - roll->epoch_ns)/1e9));
+}
+
+internal inline void note_roll_touch(Note_Roll *roll, int slot)
+{
+    if (slot < roll->dirty_first) roll->dirty_first = slot;
+    if (slot > roll->dirty_last) roll->dirty_last = slot;
+}
+
+internal inline int note_roll_add(Note_Roll *roll, int lane, float start, float end, int velocity)
+{
+    int slot = (int) (roll->count % NOTE_ROLL_LEN);
+    roll->count += 1;
+
+    // @Note: Whatever was still sounding in the slot we're taking is just forgotten.
+    Note_Span *span = &roll->spans[slot];
+    int old_lane = (int) span->lane;
+    if (roll->open[old_lane] == slot) roll->open[old_lane] = -1;
+
+    span->start = start;
+    span->end = end;
+    span->lane = (float) lane;
+    span->velocity = (float) velocity;
+    note_roll_touch(roll, slot);
+
+    return(slot);
+}
+
+internal inline void note_roll_close(Note_Roll *roll, int lane, float end)
+{
+    int slot = roll->open[lane];
+    if (slot == -1) return;
+
+    roll->spans[slot].end = end;
+    roll->open[lane] = -1;
+    note_roll_touch(roll, slot);
+}
+
+// @Note: For notes that haven't been played yet, the UI thread only.
+internal inline void note_roll_add_span(Note_Roll *roll, int lane, uint64_t start_ns, uint64_t end_ns, int velocity)
+{
+    if (lane < 0 || lane >= MIDI_FULL_LEN) return;
+    note_roll_add(roll, lane, note_roll_seconds(roll, start_ns), note_roll_seconds(roll, end_ns), velocity);
+}
+
+// @Note: Drops every span that starts after 'time_ns', the UI thread only.
+// For when playback jumps and what was coming up isn't anymore.
+internal inline void note_roll_cut(Note_Roll *roll, uint64_t time_ns)
+{
+    float time = note_roll_seconds(roll, time_ns);
+
+    for (int slot = 0; slot < NOTE_ROLL_LEN; ++slot) {
+        Note_Span *span = &roll->spans[slot];
+        if (span->start <= time) continue;
+
+        span->start = 0.0f;
+        span->end = 0.0f;
+        note_roll_touch(roll, slot);
+    }
+}
+
+// @Note: Turns everything the pipeline played since the last call into spans.
+internal inline void note_roll_drain(Note_Roll *roll, Note_Roll_Events *queue)
+{
+    Note_Roll_Event event = {0};
+
+    while (note_roll_events_pop(queue, &event)) {
+        if (event.lane < 0 || event.lane >= MIDI_FULL_LEN) continue;
+
+        float time = note_roll_seconds(roll, event.time_ns);
+        note_roll_close(roll, event.lane, time);
+
+        if (event.velocity > 0) {
+            roll->open[event.lane] = note_roll_add(roll, event.lane, time, -1.0f, event.velocity);
+        }
+    }
+}
+
+#endif // NOTE_ROLL_H
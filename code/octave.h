@@ -0,0 +1,133 @@
+#ifndef OCTAVE_H
+#define OCTAVE_H
+
+// @Note: Picks which octave every note of a song is played in, for songs
+// that don't fit the keyboard. Folding each note on its own keeps them all
+// playable, but it flips octaves back and forth around the edges and happily
+// parks a whole melody on a Shift/Ctrl octave. Modifiers are pressed and
+// released around every single key (see 'pipeline_schedule_tap()'), so each
+// one a note needs is two more key events the game has to catch. This looks
+// at the whole song instead: a Viterbi pass over the notes in order, where a
+// note's state is how many octaves it's moved, and the cheapest path through
+// all of them wins. Costs per note:
+//
+//     OCTAVE_COST_SHIFT     per octave away from where it was written
+//     OCTAVE_COST_JUMP      per octave its shift differs from the previous
+//                           note's, so a phrase moves as a whole
+//     OCTAVE_COST_MODIFIER  per modifier its key needs
+//
+// Only shifts that land on a mapped key are states, so everything that can be
+// played is. A note that can't be played in any octave keeps shift 0 and is
+// skipped, the notes around it are compared with each other.
+//
+// O(notes*OCTAVE_SHIFTS_LEN^2) time and one byte per note and shift for the
+// back pointers, a few ms for a long song.
+
+#define OCTAVE_SHIFT_RANGE 4 // @Note: -4..4 octaves gets any MIDI note onto a 3 octave keyboard.
+#define OCTAVE_SHIFTS_LEN (2*OCTAVE_SHIFT_RANGE + 1)
+#define OCTAVE_NO_STATE 0xFF
+
+#define OCTAVE_COST_SHIFT 2
+#define OCTAVE_COST_JUMP 4
+#define OCTAVE_COST_MODIFIER 3
+
+struct Octave_Note {
+    uint8_t note;
+    uint8_t velocity;
+};
+
+// @Note: The key 'note' plays moved by 'shift' octaves, 0 if that's off the keyboard or unmapped.
+internal inline int octave_key(const Mapping_Table *table, const Octave_Note *note, int shift)
+{
+    int index = midi_note_to_index(note->note + shift*12, NOTE_OFFSET);
+    if (index == -1) return(0);
+
+    return(mapping_lookup_key(table, index, note->velocity));
+}
+
+internal inline uint32_t octave_modifier_count(int key)
+{
+    int modifiers = KEY_MODS(key);
+    return((uint32_t) ((modifiers & 1) + ((modifiers >> 1) & 1) + ((modifiers >> 2) & 1)));
+}
+
+// @Note: Fills 'shifts' (octaves, one per note), false if there wasn't memory for the back pointers.
+internal inline bool octave_assign(const Octave_Note *notes, size_t count, const Mapping_Table *table, int8_t *shifts)
+{
+    uint8_t *from = (uint8_t *) malloc(count*OCTAVE_SHIFTS_LEN + 1);
+    if (from == 0) return(false);
+
+    uint32_t costs[OCTAVE_SHIFTS_LEN] = {0};
+    int keys[OCTAVE_SHIFTS_LEN] = {0}; // @Note: Previous playable note's key per state, 0 if it isn't one.
+    bool started = false;
+    size_t last = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t *row = &from[i*OCTAVE_SHIFTS_LEN];
+        uint32_t next_costs[OCTAVE_SHIFTS_LEN] = {0};
+        int next_keys[OCTAVE_SHIFTS_LEN] = {0};
+        bool playable = false;
+
+        for (int s = 0; s < OCTAVE_SHIFTS_LEN; ++s) {
+            int shift = s - OCTAVE_SHIFT_RANGE;
+            int key = octave_key(table, &notes[i], shift);
+            row[s] = OCTAVE_NO_STATE;
+            if (key == 0) continue;
+
+            uint32_t own = (uint32_t) (shift < 0 ? -shift : shift)*OCTAVE_COST_SHIFT + octave_modifier_count(key)*OCTAVE_COST_MODIFIER;
+            uint32_t best = UINT32_MAX;
+            uint8_t best_from = 0;
+
+            if (!started) {
+                best = 0;
+            } else {
+                for (int p = 0; p < OCTAVE_SHIFTS_LEN; ++p) {
+                    if (keys[p] == 0) continue;
+
+                    uint32_t jump = (uint32_t) (p > s ? p - s : s - p)*OCTAVE_COST_JUMP;
+                    uint32_t cost = costs[p] + jump;
+
+                    if (cost < best) {
+                        best = cost;
+                        best_from = (uint8_t) p;
+                    }
+                }
+            }
+
+            next_costs[s] = best + own;
+            next_keys[s] = key;
+            row[s] = best_from;
+            playable = true;
+        }
+
+        shifts[i] = 0;
+        if (!playable) continue;
+
+        memcpy(costs, next_costs, sizeof(costs));
+        memcpy(keys, next_keys, sizeof(keys));
+        started = true;
+        last = i;
+    }
+
+    if (started) {
+        int state = -1;
+        for (int s = 0; s < OCTAVE_SHIFTS_LEN; ++s) {
+            if (keys[s] != 0 && (state == -1 || costs[s] < costs[state])) state = s;
+        }
+
+        // @Note: Every playable note's row points at the state of the playable
+        // note before it, the rows of the ones that aren't are all OCTAVE_NO_STATE.
+        for (size_t i = last + 1; i-- > 0;) {
+            const uint8_t *row = &from[i*OCTAVE_SHIFTS_LEN];
+            if (row[state] == OCTAVE_NO_STATE) continue;
+
+            shifts[i] = (int8_t) (state - OCTAVE_SHIFT_RANGE);
+            state = row[state];
+        }
+    }
+
+    free(from);
+    return(true);
+}
+
+#endif // OCTAVE_H
@@ -0,0 +1,503 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// @Note: Everything between "a MIDI event got popped off the queue" and
+// "a key event is due". It's driven by the injection thread but doesn't know
+// about it (or about SendInput), the caller pops due key events and sends them.
+//
+//     decode -> filter -> map (velocity LUT) -> strum -> schedule -> pace
+//
+// Every key event goes through the timer wheel, even when it's due right away.
+//
+// In KEY_MODE_TAP every NOTE_ON is a key press and release, NOTE_OFF does
+// nothing. In KEY_MODE_HOLD the key is held down for as long as the note is,
+// and the sustain pedal (CC64) keeps it down past the NOTE_OFF until the
+// pedal comes back up. CC, pitch bend and program change go through the
+// config's control mappings, see 'pipeline_control()'.
+
+#define OCTAVE_SHIFT_MAX 2
+
+enum Key_Mode {
+    KEY_MODE_TAP = 0,
+    KEY_MODE_HOLD,
+    KEY_MODE_COUNT,
+};
+
+global const char *const key_mode_names[KEY_MODE_COUNT] = { "Tap", "Hold" };
+
+#define HOLD_DOWN 0x1 // @Note: Key down is scheduled.
+#define HOLD_WAITING 0x2 // @Note: Held back by strumming, no key down yet.
+#define HOLD_RELEASED 0x4 // @Note: NOTE_OFF came while it was still waiting.
+#define HOLD_SUSTAINED 0x8 // @Note: NOTE_OFF came while the pedal was down.
+
+// @Note: Per MIDI note, what was pressed for it and where it's highlighted,
+// so the release matches the press even if the octave or profile changed in between.
+struct Note_Hold {
+    uint64_t down_ns;
+    uint16_t key;
+    int8_t index;
+    uint8_t flags;
+};
+
+// @Note: The game only samples input once per frame, two key events closer
+// than that collapse into one (or none). The pacer holds every outgoing key
+// event back until 'key_gap_ms' has passed since the previous one, so a
+// tap becomes down ... gap ... up and a fast run is stretched out instead of
+// lost. Notes coming in faster than that for long enough would back up
+// without end, so a key down that would go out more than 'key_delay_max_ms'
+// late is dropped, and the key up that goes with it after it. A key up whose
+// key down went out is never dropped, nothing gets stuck. Neither is the
+// rest of a combo once one of its modifiers went down.
+struct Pacer {
+    uint64_t next_free_ns;
+    uint16_t skipped[256]; // @Note: Per vk, key downs dropped whose key up hasn't come by yet.
+    bool in_combo; // @Note: A modifier went down, the key it's for hasn't yet.
+
+    // @Note: Stats for the UI, 'delay' is only what pacing added on top of
+    // when the event was due.
+    uint64_t paced_events;
+    uint64_t total_delay_ns;
+    uint64_t last_delay_ns;
+    uint64_t max_delay_ns;
+    uint64_t dropped; // @Note: Key downs, modifiers included.
+};
+
+// @Note: Only ever append to this, it's saved as is in config.dat.
+struct Pipeline_Settings {
+    Note_Filter_Settings filter;
+    Strum_Settings strum;
+    int key_gap_ms;
+    int key_mode;
+    int receive_drop; // @Note: MIDI_CLASS_BIT()s, applied by whoever owns the MIDI callback (see receive.h).
+    int key_delay_max_ms; // @Note: Most pacing may hold a key down back, see 'Pacer'.
+};
+
+struct Pipeline {
+    Note_Filter filter;
+    Strum strum;
+    Timer_Wheel wheel;
+    Pacer pacer;
+
+    Note_Hold holds[128];
+    bool sustain;
+    int octave_shift;
+    bool controls_on[CONTROLS_LEN];
+
+    // @Note: Last CC/pitch bend/program change seen, so the UI can "learn"
+    // a control mapping. 'controls_seen' goes up by one with each of them.
+    std::atomic<uint32_t> last_control;
+    std::atomic<uint32_t> controls_seen;
+
+    // @Note: Optional, the UI points these at its own state. Without
+    // 'config_id' only the first mapping table is ever used.
+    bool *highlighted_notes;
+    Log *log;
+    Note_Roll_Events *note_roll;
+
+    // @Note: What schedule records get tagged with, see trace.h.
+    Trace_Buffer *trace;
+    uint64_t trace_event_ns;
+    uint8_t trace_note;
+    std::atomic<size_t> *config_id;
+};
+
+internal inline Pipeline_Settings default_pipeline_settings()
+{
+    Pipeline_Settings settings = {0};
+    settings.filter.debounce_ms = 5;
+    settings.filter.retrigger_ms = 0;
+    settings.filter.retrigger_mode = RETRIGGER_DELAY;
+    settings.strum.window_ms = 0;
+    settings.strum.offset_ms = 20;
+    settings.strum.direction = STRUM_PLAYED;
+    settings.key_gap_ms = 0;
+    settings.key_mode = KEY_MODE_TAP;
+    settings.receive_drop = DEFAULT_RECEIVE_DROP;
+    settings.key_delay_max_ms = 250;
+
+    return(settings);
+}
+
+// @Note: Has to be called before anything else, 'now_ns' is where the wheel starts turning.
+internal inline void pipeline_init(Pipeline *pipeline, uint64_t now_ns)
+{
+    timer_wheel_init(&pipeline->wheel, now_ns);
+
+    for (size_t i = 0; i < ARR_SZ(pipeline->holds); ++i) {
+        pipeline->holds[i].index = -1;
+    }
+}
+
+internal inline int pipeline_trace_result(Filter_Action action)
+{
+    if (action == FILTER_DROP) return(TRACE_FILTERED);
+    if (action == FILTER_DELAY) return(TRACE_DELAYED);
+
+    return(TRACE_OK);
+}
+
+internal inline void pipeline_schedule_key(Pipeline *pipeline, int vk, uint16_t flags, uint64_t time_ns, int lane)
+{
+    Key_Event event = {0};
+    event.time_ns = time_ns;
+    event.vk = (uint16_t) vk;
+    event.flags = flags;
+    event.lane = (int8_t) lane;
+    
+    timer_wheel_insert(&pipeline->wheel, event);
+    trace_emit(pipeline->trace, TRACE_SCHEDULE, TRACE_OK, pipeline->trace_note, event.vk | (flags << 16), pipeline->trace_event_ns, time_ns);
+}
+
+// @Note: A combo goes out as modifiers down, key down, key up, modifiers up.
+// Everything is scheduled for the same time, the wheel keeps them in order
+// and the pacer spreads them out if it's on.
+internal inline void pipeline_schedule_tap(Pipeline *pipeline, int key, uint64_t time_ns, int lane)
+{
+    const int modifier_vks[3] = { KEY_VK_SHIFT, KEY_VK_CTRL, KEY_VK_ALT };
+    int modifiers = KEY_MODS(key);
+
+    for (int i = 0; i < 3; ++i) {
+        if (modifiers & (1 << i)) pipeline_schedule_key(pipeline, modifier_vks[i], 0, time_ns, -1);
+    }
+    
+    pipeline_schedule_key(pipeline, KEY_VK(key), 0, time_ns, lane);
+    pipeline_schedule_key(pipeline, KEY_VK(key), KEY_EVENT_UP, time_ns, lane);
+    
+    for (int i = 2; i >= 0; --i) {
+        if (modifiers & (1 << i)) pipeline_schedule_key(pipeline, modifier_vks[i], KEY_EVENT_UP, time_ns, -1);
+    }
+}
+
+// @Note: Modifiers only stay down for as long as it takes to press the key,
+// otherwise they'd leak into every other key pressed while this one is held.
+internal inline void pipeline_schedule_key_down(Pipeline *pipeline, int key, uint64_t time_ns, int lane)
+{
+    const int modifier_vks[3] = { KEY_VK_SHIFT, KEY_VK_CTRL, KEY_VK_ALT };
+    int modifiers = KEY_MODS(key);
+
+    for (int i = 0; i < 3; ++i) {
+        if (modifiers & (1 << i)) pipeline_schedule_key(pipeline, modifier_vks[i], 0, time_ns, -1);
+    }
+    
+    pipeline_schedule_key(pipeline, KEY_VK(key), 0, time_ns, lane);
+    
+    for (int i = 2; i >= 0; --i) {
+        if (modifiers & (1 << i)) pipeline_schedule_key(pipeline, modifier_vks[i], KEY_EVENT_UP, time_ns, -1);
+    }
+}
+
+internal inline void pipeline_release_hold(Pipeline *pipeline, Note_Hold *hold, uint64_t time_ns)
+{
+    uint64_t up_ns = time_ns > hold->down_ns ? time_ns : hold->down_ns;
+    pipeline->trace_note = (uint8_t) (hold - pipeline->holds);
+    pipeline_schedule_key(pipeline, KEY_VK(hold->key), KEY_EVENT_UP, up_ns, hold->index);
+    hold->flags = 0;
+}
+
+// @Note: The key for 'note' actually goes down at 'time_ns', whether that's
+// right away or after strumming held it back.
+internal inline void pipeline_press(Pipeline *pipeline, const Pipeline_Settings *settings, uint8_t note, int key, uint64_t time_ns)
+{
+    Note_Hold *hold = &pipeline->holds[note & 0x7F];
+    pipeline->trace_note = note;
+    
+    if (settings->key_mode == KEY_MODE_TAP) {
+        pipeline_schedule_tap(pipeline, key, time_ns, hold->index);
+        return;
+    }
+
+    bool released = hold->flags & HOLD_RELEASED;
+
+    // @Note: Struck again while still sustained, let go of it first.
+    if (hold->flags & HOLD_DOWN) pipeline_release_hold(pipeline, hold, time_ns);
+
+    pipeline_schedule_key_down(pipeline, key, time_ns, hold->index);
+    hold->key = (uint16_t) key;
+    hold->down_ns = time_ns;
+    hold->flags = HOLD_DOWN;
+    
+    if (released) pipeline_release_hold(pipeline, hold, time_ns);
+}
+
+internal inline void pipeline_flush_strum(Pipeline *pipeline, const Pipeline_Settings *settings)
+{
+    Strum_Note notes[STRUM_NOTES_LEN];
+    size_t len = strum_flush(&pipeline->strum, &settings->strum, notes);
+
+    for (size_t i = 0; i < len; ++i) {
+        pipeline_press(pipeline, settings, notes[i].note, notes[i].key, notes[i].time_ns);
+    }
+}
+
+internal inline void pipeline_set_sustain(Pipeline *pipeline, bool sustain, uint64_t time_ns)
+{
+    if (pipeline->sustain == sustain) return;
+    pipeline->sustain = sustain;
+    
+    if (sustain) return;
+    
+    for (size_t i = 0; i < ARR_SZ(pipeline->holds); ++i) {
+        if (pipeline->holds[i].flags & HOLD_SUSTAINED) {
+            pipeline_release_hold(pipeline, &pipeline->holds[i], time_ns);
+        }
+    }
+}
+
+internal inline const Mapping_Table *pipeline_table(const Pipeline *pipeline, const Mapping_Table *tables)
+{
+    if (pipeline->config_id == 0) return(&tables[0]);
+
+    return(&tables[pipeline->config_id->load(std::memory_order_relaxed)]);
+}
+
+internal inline void pipeline_control_action(Pipeline *pipeline, const Pipeline_Settings *settings, const Control_Mapping *control, bool pressed, uint64_t time_ns)
+{
+    switch (control->action) {
+    case ACTION_KEY: {
+        if (control->param == 0) break;
+        
+        if (settings->key_mode == KEY_MODE_TAP) {
+            if (pressed) pipeline_schedule_tap(pipeline, control->param, time_ns, -1);
+        } else if (pressed) {
+            pipeline_schedule_key_down(pipeline, control->param, time_ns, -1);
+        } else {
+            pipeline_schedule_key(pipeline, KEY_VK(control->param), KEY_EVENT_UP, time_ns, -1);
+        }
+    } break;
+
+    case ACTION_OCTAVE_UP: {
+        if (pressed && pipeline->octave_shift < OCTAVE_SHIFT_MAX) pipeline->octave_shift += 1;
+    } break;
+
+    case ACTION_OCTAVE_DOWN: {
+        if (pressed && pipeline->octave_shift > -OCTAVE_SHIFT_MAX) pipeline->octave_shift -= 1;
+    } break;
+
+    case ACTION_OCTAVE_RESET: {
+        if (pressed) pipeline->octave_shift = 0;
+    } break;
+
+    case ACTION_PROFILE: {
+        if (pressed && pipeline->config_id && control->param >= 0 && control->param < CONFIG_LEN) {
+            pipeline->config_id->store((size_t) control->param, std::memory_order_relaxed);
+            if (pipeline->log) log_push(pipeline->log, time_ns, "Loaded config %d", control->param + 1);
+        }
+    } break;
+    }
+}
+
+// @Note: Every control mapping is a Schmitt trigger, it turns on when the
+// value reaches 'threshold' and only turns off again once it's moved
+// 'hysteresis' back past it, so a noisy or slowly moving controller produces
+// exactly one press and one release. Program change has no "off", it's a
+// press and release in one go.
+internal inline void pipeline_control(Pipeline *pipeline, const Mapping_Table *table, const Pipeline_Settings *settings,
+                                      const Midi_Message *message, uint64_t time_ns)
+{
+    pipeline->last_control.store(message->status | (message->note << 8) | (message->velocity << 16), std::memory_order_relaxed);
+    pipeline->controls_seen.fetch_add(1, std::memory_order_release);
+    
+    if (message->status == CONTROL_CHANGE && message->note == SUSTAIN_CC) {
+        pipeline_set_sustain(pipeline, message->velocity >= 64, time_ns);
+    }
+
+    for (int i = 0; i < CONTROLS_LEN; ++i) {
+        const Control_Mapping *control = &table->controls[i];
+        int value = 0;
+        
+        if (control->source == CONTROL_CC) {
+            if (message->status != CONTROL_CHANGE || message->note != control->number) continue;
+            value = message->velocity;
+        } else if (control->source == CONTROL_PITCH_BEND) {
+            if (message->status != PITCH_BEND) continue;
+            value = message->velocity - 64;
+        } else if (control->source == CONTROL_PROGRAM_CHANGE) {
+            if (message->status != PROGRAM_CHANGE || message->note != control->number) continue;
+            
+            pipeline_control_action(pipeline, settings, control, true, time_ns);
+            pipeline_control_action(pipeline, settings, control, false, time_ns);
+            continue;
+        } else {
+            continue;
+        }
+
+        bool below = control->threshold < 0;
+        bool on = below ? value <= control->threshold : value >= control->threshold;
+        bool off = below ? value > control->threshold + control->hysteresis : value < control->threshold - control->hysteresis;
+
+        if (!pipeline->controls_on[i] && on) {
+            pipeline->controls_on[i] = true;
+            pipeline_control_action(pipeline, settings, control, true, time_ns);
+        } else if (pipeline->controls_on[i] && off) {
+            pipeline->controls_on[i] = false;
+            pipeline_control_action(pipeline, settings, control, false, time_ns);
+        }
+    }
+}
+
+internal inline void pipeline_note(Pipeline *pipeline, const Mapping_Table *table, const Pipeline_Settings *settings,
+                                   const Midi_Message *message, uint64_t time_ns)
+{
+    Note_Hold *hold = &pipeline->holds[message->note & 0x7F];
+    
+    if (message->status == NOTE_OFF) {
+        uint64_t due_ns = 0;
+        Filter_Action action = note_filter_apply(&pipeline->filter, &settings->filter, message, time_ns, &due_ns);
+        
+        trace_emit(pipeline->trace, TRACE_FILTER, pipeline_trace_result(action), message->note, 0, time_ns, due_ns);
+        if (action == FILTER_DROP) return;
+        
+        if (pipeline->highlighted_notes && hold->index >= 0) {
+            pipeline->highlighted_notes[hold->index] = false;
+        }
+        if (pipeline->note_roll && hold->index >= 0) {
+            note_roll_events_push(pipeline->note_roll, time_ns, hold->index, 0);
+        }
+
+        if (hold->flags & HOLD_WAITING) {
+            hold->flags |= HOLD_RELEASED;
+        } else if (hold->flags & HOLD_DOWN) {
+            if (pipeline->sustain) hold->flags |= HOLD_SUSTAINED;
+            else pipeline_release_hold(pipeline, hold, due_ns);
+        }
+        
+        return;
+    }
+    
+    int index = midi_note_to_index(message->note + pipeline->octave_shift*12, NOTE_OFFSET);
+    if (index == -1) {
+        trace_emit(pipeline->trace, TRACE_MAP, TRACE_OUT_OF_RANGE, message->note, 0, time_ns, 0);
+        if (pipeline->log) log_push(pipeline->log, time_ns, "Note %d is outside the visible range", message->note);
+        return;
+    }
+
+    uint64_t due_ns = 0;
+    Filter_Action action = note_filter_apply(&pipeline->filter, &settings->filter, message, time_ns, &due_ns);
+    
+    trace_emit(pipeline->trace, TRACE_FILTER, pipeline_trace_result(action), message->note, 0, time_ns, due_ns);
+    if (action == FILTER_DROP) return;
+
+    hold->index = (int8_t) index;
+    if (pipeline->highlighted_notes) pipeline->highlighted_notes[index] = true;
+    if (pipeline->note_roll) note_roll_events_push(pipeline->note_roll, time_ns, index, message->velocity);
+
+    int key = mapping_lookup_key(table, index, message->velocity);
+    
+    trace_emit(pipeline->trace, TRACE_MAP, key == 0 ? TRACE_UNMAPPED : TRACE_OK, message->note, (uint32_t) key, time_ns, due_ns);
+    if (key == 0) return;
+
+    // @Note: A chord that's still being held has to go out before
+    // anything that comes after it opens the next one.
+    if (strum_deadline(&pipeline->strum) <= due_ns) {
+        pipeline_flush_strum(pipeline, settings);
+    }
+
+    if (strum_add(&pipeline->strum, &settings->strum, message->note, (uint16_t) key, due_ns, &due_ns)) {
+        pipeline_press(pipeline, settings, message->note, key, due_ns);
+    } else if (settings->key_mode == KEY_MODE_HOLD) {
+        hold->flags = (hold->flags & HOLD_DOWN) | HOLD_WAITING;
+    }
+}
+
+// @Note: 'tables' is every config's mapping table, 'config_id' picks which one is live.
+internal inline void pipeline_process(Pipeline *pipeline, const Mapping_Table *tables, const Pipeline_Settings *settings, const Midi_Event *event)
+{
+    Midi_Message message = midi_decode(event->packed);
+    const Mapping_Table *table = pipeline_table(pipeline, tables);
+
+    pipeline->trace_event_ns = event->time_ns;
+    pipeline->trace_note = message.note;
+    trace_emit(pipeline->trace, TRACE_DECODE, TRACE_OK, message.note, event->packed, event->time_ns, 0);
+
+    switch (message.status) {
+    case NOTE_ON:
+    case NOTE_OFF: {
+        pipeline_note(pipeline, table, settings, &message, event->time_ns);
+    } break;
+
+    case CONTROL_CHANGE:
+    case PITCH_BEND:
+    case PROGRAM_CHANGE: {
+        pipeline_control(pipeline, table, settings, &message, event->time_ns);
+    } break;
+    }
+}
+
+// @Note: Time based work that isn't triggered by an incoming event,
+// call it before popping due key events.
+internal inline void pipeline_update(Pipeline *pipeline, const Pipeline_Settings *settings, uint64_t now_ns)
+{
+    pipeline->trace_event_ns = 0;
+    
+    if (strum_deadline(&pipeline->strum) <= now_ns) {
+        pipeline_flush_strum(pipeline, settings);
+    }
+}
+
+// @Note: 'next_free_ns' is left over from the last paced event, it only
+// counts while pacing is on.
+internal inline uint64_t pipeline_next_due(const Pipeline *pipeline, const Pipeline_Settings *settings)
+{
+    uint64_t due_ns = strum_deadline(&pipeline->strum);
+    
+    uint64_t key_due_ns = timer_wheel_next_due(&pipeline->wheel);
+    if (key_due_ns == UINT64_MAX) return(due_ns);
+    
+    if (settings->key_gap_ms > 0 && key_due_ns < pipeline->pacer.next_free_ns) key_due_ns = pipeline->pacer.next_free_ns;
+    if (key_due_ns < due_ns) due_ns = key_due_ns;
+    
+    return(due_ns);
+}
+
+internal inline bool pipeline_pop_due(Pipeline *pipeline, const Pipeline_Settings *settings, uint64_t now_ns, Key_Event *event)
+{
+    Timer_Wheel *wheel = &pipeline->wheel;
+    Pacer *pacer = &pipeline->pacer;
+
+    timer_wheel_advance(wheel, now_ns);
+
+    for (;;) {
+        const Key_Event *ready = timer_wheel_peek_ready(wheel);
+        if (ready == 0 || ready->time_ns > now_ns) return(false);
+        if (settings->key_gap_ms > 0 && pacer->next_free_ns > now_ns) return(false);
+
+        timer_wheel_pop_ready(wheel, event);
+        uint16_t *skipped = &pacer->skipped[event->vk & 0xFF];
+
+        // @Note: Its key down was dropped. This goes even with pacing off,
+        // so turning it off and on again can't pair a later key up with the
+        // wrong key down.
+        if ((event->flags & KEY_EVENT_UP) && *skipped > 0) {
+            *skipped -= 1;
+            continue;
+        }
+
+        if (settings->key_gap_ms <= 0) return(true);
+
+        uint64_t delay_ns = pacer->next_free_ns > event->time_ns ? pacer->next_free_ns - event->time_ns : 0;
+
+        if (!(event->flags & KEY_EVENT_UP)) {
+            if (!pacer->in_combo && delay_ns > (uint64_t) settings->key_delay_max_ms*1000000ull) {
+                *skipped += 1;
+                pacer->dropped += 1;
+                continue;
+            }
+
+            pacer->in_combo = event->vk == KEY_VK_SHIFT || event->vk == KEY_VK_CTRL || event->vk == KEY_VK_ALT;
+        }
+        
+        pacer->paced_events += 1;
+        pacer->total_delay_ns += delay_ns;
+        pacer->last_delay_ns = delay_ns;
+        if (delay_ns > pacer->max_delay_ns) pacer->max_delay_ns = delay_ns;
+
+        // @Note: Paced from when it was supposed to go out, not from now,
+        // so the thread waking up late doesn't push everything back further.
+        uint64_t sent_ns = event->time_ns + delay_ns;
+        pacer->next_free_ns = sent_ns + settings->key_gap_ms*1000000ull;
+
+        return(true);
+    }
+}
+
+#endif // PIPELINE_H
@@ -0,0 +1,482 @@
+// @Note: Stand-in for a game reading our key presses. Games don't get key
+// events, they look at which keys are down once a frame, so a tap that's
+// down and up again between two frames never happened as far as they're
+// concerned. This runs the real pipeline on some MIDI input in virtual time,
+// collects the key events it would have sent into a mock sink and then
+// samples that sink like a game loop would, at a few frame phases, to count:
+//
+//     lost       the note's key was never seen down
+//     merged     the key was seen down, but it never looked up since the
+//                same key's previous press, so it's the same press to the game
+//     modifiers  the key was seen, but never with its modifiers held
+//     reordered  seen a frame earlier than a note that was played before it
+//     same frame seen in the same frame as the note played before it, the
+//                game can't tell which came first
+//
+// Usage: maidai-poll <pattern|file.trace> [options]
+//
+//     patterns: scale, trill, repeat, chords (see 'make_pattern()'), or the
+//     MIDI input of a trace recorded with F7 (see trace.h)
+//
+//     --fps 30,60,144      frame rates to sample at (default 60)
+//     --nps 12             notes per second for the patterns
+//     --mode tap|hold      key mode
+//     --gap 0              minimum ms between two key events
+//     --max-delay 250      key downs the gap would hold back longer than this
+//                          are dropped
+//     --strum 0            strum window ms (--strum-step for the step)
+//     --debounce 5         debounce ms
+//     --profiles file.txt  map with the first profile in a text export instead
+//                          of the built-in three octave layout
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "./base.h"
+#include "./vk.h"
+#include "./timer.h"
+#include "./midi.h"
+#include "./config.h"
+#include "./config_text.h"
+#include "./queue.h"
+#include "./log.h"
+#include "./receive.h"
+#include "./filter.h"
+#include "./strum.h"
+#include "./timer_wheel.h"
+#include "./trace.h"
+#include "./note_roll.h"
+#include "./pipeline.h"
+
+#define POLL_PATTERN_NOTES 400
+#define POLL_PHASES 16 // @Note: Frame offsets every rate is sampled at, the results are averaged.
+#define POLL_FPS_CAP 8
+
+struct Poll_Input {
+    uint64_t time_ns;
+    uint32_t packed;
+};
+
+// @Note: A key event the pipeline sent, and the note it was sent for.
+struct Poll_Key {
+    uint64_t time_ns;
+    uint16_t vk;
+    bool up;
+};
+
+struct Poll_Note {
+    uint64_t played_ns;
+    int key; // @Note: KEY_COMBO(), what the note mapped to.
+    uint64_t down_ns; // @Note: When its key went down, 0 if it never did.
+};
+
+struct Poll_Result {
+    double notes;
+    double lost;
+    double merged;
+    double modifiers;
+    double reordered;
+    double same_frame;
+};
+
+global Pipeline pipeline;
+global Trace_Buffer trace;
+global Mapping_Table tables[CONFIG_LEN];
+
+internal uint32_t poll_pack(int status, int note, int velocity)
+{
+    return((uint32_t) (status | (note << 8) | (velocity << 16)));
+}
+
+// @Note: Every note is half as long as the gap to the next one.
+internal bool make_pattern(const char *name, int notes_per_second, std::vector<Poll_Input> *input)
+{
+    uint64_t step_ns = 1000000000ull / (uint64_t) notes_per_second;
+    uint64_t time_ns = 1000000000ull;
+    const int chord[4] = { 0, 4, 7, 12 };
+
+    for (int i = 0; i < POLL_PATTERN_NOTES; ++i) {
+        int notes[4] = {0};
+        int len = 1;
+
+        if (strcmp(name, "scale") == 0) {
+            const int major[7] = { 0, 2, 4, 5, 7, 9, 11 };
+            notes[0] = NOTE_OFFSET + 12 + major[i % 7];
+        } else if (strcmp(name, "trill") == 0) {
+            notes[0] = NOTE_OFFSET + 12 + (i & 1)*2;
+        } else if (strcmp(name, "repeat") == 0) {
+            notes[0] = NOTE_OFFSET + 12;
+        } else if (strcmp(name, "chords") == 0) {
+            for (int j = 0; j < 4; ++j) notes[j] = NOTE_OFFSET + (i % 3)*5 + chord[j];
+            len = 4;
+        } else {
+            return(false);
+        }
+
+        for (int j = 0; j < len; ++j) {
+            input->push_back({ time_ns, poll_pack(NOTE_ON, notes[j], 100) });
+            input->push_back({ time_ns + step_ns/2, poll_pack(NOTE_OFF, notes[j], 0) });
+        }
+
+        time_ns += step_ns;
+    }
+
+    std::stable_sort(input->begin(), input->end(), [](const Poll_Input &a, const Poll_Input &b) { return(a.time_ns < b.time_ns); });
+    return(true);
+}
+
+// @Note: Whatever made it past the receive filter in a recorded session.
+internal bool read_trace_input(const char *path, std::vector<Poll_Input> *input)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) return(false);
+
+    Trace_File_Header header = {0};
+    bool result = fread(&header, sizeof(header), 1, file) == 1 && header.magic == TRACE_MAGIC &&
+                  header.version == TRACE_VERSION && header.record_size == sizeof(Trace_Record);
+
+    Trace_Record record = {0};
+    while (result && fread(&record, sizeof(record), 1, file) == 1) {
+        if (record.stage == TRACE_DECODE) input->push_back({ record.event_ns, record.data });
+    }
+
+    fclose(file);
+    std::stable_sort(input->begin(), input->end(), [](const Poll_Input &a, const Poll_Input &b) { return(a.time_ns < b.time_ns); });
+
+    return(result && !input->empty());
+}
+
+// @Note: Three octaves, the middle one as is, the low one with Ctrl and the
+// high one with Shift, like most games with a 37 key performance mode.
+internal void make_default_config(Config *config)
+{
+    const char *keys = "Q2W3ER5T6Y7U";
+    const int modifiers[3] = { KEY_MOD_CTRL, 0, KEY_MOD_SHIFT };
+
+    for (int i = 0; i < MIDI_FULL_LEN; ++i) {
+        int octave = i/12 < 3 ? i/12 : 2;
+        int vk = i == MIDI_FULL_LEN - 1 ? 'I' : keys[i % 12];
+        config->keys_map[i] = KEY_COMBO(vk, modifiers[octave]);
+    }
+}
+
+internal bool load_profile(const char *path, Config *config)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) return(false);
+
+    std::vector<char> data;
+    char chunk[4096];
+    size_t len = 0;
+    while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + len);
+    fclose(file);
+
+    Config configs[CONFIG_LEN] = {};
+    Config_Text_Result result = config_text_parse(data.data(), data.size(), configs, CONFIG_LEN);
+    if (result.profiles == 0) return(false);
+
+    *config = configs[0];
+    return(true);
+}
+
+// @Note: Feeds 'input' through the pipeline as if the injection thread woke
+// up exactly when it had something to do. Key downs are tied back to their
+// note through the trace records, the same way trace_tool.cpp does it.
+internal void run_pipeline(const std::vector<Poll_Input> *input, const Pipeline_Settings *settings,
+                           std::vector<Poll_Key> *keys, std::vector<Poll_Note> *notes)
+{
+    uint64_t start_ns = input->empty() ? 0 : (*input)[0].time_ns;
+
+    pipeline_init(&pipeline, start_ns);
+    pipeline.trace = &trace;
+    trace.enabled.store(true);
+
+    std::map<std::pair<uint32_t, uint64_t>, std::vector<size_t>> scheduled;
+    std::map<uint64_t, size_t> notes_by_time;
+    size_t last_mapped[128] = {0}; // @Note: Index + 1 of the last note mapped per note number.
+    static Trace_Record records[TRACE_BUFFER_LEN];
+
+    size_t next = 0;
+    uint64_t now_ns = start_ns;
+
+    for (;;) {
+        uint64_t input_ns = next < input->size() ? (*input)[next].time_ns : UINT64_MAX;
+        uint64_t due_ns = pipeline_next_due(&pipeline, settings);
+        uint64_t wake_ns = input_ns < due_ns ? input_ns : due_ns;
+        if (wake_ns == UINT64_MAX) break;
+
+        // @Note: The wheel only knows its tick, nudge forward so we can't get stuck on one.
+        now_ns = wake_ns > now_ns ? wake_ns : now_ns + TIMER_WHEEL_TICK_NS;
+
+        while (next < input->size() && (*input)[next].time_ns <= now_ns) {
+            Midi_Event event = { (*input)[next].time_ns, (*input)[next].packed, 0 };
+            pipeline_process(&pipeline, tables, settings, &event);
+            next += 1;
+        }
+
+        pipeline_update(&pipeline, settings, now_ns);
+
+        Key_Event key = {0};
+        while (pipeline_pop_due(&pipeline, settings, now_ns, &key)) {
+            keys->push_back({ now_ns, key.vk, (key.flags & KEY_EVENT_UP) != 0 });
+            trace_emit(&trace, TRACE_INJECT, TRACE_OK, 0, key.vk | (key.flags << 16), 0, key.time_ns);
+        }
+
+        size_t count = trace_drain(&trace, records, TRACE_BUFFER_LEN);
+        for (size_t i = 0; i < count; ++i) {
+            const Trace_Record *record = &records[i];
+
+            if (record->stage == TRACE_MAP && record->result == TRACE_OK) {
+                notes_by_time[record->event_ns] = notes->size();
+                last_mapped[record->note & 0x7F] = notes->size() + 1;
+                notes->push_back({ record->event_ns, (int) record->data, 0 });
+            } else if (record->stage == TRACE_SCHEDULE) {
+                // @Note: Strummed notes go out later without their event, they're the last one mapped on that note.
+                size_t index = 0;
+                if (record->event_ns != 0) {
+                    auto found = notes_by_time.find(record->event_ns);
+                    if (found == notes_by_time.end()) continue;
+                    index = found->second;
+                } else if (last_mapped[record->note & 0x7F] != 0) {
+                    index = last_mapped[record->note & 0x7F] - 1;
+                } else {
+                    continue;
+                }
+
+                const Poll_Note *note = &(*notes)[index];
+                bool main_key_down = (record->data & 0xFFFF) == (uint32_t) KEY_VK(note->key) && ((record->data >> 16) & KEY_EVENT_UP) == 0;
+                if (main_key_down) scheduled[std::make_pair(record->data, record->due_ns)].push_back(index);
+            } else if (record->stage == TRACE_INJECT) {
+                std::vector<size_t> *waiting = &scheduled[std::make_pair(record->data, record->due_ns)];
+                if (waiting->empty()) continue;
+
+                (*notes)[waiting->front()].down_ns = keys->back().time_ns;
+                waiting->erase(waiting->begin());
+            }
+        }
+    }
+}
+
+// @Note: Down intervals per vk, [down, up).
+struct Poll_Key_State {
+    std::vector<std::pair<uint64_t, uint64_t>> presses[256];
+};
+
+internal void build_key_state(const std::vector<Poll_Key> *keys, Poll_Key_State *key_state)
+{
+    uint64_t down_since[256] = {0};
+
+    for (const Poll_Key &key : *keys) {
+        if (!key.up && down_since[key.vk] == 0) {
+            down_since[key.vk] = key.time_ns;
+        } else if (key.up && down_since[key.vk] != 0) {
+            key_state->presses[key.vk].push_back(std::make_pair(down_since[key.vk], key.time_ns));
+            down_since[key.vk] = 0;
+        }
+    }
+
+    for (int vk = 0; vk < 256; ++vk) {
+        if (down_since[vk] != 0) key_state->presses[vk].push_back(std::make_pair(down_since[vk], UINT64_MAX));
+    }
+}
+
+// @Note: The press of 'vk' that's down at 'time_ns', -1 if it's up.
+internal int press_at(const Poll_Key_State *key_state, int vk, uint64_t time_ns)
+{
+    const std::vector<std::pair<uint64_t, uint64_t>> *presses = &key_state->presses[vk];
+    auto after = std::upper_bound(presses->begin(), presses->end(), std::make_pair(time_ns, UINT64_MAX));
+    if (after == presses->begin()) return(-1);
+
+    --after;
+    if (time_ns >= after->second) return(-1);
+
+    return((int) (after - presses->begin()));
+}
+
+internal uint64_t first_frame_at(uint64_t time_ns, uint64_t phase_ns, uint64_t period_ns)
+{
+    if (time_ns <= phase_ns) return(0);
+    return((time_ns - phase_ns + period_ns - 1)/period_ns);
+}
+
+internal Poll_Result sample(const std::vector<Poll_Note> *notes, const Poll_Key_State *key_state, int fps, uint64_t phase_ns)
+{
+    const int modifier_vks[3] = { KEY_VK_SHIFT, KEY_VK_CTRL, KEY_VK_ALT };
+    uint64_t period_ns = 1000000000ull / (uint64_t) fps;
+
+    Poll_Result result = {0};
+    std::map<std::pair<int, int>, bool> seen_presses; // @Note: (vk, press) the game already saw as some note.
+    int64_t last_frame = -1;
+
+    for (const Poll_Note &note : *notes) {
+        result.notes += 1;
+
+        int vk = KEY_VK(note.key);
+        int press = note.down_ns != 0 ? press_at(key_state, vk, note.down_ns) : -1;
+        if (press == -1) {
+            result.lost += 1;
+            continue;
+        }
+
+        std::pair<uint64_t, uint64_t> interval = key_state->presses[vk][press];
+        uint64_t frame = first_frame_at(interval.first, phase_ns, period_ns);
+        uint64_t frame_ns = phase_ns + frame*period_ns;
+
+        if (frame_ns >= interval.second) {
+            // @Note: Never sampled while down, unless it's glued onto the previous press.
+            bool glued = press > 0 && key_state->presses[vk][press - 1].second == interval.first;
+            if (glued) result.merged += 1;
+            else result.lost += 1;
+            continue;
+        }
+
+        // @Note: Up since the last press? If no frame saw that, it's the same press.
+        if (press > 0 && seen_presses.count(std::make_pair(vk, press - 1))) {
+            uint64_t up_ns = key_state->presses[vk][press - 1].second;
+            if (first_frame_at(up_ns, phase_ns, period_ns) >= frame) {
+                result.merged += 1;
+                continue;
+            }
+        }
+
+        if (seen_presses.count(std::make_pair(vk, press))) {
+            result.merged += 1;
+            continue;
+        }
+        seen_presses[std::make_pair(vk, press)] = true;
+
+        int modifiers = KEY_MODS(note.key);
+        bool modifiers_held = false;
+        for (uint64_t t = frame_ns; t < interval.second && !modifiers_held; t += period_ns) {
+            modifiers_held = true;
+            for (int i = 0; i < 3; ++i) {
+                bool held = press_at(key_state, modifier_vks[i], t) != -1;
+                if (((modifiers >> i) & 1) != (int) held) modifiers_held = false;
+            }
+        }
+        if (!modifiers_held) result.modifiers += 1;
+
+        if ((int64_t) frame < last_frame) result.reordered += 1;
+        else if ((int64_t) frame == last_frame) result.same_frame += 1;
+        if ((int64_t) frame > last_frame) last_frame = (int64_t) frame;
+    }
+
+    return(result);
+}
+
+internal int parse_list(const char *text, int *values, int cap)
+{
+    int len = 0;
+    while (*text && len < cap) {
+        values[len++] = atoi(text);
+        const char *comma = strchr(text, ',');
+        if (!comma) break;
+        text = comma + 1;
+    }
+
+    return(len);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: maidai-poll <scale|trill|repeat|chords|file.trace> [--fps 30,60] [--nps 12] [--mode tap|hold]\n"
+                        "                   [--gap ms] [--max-delay ms] [--strum ms] [--strum-step ms] [--debounce ms] [--profiles file.txt]\n");
+        return 1;
+    }
+
+    int fps[POLL_FPS_CAP] = { 60 };
+    int fps_len = 1;
+    int notes_per_second = 12;
+    const char *profiles = 0;
+    Pipeline_Settings settings = default_pipeline_settings();
+
+    for (int i = 2; i < argc; ++i) {
+        const char *option = argv[i];
+        if (i + 1 >= argc) {
+            fprintf(stderr, "'%s' needs a value\n", option);
+            return 1;
+        }
+
+        const char *value = argv[++i];
+
+        if (strcmp(option, "--fps") == 0) fps_len = parse_list(value, fps, POLL_FPS_CAP);
+        else if (strcmp(option, "--nps") == 0) notes_per_second = atoi(value);
+        else if (strcmp(option, "--mode") == 0) settings.key_mode = strcmp(value, "hold") == 0 ? KEY_MODE_HOLD : KEY_MODE_TAP;
+        else if (strcmp(option, "--gap") == 0) settings.key_gap_ms = atoi(value);
+        else if (strcmp(option, "--max-delay") == 0) settings.key_delay_max_ms = atoi(value);
+        else if (strcmp(option, "--strum") == 0) settings.strum.window_ms = atoi(value);
+        else if (strcmp(option, "--strum-step") == 0) settings.strum.offset_ms = atoi(value);
+        else if (strcmp(option, "--debounce") == 0) settings.filter.debounce_ms = atoi(value);
+        else if (strcmp(option, "--profiles") == 0) profiles = value;
+        else {
+            fprintf(stderr, "Unknown option '%s'\n", option);
+            return 1;
+        }
+    }
+
+    if (notes_per_second <= 0) notes_per_second = 1;
+
+    std::vector<Poll_Input> input;
+    if (!make_pattern(argv[1], notes_per_second, &input) && !read_trace_input(argv[1], &input)) {
+        fprintf(stderr, "'%s' is neither a pattern nor a trace with MIDI input\n", argv[1]);
+        return 1;
+    }
+
+    Config config = {};
+    if (profiles) {
+        if (!load_profile(profiles, &config)) {
+            fprintf(stderr, "No profile in '%s'\n", profiles);
+            return 1;
+        }
+    } else {
+        make_default_config(&config);
+    }
+    config_build_table(&config, &tables[0]);
+
+    std::vector<Poll_Key> keys;
+    std::vector<Poll_Note> notes;
+    run_pipeline(&input, &settings, &keys, &notes);
+
+    static Poll_Key_State key_state;
+    build_key_state(&keys, &key_state);
+
+    printf("%zu MIDI events, %zu mapped notes, %zu key events (%s, gap %d ms, strum %d ms)\n", input.size(), notes.size(),
+           keys.size(), key_mode_names[settings.key_mode], settings.key_gap_ms, settings.strum.window_ms);
+    if (settings.key_gap_ms > 0) {
+        printf("pacing added up to %.1f ms, dropped %llu key downs over %d ms late\n", pipeline.pacer.max_delay_ns/1e6,
+               (unsigned long long) pipeline.pacer.dropped, settings.key_delay_max_ms);
+    }
+    printf("\n");
+    printf("%5s %8s %8s %8s %10s %10s %10s\n", "fps", "lost", "merged", "mods", "reordered", "same frame", "seen ok");
+
+    for (int i = 0; i < fps_len; ++i) {
+        if (fps[i] <= 0) continue;
+
+        uint64_t period_ns = 1000000000ull / (uint64_t) fps[i];
+        Poll_Result total = {0};
+
+        for (int phase = 0; phase < POLL_PHASES; ++phase) {
+            Poll_Result result = sample(&notes, &key_state, fps[i], period_ns*phase/POLL_PHASES);
+            total.notes += result.notes;
+            total.lost += result.lost;
+            total.merged += result.merged;
+            total.modifiers += result.modifiers;
+            total.reordered += result.reordered;
+            total.same_frame += result.same_frame;
+        }
+
+        double n = total.notes > 0 ? total.notes : 1;
+        double ok = total.notes - total.lost - total.merged - total.modifiers;
+        printf("%5d %7.1f%% %7.1f%% %7.1f%% %9.1f%% %9.1f%% %9.1f%%\n", fps[i], 100*total.lost/n, 100*total.merged/n,
+               100*total.modifiers/n, 100*total.reordered/n, 100*total.same_frame/n, 100*ok/n);
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// @Note: Frame profiler, every frame gets a slot in a ring buffer that
+// scoped zones write into. Nothing here allocates, the whole thing lives
+// in a global and is dumped as a Chrome trace (chrome://tracing, Perfetto)
+// on request.
+
+#define PROFILER_FRAMES_LEN 240
+#define PROFILER_RECORDS_LEN 64
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(zone) Profile_Scope PROFILE_CONCAT(profile_scope_, __LINE__)(zone)
+
+enum Profile_Zone {
+    PROFILE_ZONE_KEY_ASSIGNMENT = 0,
+    PROFILE_ZONE_MIDI_CONTROLLER,
+    PROFILE_ZONE_RENDER_KEYBOARD,
+    PROFILE_ZONE_RENDER_CONTROL_PANEL,
+    PROFILE_ZONE_RENDER_NOTE_ROLL,
+    PROFILE_ZONE_TEXT,
+    PROFILE_ZONE_COUNT,
+};
+
+global const char *profile_zone_names[PROFILE_ZONE_COUNT] = {
+    "check_key_assignment",
+    "check_midi_controller",
+    "render_keyboard",
+    "render_control_panel",
+    "render_note_roll",
+    "text",
+};
+
+struct Profile_Record {
+    uint64_t start_ns;
+    uint32_t duration_ns;
+    uint32_t zone;
+};
+
+struct Profile_Frame {
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint64_t zone_ns[PROFILE_ZONE_COUNT];
+    uint32_t records_len;
+    uint32_t records_dropped;
+
+    // @Note: Keep this last, 'profiler_begin_frame()' clears everything before it.
+    Profile_Record records[PROFILER_RECORDS_LEN];
+};
+
+struct Profiler {
+    Profile_Frame frames[PROFILER_FRAMES_LEN];
+    size_t frame_index;
+    size_t frames_recorded;
+    
+    bool visible;
+};
+
+global Profiler profiler = {0};
+
+internal inline Profile_Frame *profiler_current_frame()
+{
+    return(&profiler.frames[profiler.frame_index]);
+}
+
+internal inline void profiler_begin_frame()
+{
+    Profile_Frame *frame = profiler_current_frame();
+    memset(frame, 0, sizeof(*frame) - sizeof(frame->records));
+    frame->start_ns = get_time_ns();
+}
+
+internal inline void profiler_end_frame()
+{
+    Profile_Frame *frame = profiler_current_frame();
+    frame->duration_ns = get_time_ns() - frame->start_ns;
+
+    profiler.frame_index = (profiler.frame_index + 1) % PROFILER_FRAMES_LEN;
+    if (profiler.frames_recorded < PROFILER_FRAMES_LEN) {
+        profiler.frames_recorded += 1;
+    }
+}
+
+internal inline void profiler_record(Profile_Zone zone, uint64_t start_ns, uint64_t end_ns)
+{
+    Profile_Frame *frame = profiler_current_frame();
+    frame->zone_ns[zone] += end_ns - start_ns;
+
+    if (frame->records_len < PROFILER_RECORDS_LEN) {
+        Profile_Record *record = &frame->records[frame->records_len++];
+        record->start_ns = start_ns;
+        record->duration_ns = (uint32_t) (end_ns - start_ns);
+        record->zone = zone;
+    } else {
+        frame->records_dropped += 1;
+    }
+}
+
+struct Profile_Scope {
+    Profile_Zone zone;
+    uint64_t start_ns;
+
+    Profile_Scope(Profile_Zone z) : zone(z), start_ns(get_time_ns()) {}
+    ~Profile_Scope() { profiler_record(zone, start_ns, get_time_ns()); }
+};
+
+// @Note: 'age' 0 is the last finished frame.
+internal inline const Profile_Frame *profiler_get_frame(size_t age)
+{
+    size_t index = (profiler.frame_index + PROFILER_FRAMES_LEN - 1 - age) % PROFILER_FRAMES_LEN;
+    return(&profiler.frames[index]);
+}
+
+internal inline double profiler_average_ms(int zone, size_t frames_len)
+{
+    if (frames_len > profiler.frames_recorded) frames_len = profiler.frames_recorded;
+    if (frames_len == 0) return(0.0);
+    
+    uint64_t total = 0;
+    for (size_t i = 0; i < frames_len; ++i) {
+        const Profile_Frame *frame = profiler_get_frame(i);
+        total += zone == -1 ? frame->duration_ns : frame->zone_ns[zone];
+    }
+
+    return((double) total / (double) frames_len / 1e6);
+}
+
+// @Note: Chrome's trace event format, complete ('X') events with
+// timestamps in microseconds. Frames go on their own track so stalls
+// are easy to line up with the zones.
+internal inline bool profiler_export_chrome_trace(const char *file_path)
+{
+    FILE *file = fopen(file_path, "wb");
+    if (file == 0) return(false);
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    
+    for (size_t age = profiler.frames_recorded; age-- > 0;) {
+        const Profile_Frame *frame = profiler_get_frame(age);
+
+        fprintf(file, "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",\n", frame->start_ns / 1e3, frame->duration_ns / 1e3);
+        first = false;
+        
+        for (uint32_t i = 0; i < frame->records_len; ++i) {
+            const Profile_Record *record = &frame->records[i];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                    profile_zone_names[record->zone], record->start_ns / 1e3, record->duration_ns / 1e3);
+        }
+    }
+    
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    return(true);
+}
+
+#endif // PROFILER_H
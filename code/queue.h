@@ -0,0 +1,90 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <atomic>
+
+// @Note: Bounded multi-producer/single-consumer queue between the MIDI
+// callbacks (one per device, each on its own winmm thread) and the
+// injection thread. Every cell carries a sequence number so producers
+// only ever contend on 'head', it never blocks and never allocates.
+// When it's full the event is dropped and counted, the callback can't wait.
+
+#define MIDI_QUEUE_LEN 1024 // @Note: Must be a power of two.
+
+struct Midi_Event {
+    uint64_t time_ns;
+    uint32_t packed;
+    uint32_t device;
+};
+
+struct Midi_Queue_Cell {
+    std::atomic<size_t> sequence;
+    Midi_Event event;
+};
+
+// @Note: Padded by hand instead of alignas(), MSVC warns (C4324) on every
+// struct that gets padded because of it and we build with /WX.
+struct Midi_Queue {
+    Midi_Queue_Cell cells[MIDI_QUEUE_LEN];
+    uint8_t pad0[CACHE_LINE_SIZE];
+    
+    std::atomic<size_t> head;
+    uint8_t pad1[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    
+    size_t tail;
+    uint8_t pad2[CACHE_LINE_SIZE - sizeof(size_t)];
+    
+    std::atomic<size_t> dropped;
+};
+
+internal inline void midi_queue_init(Midi_Queue *queue)
+{
+    for (size_t i = 0; i < MIDI_QUEUE_LEN; ++i) {
+        queue->cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    queue->head.store(0, std::memory_order_relaxed);
+    queue->tail = 0;
+    queue->dropped.store(0, std::memory_order_relaxed);
+}
+
+internal inline bool midi_queue_push(Midi_Queue *queue, const Midi_Event *event)
+{
+    size_t head = queue->head.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Midi_Queue_Cell *cell = &queue->cells[head & (MIDI_QUEUE_LEN - 1)];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) head;
+
+        if (diff == 0) {
+            if (queue->head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                cell->event = *event;
+                cell->sequence.store(head + 1, std::memory_order_release);
+                return(true);
+            }
+        } else if (diff < 0) {
+            queue->dropped.fetch_add(1, std::memory_order_relaxed);
+            return(false);
+        } else {
+            head = queue->head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// @Note: Only the injection thread is allowed to call this.
+internal inline bool midi_queue_pop(Midi_Queue *queue, Midi_Event *event)
+{
+    Midi_Queue_Cell *cell = &queue->cells[queue->tail & (MIDI_QUEUE_LEN - 1)];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+
+    if (sequence != queue->tail + 1) return(false);
+
+    *event = cell->event;
+    cell->sequence.store(queue->tail + MIDI_QUEUE_LEN, std::memory_order_release);
+    queue->tail += 1;
+
+    return(true);
+}
+
+#endif // QUEUE_H
@@ -0,0 +1,99 @@
+#ifndef RECEIVE_H
+#define RECEIVE_H
+
+// @Note: First thing the MIDI callback does, before timestamping or queueing.
+// Controllers happily stream clock (0xF8, 24 per quarter note), active
+// sensing (0xFE, every ~300ms) and aftertouch for as long as a key is held,
+// none of which we use. Whatever the user wants gone is turned into a
+// 256-bit mask indexed by the status byte, so accepting a message is one
+// load, a shift and a test.
+//
+// The mask is written by the UI thread and read by the winmm thread, 64 bits
+// at a time. A message racing a settings change can land on either side of
+// it, which is fine.
+
+enum Midi_Class {
+    MIDI_CLASS_NOTE = 0,
+    MIDI_CLASS_POLY_PRESSURE,
+    MIDI_CLASS_CONTROL,
+    MIDI_CLASS_PROGRAM,
+    MIDI_CLASS_CHANNEL_PRESSURE,
+    MIDI_CLASS_PITCH_BEND,
+    MIDI_CLASS_SYSTEM, // @Note: SysEx and system common, 0xF0-0xF7.
+    MIDI_CLASS_CLOCK,
+    MIDI_CLASS_TRANSPORT, // @Note: Start/continue/stop and the undefined realtime ones.
+    MIDI_CLASS_ACTIVE_SENSING,
+    MIDI_CLASS_RESET,
+    MIDI_CLASS_COUNT,
+};
+
+#define MIDI_CLASS_BIT(class) (1 << (class))
+
+// @Note: What gets dropped if there's no config.dat saying otherwise.
+#define DEFAULT_RECEIVE_DROP (MIDI_CLASS_BIT(MIDI_CLASS_CLOCK) | MIDI_CLASS_BIT(MIDI_CLASS_ACTIVE_SENSING) | \
+                              MIDI_CLASS_BIT(MIDI_CLASS_POLY_PRESSURE) | MIDI_CLASS_BIT(MIDI_CLASS_CHANNEL_PRESSURE))
+
+global const char *const midi_class_names[MIDI_CLASS_COUNT] = {
+    "note", "poly aftertouch", "control", "program", "aftertouch", "pitch bend",
+    "system", "clock", "transport", "active sensing", "reset",
+};
+
+struct Receive_Filter {
+    std::atomic<uint64_t> drop[4];
+
+    // @Note: Only the callback writes these, everybody else just reads.
+    std::atomic<uint32_t> dropped[MIDI_CLASS_COUNT];
+};
+
+internal inline int midi_status_class(uint8_t status)
+{
+    if (status < 0xF0) {
+        // @Note: Data bytes (running status) never reach us from winmm, they're lumped in with notes.
+        if (status < NOTE_OFF) return(MIDI_CLASS_NOTE);
+
+        const int channel_classes[7] = {
+            MIDI_CLASS_NOTE, MIDI_CLASS_NOTE, MIDI_CLASS_POLY_PRESSURE, MIDI_CLASS_CONTROL,
+            MIDI_CLASS_PROGRAM, MIDI_CLASS_CHANNEL_PRESSURE, MIDI_CLASS_PITCH_BEND,
+        };
+
+        return(channel_classes[(status >> 4) - 8]);
+    }
+
+    if (status < 0xF8) return(MIDI_CLASS_SYSTEM);
+    if (status == 0xF8) return(MIDI_CLASS_CLOCK);
+    if (status == 0xFE) return(MIDI_CLASS_ACTIVE_SENSING);
+    if (status == 0xFF) return(MIDI_CLASS_RESET);
+
+    return(MIDI_CLASS_TRANSPORT);
+}
+
+// @Note: 'drop_classes' is a set of MIDI_CLASS_BIT()s.
+internal inline void receive_filter_set(Receive_Filter *filter, int drop_classes)
+{
+    uint64_t drop[4] = {0};
+
+    for (int status = 0; status < 256; ++status) {
+        if (drop_classes & MIDI_CLASS_BIT(midi_status_class((uint8_t) status))) {
+            drop[status >> 6] |= 1ull << (status & 63);
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        filter->drop[i].store(drop[i], std::memory_order_relaxed);
+    }
+}
+
+internal inline bool receive_filter_accept(Receive_Filter *filter, uint32_t packed)
+{
+    uint8_t status = packed & 0xFF;
+    uint64_t drop = filter->drop[status >> 6].load(std::memory_order_relaxed);
+
+    if (((drop >> (status & 63)) & 1) == 0) return(true);
+
+    std::atomic<uint32_t> *dropped = &filter->dropped[midi_status_class(status)];
+    dropped->store(dropped->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    return(false);
+}
+
+#endif // RECEIVE_H
@@ -0,0 +1,256 @@
+#ifndef SMF_H
+#define SMF_H
+
+// @Note: Standard MIDI File reader. It works on the file in place (mapped or
+// read into memory) and never allocates, every track just keeps its next
+// event decoded and 'smf_next()' hands out whichever comes first, with its
+// time converted through the tempo map on the way. Memory use doesn't
+// depend on the file, so a library scan can stream through thousands of them.
+//
+// Channel messages come out packed like winmm's MIM_DATA (status, then the
+// two data bytes), so they go through the pipeline exactly like live input.
+// Tempo changes come out as well, SysEx and every other meta event is
+// skipped. Format 2 files (independent sequences) are merged like format 1,
+// nobody writes those anymore.
+//
+// A broken or truncated track just ends where it stops making sense, the
+// rest of the file still plays.
+
+#define SMF_TRACKS_CAP 64
+#define SMF_DEFAULT_TEMPO 500000 // @Note: Microseconds per quarter note, 120 bpm.
+
+enum Smf_Event_Type {
+    SMF_EVENT_MIDI = 0, // @Note: 'data' is the packed message.
+    SMF_EVENT_TEMPO, // @Note: 'data' is microseconds per quarter note.
+};
+
+struct Smf_Event {
+    uint64_t time_ns;
+    uint64_t tick;
+    uint32_t data;
+    uint8_t type;
+    uint8_t track;
+};
+
+struct Smf_Track {
+    const uint8_t *at;
+    const uint8_t *end;
+    uint64_t tick;
+    uint8_t running_status;
+    bool pending; // @Note: 'event' holds the track's next event, false once it's done.
+    Smf_Event event;
+};
+
+struct Smf {
+    int format;
+    int division; // @Note: Ticks per quarter note, or per second for SMPTE time.
+    bool smpte;
+    int tracks_len;
+    int tracks_skipped; // @Note: Past SMF_TRACKS_CAP.
+    bool broken; // @Note: Some track or chunk ended early.
+    Smf_Track tracks[SMF_TRACKS_CAP];
+
+    // @Note: Last tempo change, ticks after it are converted from there.
+    uint64_t tempo_tick;
+    uint64_t tempo_ns;
+    uint32_t tempo;
+};
+
+internal inline uint32_t smf_read_u32(const uint8_t *at)
+{
+    return(((uint32_t) at[0] << 24) | ((uint32_t) at[1] << 16) | ((uint32_t) at[2] << 8) | (uint32_t) at[3]);
+}
+
+internal inline uint32_t smf_read_u16(const uint8_t *at)
+{
+    return(((uint32_t) at[0] << 8) | (uint32_t) at[1]);
+}
+
+// @Note: At most 4 bytes of 7 bits, false if it runs off the end.
+internal inline bool smf_read_varlen(const uint8_t **at, const uint8_t *end, uint32_t *value)
+{
+    uint32_t result = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        if (*at >= end) return(false);
+
+        uint8_t byte = *(*at)++;
+        result = (result << 7) | (byte & 0x7F);
+
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return(true);
+        }
+    }
+
+    return(false);
+}
+
+// @Note: Decodes the track's next event we care about into 'track->event'.
+internal inline void smf_track_advance(Smf *smf, Smf_Track *track)
+{
+    track->pending = false;
+
+    while (track->at < track->end) {
+        uint32_t delta = 0;
+        if (!smf_read_varlen(&track->at, track->end, &delta) || track->at >= track->end) break;
+        track->tick += delta;
+
+        uint8_t status = *track->at;
+        if (status & 0x80) {
+            track->at += 1;
+        } else if (track->running_status) {
+            status = track->running_status;
+        } else {
+            break;
+        }
+
+        if (status < 0xF0) {
+            uint8_t kind = status & 0xF0;
+            ptrdiff_t len = (kind == PROGRAM_CHANGE || kind == 0xD0) ? 1 : 2;
+            if (track->end - track->at < len) break;
+
+            uint32_t packed = status | ((uint32_t) (track->at[0] & 0x7F) << 8);
+            if (len == 2) packed |= (uint32_t) (track->at[1] & 0x7F) << 16;
+
+            track->at += len;
+            track->running_status = status;
+
+            track->event.tick = track->tick;
+            track->event.data = packed;
+            track->event.type = SMF_EVENT_MIDI;
+            track->pending = true;
+            return;
+        }
+
+        // @Note: SysEx and meta events cancel running status.
+        track->running_status = 0;
+
+        if (status == 0xF0 || status == 0xF7) {
+            uint32_t len = 0;
+            if (!smf_read_varlen(&track->at, track->end, &len) || (uint32_t) (track->end - track->at) < len) break;
+            track->at += len;
+        } else if (status == 0xFF) {
+            if (track->at >= track->end) break;
+            uint8_t type = *track->at++;
+
+            uint32_t len = 0;
+            if (!smf_read_varlen(&track->at, track->end, &len) || (uint32_t) (track->end - track->at) < len) break;
+
+            const uint8_t *data = track->at;
+            track->at += len;
+
+            if (type == 0x2F) {
+                track->at = track->end;
+                return;
+            }
+
+            if (type == 0x51 && len == 3) {
+                track->event.tick = track->tick;
+                track->event.data = ((uint32_t) data[0] << 16) | ((uint32_t) data[1] << 8) | (uint32_t) data[2];
+                track->event.type = SMF_EVENT_TEMPO;
+                track->pending = true;
+                return;
+            }
+        } else {
+            break;
+        }
+    }
+
+    // @Note: Something didn't parse, the track ends here.
+    if (track->at < track->end) {
+        smf->broken = true;
+        track->at = track->end;
+    }
+}
+
+internal inline bool smf_open(Smf *smf, const uint8_t *data, size_t size)
+{
+    memset(smf, 0, sizeof(*smf));
+    smf->tempo = SMF_DEFAULT_TEMPO;
+
+    if (size < 14 || memcmp(data, "MThd", 4) != 0) return(false);
+
+    uint32_t header_len = smf_read_u32(data + 4);
+    if (header_len < 6 || header_len > size - 8) return(false);
+
+    smf->format = (int) smf_read_u16(data + 8);
+    uint32_t division = smf_read_u16(data + 12);
+
+    if (division & 0x8000) {
+        // @Note: SMPTE, negative frames per second in the high byte, ticks per frame in the low one.
+        int fps = 256 - (int) (division >> 8);
+        smf->division = fps*(int) (division & 0xFF);
+        smf->smpte = true;
+    } else {
+        smf->division = (int) division;
+    }
+
+    if (smf->division <= 0) return(false);
+
+    const uint8_t *at = data + 8 + header_len;
+    const uint8_t *end = data + size;
+
+    while (end - at >= 8) {
+        uint32_t chunk_len = smf_read_u32(at + 4);
+        const uint8_t *chunk = at + 8;
+
+        if (chunk_len > (uint32_t) (end - chunk)) {
+            chunk_len = (uint32_t) (end - chunk);
+            smf->broken = true;
+        }
+
+        if (memcmp(at, "MTrk", 4) == 0) {
+            if (smf->tracks_len < SMF_TRACKS_CAP) {
+                Smf_Track *track = &smf->tracks[smf->tracks_len];
+                track->at = chunk;
+                track->end = chunk + chunk_len;
+                track->event.track = (uint8_t) smf->tracks_len;
+
+                smf->tracks_len += 1;
+                smf_track_advance(smf, track);
+            } else {
+                smf->tracks_skipped += 1;
+            }
+        }
+
+        at = chunk + chunk_len;
+    }
+
+    return(smf->tracks_len > 0);
+}
+
+internal inline uint64_t smf_tick_to_ns(const Smf *smf, uint64_t tick)
+{
+    if (smf->smpte) return(tick*1000000000ull/(uint64_t) smf->division);
+
+    return(smf->tempo_ns + (tick - smf->tempo_tick)*smf->tempo*1000ull/(uint64_t) smf->division);
+}
+
+// @Note: Earliest event across all tracks, the lower track wins a tie, so a
+// tempo change in the conductor track applies to everything on its tick.
+internal inline bool smf_next(Smf *smf, Smf_Event *event)
+{
+    Smf_Track *next = 0;
+
+    for (int i = 0; i < smf->tracks_len; ++i) {
+        Smf_Track *track = &smf->tracks[i];
+        if (track->pending && (next == 0 || track->event.tick < next->event.tick)) next = track;
+    }
+
+    if (next == 0) return(false);
+
+    *event = next->event;
+    event->time_ns = smf_tick_to_ns(smf, event->tick);
+
+    if (event->type == SMF_EVENT_TEMPO && event->data > 0) {
+        smf->tempo_ns = event->time_ns;
+        smf->tempo_tick = event->tick;
+        smf->tempo = event->data;
+    }
+
+    smf_track_advance(smf, next);
+    return(true);
+}
+
+#endif // SMF_H
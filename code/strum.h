@@ -0,0 +1,116 @@
+#ifndef STRUM_H
+#define STRUM_H
+
+// @Note: Chord strumming. NOTE_ONs that land within 'window_ms' of the first
+// one are treated as a chord and spread out 'offset_ms' apart, because the
+// game only picks up some of the keys when they all arrive at once.
+//
+// - STRUM_PLAYED keeps the order they came in. The first note goes out right
+//   away, so a single note never waits on the window.
+// - STRUM_UP/STRUM_DOWN need to see the whole chord before sorting it, so the
+//   notes are held until the window closes. That's 'window_ms' of latency on
+//   every note, only pick these when that's acceptable.
+
+#define STRUM_NOTES_LEN 16
+
+enum Strum_Direction {
+    STRUM_PLAYED = 0,
+    STRUM_UP,
+    STRUM_DOWN,
+    STRUM_DIRECTION_COUNT,
+};
+
+global const char *const strum_direction_names[STRUM_DIRECTION_COUNT] = { "Played", "Up", "Down" };
+
+struct Strum_Settings {
+    int window_ms; // @Note: 0 turns strumming off.
+    int offset_ms;
+    int direction;
+};
+
+struct Strum_Note {
+    uint64_t time_ns;
+    uint16_t key;
+    uint8_t note;
+};
+
+struct Strum {
+    bool open;
+    uint64_t start_ns;
+    uint64_t deadline_ns;
+    
+    uint32_t count; // @Note: How many notes the open chord has had so far.
+    Strum_Note held[STRUM_NOTES_LEN];
+    uint32_t held_len;
+};
+
+internal inline uint64_t strum_deadline(const Strum *strum)
+{
+    if (!strum->open || strum->held_len == 0) return(UINT64_MAX);
+
+    return(strum->deadline_ns);
+}
+
+// @Note: Closes the current chord. Returns how many held notes were written
+// to 'out', already sorted and with the time each one should go out at.
+internal inline size_t strum_flush(Strum *strum, const Strum_Settings *settings, Strum_Note *out)
+{
+    size_t len = strum->held_len;
+
+    // @Note: Insertion sort, there's at most STRUM_NOTES_LEN of them.
+    for (size_t i = 0; i < len; ++i) {
+        Strum_Note note = strum->held[i];
+        size_t j = i;
+        
+        while (j > 0 && (settings->direction == STRUM_DOWN ? out[j - 1].note < note.note : out[j - 1].note > note.note)) {
+            out[j] = out[j - 1];
+            j -= 1;
+        }
+        
+        out[j] = note;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        out[i].time_ns = strum->deadline_ns + i*settings->offset_ms*1000000ull;
+    }
+
+    strum->open = false;
+    strum->held_len = 0;
+    strum->count = 0;
+    
+    return(len);
+}
+
+// @Note: Returns true when the note should be scheduled right away at
+// 'due_ns', false when it's been held for the next 'strum_flush()'.
+internal inline bool strum_add(Strum *strum, const Strum_Settings *settings, uint8_t note, uint16_t key, uint64_t time_ns, uint64_t *due_ns)
+{
+    *due_ns = time_ns;
+    if (settings->window_ms <= 0) return(true);
+
+    bool in_chord = strum->open && time_ns < strum->start_ns + settings->window_ms*1000000ull;
+    if (!in_chord) {
+        strum->open = true;
+        strum->start_ns = time_ns;
+        strum->deadline_ns = time_ns + settings->window_ms*1000000ull;
+        strum->count = 0;
+    }
+    
+    if (settings->direction == STRUM_PLAYED || strum->held_len == STRUM_NOTES_LEN) {
+        uint64_t strummed_ns = strum->start_ns + strum->count*settings->offset_ms*1000000ull;
+        if (strummed_ns > time_ns) *due_ns = strummed_ns;
+
+        strum->count += 1;
+        return(true);
+    }
+
+    Strum_Note *held = &strum->held[strum->held_len++];
+    held->time_ns = time_ns;
+    held->key = key;
+    held->note = note;
+    strum->count += 1;
+    
+    return(false);
+}
+
+#endif // STRUM_H
@@ -0,0 +1,673 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+// @Note: A song compiled ahead of time into exactly the key events it turns
+// into. The MIDI file goes through the same pipeline live input does
+// (reduced to one voice if asked, transposed and moved into the keyboard's
+// range first, see voice.h and octave.h), but in virtual time, so strumming,
+// pacing and modifier sequencing are all baked in and replaying it is
+// nothing but "send record n at start + time_ns". That's as deterministic as
+// timing gets, the injection thread does no work per event but the
+// SendInput itself (see 'Timeline_Player').
+//
+// File layout: a Timeline_File_Header, then 'count' records sorted by time.
+// It's meant to be mapped and used in place.
+
+#define TIMELINE_MAGIC 0x4E4C544D // @Note: "MTLN"
+#define TIMELINE_VERSION 1
+
+// @Note: Where the compiler's virtual clock starts, nothing in the pipeline
+// expects to see time 0. Record times are relative to it.
+#define TIMELINE_EPOCH_NS 1000000000ull
+
+struct Timeline_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t duration_ns; // @Note: Until the song's last event, which can be after the last key event.
+};
+
+struct Timeline_Record {
+    uint64_t time_ns; // @Note: Since the start of the song.
+    uint16_t vk;
+    uint8_t flags; // @Note: KEY_EVENT_UP.
+    int8_t lane; // @Note: Keyboard index the key plays, -1 for modifiers.
+    uint32_t reserved;
+};
+
+struct Timeline {
+    Timeline_Record *records;
+    size_t count;
+    size_t cap;
+    uint64_t duration_ns;
+};
+
+// @Note: What happens to notes outside the keyboard.
+enum Octave_Mode {
+    OCTAVE_MODE_NONE = 0, // @Note: Nothing, they're dropped.
+    OCTAVE_MODE_FOLD, // @Note: Each one is moved by octaves until it fits.
+    OCTAVE_MODE_BEST, // @Note: Whole song at once, see octave.h.
+    OCTAVE_MODE_COUNT,
+};
+
+global const char *const octave_mode_names[OCTAVE_MODE_COUNT] = { "none", "fold", "best" };
+
+struct Timeline_Options {
+    Pipeline_Settings settings;
+    int transpose; // @Note: Semitones.
+    int octaves; // @Note: Octave_Mode.
+    int voice; // @Note: Voice_Mode, see voice.h.
+    int voice_track; // @Note: For VOICE_TRACK, counting from 0.
+};
+
+internal inline Timeline_Options default_timeline_options()
+{
+    Timeline_Options options = {};
+    options.settings = default_pipeline_settings();
+    options.octaves = OCTAVE_MODE_BEST;
+
+    return(options);
+}
+
+internal inline void timeline_free(Timeline *timeline)
+{
+    free(timeline->records);
+    memset(timeline, 0, sizeof(*timeline));
+}
+
+internal inline bool timeline_push(Timeline *timeline, const Key_Event *event, uint64_t time_ns)
+{
+    if (timeline->count == timeline->cap) {
+        size_t cap = timeline->cap ? timeline->cap*2 : 1024;
+        Timeline_Record *records = (Timeline_Record *) realloc(timeline->records, cap*sizeof(Timeline_Record));
+        if (records == 0) return(false);
+
+        timeline->records = records;
+        timeline->cap = cap;
+    }
+
+    Timeline_Record *record = &timeline->records[timeline->count++];
+    record->time_ns = time_ns;
+    record->vk = event->vk;
+    record->flags = (uint8_t) event->flags;
+    record->lane = event->lane;
+    record->reserved = 0;
+
+    return(true);
+}
+
+internal inline int timeline_clamp_note(int note)
+{
+    if (note < 0) return(0);
+    if (note > 127) return(127);
+
+    return(note);
+}
+
+// @Note: How long every note on in the file lasts, in file order, for
+// VOICE_LONGEST. A note that's struck again before it's let go ends there, one
+// that's never let go lasts until the end of the song.
+internal inline bool timeline_collect_durations(const uint8_t *data, size_t size, uint64_t **durations, size_t *count)
+{
+    Smf *smf = (Smf *) malloc(sizeof(Smf));
+    bool result = smf && smf_open(smf, data, size);
+    size_t cap = 0;
+    size_t open[16][128] = {}; // @Note: Index + 1 of the note on that's still sounding.
+    uint64_t starts[16][128] = {};
+    uint64_t end_ns = 0;
+
+    *durations = 0;
+    *count = 0;
+
+    Smf_Event event = {0};
+    while (result && smf_next(smf, &event)) {
+        Midi_Message message = midi_decode(event.data);
+        end_ns = event.time_ns;
+        if (event.type != SMF_EVENT_MIDI || (message.status != NOTE_ON && message.status != NOTE_OFF)) continue;
+
+        size_t *slot = &open[message.channel][message.note];
+        uint64_t *start = &starts[message.channel][message.note];
+        if (*slot) {
+            (*durations)[*slot - 1] = event.time_ns - *start;
+            *slot = 0;
+        }
+        if (message.status == NOTE_OFF) continue;
+
+        if (*count == cap) {
+            cap = cap ? cap*2 : 1024;
+            uint64_t *grown = (uint64_t *) realloc(*durations, cap*sizeof(uint64_t));
+            if (grown == 0) {
+                result = false;
+                break;
+            }
+            *durations = grown;
+        }
+
+        (*durations)[*count] = 0;
+        *slot = ++*count;
+        *start = event.time_ns;
+    }
+
+    for (int channel = 0; result && channel < 16; ++channel) {
+        for (int note = 0; note < 128; ++note) {
+            if (open[channel][note]) (*durations)[open[channel][note] - 1] = end_ns - starts[channel][note];
+        }
+    }
+
+    free(smf);
+    if (!result) {
+        free(*durations);
+        *durations = 0;
+        *count = 0;
+    }
+
+    return(result);
+}
+
+// @Note: The file's MIDI events in order as the compiler sees them, that is
+// reduced to one voice if 'options' asks for it (see voice.h). Tempo changes
+// are already in the times, they don't come out.
+struct Timeline_Source {
+    Smf smf;
+    Voice_Reducer voice;
+    const uint64_t *durations; // @Note: Per note on in the file, only for VOICE_LONGEST.
+    size_t durations_len;
+    size_t note_ons;
+
+    Voice_Out out[VOICE_OUT_LEN];
+    int out_len;
+    int out_at;
+    bool done;
+};
+
+internal inline bool timeline_source_open(Timeline_Source *source, const uint8_t *data, size_t size,
+                                          const Timeline_Options *options, const uint64_t *durations, size_t durations_len)
+{
+    memset(source, 0, sizeof(*source));
+    voice_init(&source->voice, options->voice, options->voice_track);
+    source->durations = durations;
+    source->durations_len = durations_len;
+
+    return(smf_open(&source->smf, data, size));
+}
+
+internal inline bool timeline_source_next(Timeline_Source *source, Voice_Out *event)
+{
+    while (source->out_at == source->out_len) {
+        if (source->done) return(false);
+
+        source->out_at = 0;
+        Smf_Event smf_event = {0};
+        if (!smf_next(&source->smf, &smf_event)) {
+            source->out_len = voice_flush(&source->voice, source->out);
+            source->done = true;
+            continue;
+        }
+        if (smf_event.type != SMF_EVENT_MIDI) {
+            source->out_len = 0;
+            continue;
+        }
+
+        Midi_Message message = midi_decode(smf_event.data);
+        Voice_Note note = {0};
+        note.note = message.note;
+        note.velocity = message.velocity;
+        note.channel = message.channel;
+        note.track = smf_event.track;
+        if (message.status == NOTE_ON) {
+            if (source->note_ons < source->durations_len) note.duration_ns = source->durations[source->note_ons];
+            source->note_ons += 1;
+        }
+
+        source->out_len = voice_push(&source->voice, smf_event.time_ns, smf_event.data, &note, source->out);
+    }
+
+    *event = source->out[source->out_at++];
+    return(true);
+}
+
+// @Note: Sets up 'source' for 'options', with the extra pass VOICE_LONGEST
+// needs. 'durations' is the caller's to free once it's done with the source.
+internal inline bool timeline_source_prepare(Timeline_Source *source, const uint8_t *data, size_t size,
+                                             const Timeline_Options *options, uint64_t **durations)
+{
+    size_t durations_len = 0;
+    *durations = 0;
+
+    if (options->voice == VOICE_LONGEST && !timeline_collect_durations(data, size, durations, &durations_len)) return(false);
+
+    return(timeline_source_open(source, data, size, options, *durations, durations_len));
+}
+
+// @Note: Every note on the compiler will see, transposed, in order.
+internal inline bool timeline_collect_notes(const uint8_t *data, size_t size, const Timeline_Options *options,
+                                            Octave_Note **notes, size_t *count)
+{
+    Timeline_Source *source = (Timeline_Source *) malloc(sizeof(Timeline_Source));
+    uint64_t *durations = 0;
+    bool result = source && timeline_source_prepare(source, data, size, options, &durations);
+    size_t cap = 0;
+
+    *notes = 0;
+    *count = 0;
+
+    Voice_Out event = {0};
+    while (result && timeline_source_next(source, &event)) {
+        Midi_Message message = midi_decode(event.packed);
+        if (message.status != NOTE_ON) continue;
+
+        if (*count == cap) {
+            cap = cap ? cap*2 : 1024;
+            Octave_Note *grown = (Octave_Note *) realloc(*notes, cap*sizeof(Octave_Note));
+            if (grown == 0) {
+                result = false;
+                break;
+            }
+            *notes = grown;
+        }
+
+        Octave_Note *note = &(*notes)[(*count)++];
+        note->note = (uint8_t) timeline_clamp_note(message.note + options->transpose);
+        note->velocity = message.velocity;
+    }
+
+    free(durations);
+    free(source);
+    return(result);
+}
+
+// @Note: One shift (in octaves) per note on, 0 when 'options' doesn't ask for the whole song to be planned.
+internal inline bool timeline_plan_octaves(const uint8_t *data, size_t size, const Mapping_Table *table,
+                                           const Timeline_Options *options, int8_t **shifts)
+{
+    *shifts = 0;
+    if (options->octaves != OCTAVE_MODE_BEST) return(true);
+
+    Octave_Note *notes = 0;
+    size_t count = 0;
+    bool result = timeline_collect_notes(data, size, options, &notes, &count);
+
+    if (result) {
+        *shifts = (int8_t *) malloc(count + 1);
+        result = *shifts && octave_assign(notes, count, table, *shifts);
+    }
+
+    free(notes);
+    if (!result) {
+        free(*shifts);
+        *shifts = 0;
+    }
+
+    return(result);
+}
+
+// @Note: Transposes and shifts notes, everything else goes through as is. A
+// note off is moved however its note on was, 'note_shifts' remembers that per
+// channel and note.
+internal inline uint32_t timeline_map_note(uint32_t packed, const Timeline_Options *options, const int8_t *plan,
+                                           size_t *note_ons, int8_t note_shifts[16][128])
+{
+    Midi_Message message = midi_decode(packed);
+    if (message.status != NOTE_ON && message.status != NOTE_OFF) return(packed);
+
+    int note = timeline_clamp_note(message.note + options->transpose);
+    int8_t *shift = &note_shifts[message.channel][message.note];
+
+    if (message.status == NOTE_ON) {
+        *shift = 0;
+
+        if (options->octaves == OCTAVE_MODE_BEST && plan) {
+            *shift = plan[*note_ons];
+        } else if (options->octaves == OCTAVE_MODE_FOLD) {
+            while (note + *shift*12 < NOTE_OFFSET) *shift += 1;
+            while (note + *shift*12 >= NOTE_OFFSET + MIDI_FULL_LEN) *shift -= 1;
+        }
+
+        *note_ons += 1;
+    }
+
+    note = timeline_clamp_note(note + *shift*12);
+    return((packed & ~0xFF00u) | ((uint32_t) note << 8));
+}
+
+// @Note: Runs the whole file through a private pipeline. It's driven like
+// the injection thread drives the live one, except it never sleeps, the
+// clock just jumps to whatever comes next. False if the file isn't a MIDI
+// file or we ran out of memory, 'timeline' is empty then.
+internal inline bool timeline_compile(const uint8_t *data, size_t size, const Mapping_Table *table,
+                                      const Timeline_Options *options, Timeline *timeline)
+{
+    memset(timeline, 0, sizeof(*timeline));
+
+    Timeline_Source *source = (Timeline_Source *) malloc(sizeof(Timeline_Source));
+    Pipeline *pipeline = new Pipeline();
+    int8_t *plan = 0;
+    uint64_t *durations = 0;
+    bool result = source && timeline_source_prepare(source, data, size, options, &durations) &&
+                  timeline_plan_octaves(data, size, table, options, &plan);
+
+    if (result) {
+        pipeline_init(pipeline, TIMELINE_EPOCH_NS);
+
+        int8_t note_shifts[16][128] = {};
+        size_t note_ons = 0;
+
+        Voice_Out event = {0};
+        bool pending = timeline_source_next(source, &event);
+        uint64_t now_ns = TIMELINE_EPOCH_NS;
+        uint64_t last_ns = 0;
+
+        while (result) {
+            uint64_t input_ns = pending ? TIMELINE_EPOCH_NS + event.time_ns : UINT64_MAX;
+            uint64_t due_ns = pipeline_next_due(pipeline, &options->settings);
+            uint64_t wake_ns = input_ns < due_ns ? input_ns : due_ns;
+            if (wake_ns == UINT64_MAX) break;
+
+            // @Note: The wheel only knows its tick, nudge forward so we can't get stuck on one.
+            now_ns = wake_ns > now_ns ? wake_ns : now_ns + TIMER_WHEEL_TICK_NS;
+
+            while (pending && TIMELINE_EPOCH_NS + event.time_ns <= now_ns) {
+                Midi_Event midi = {0};
+                midi.time_ns = TIMELINE_EPOCH_NS + event.time_ns;
+                midi.packed = timeline_map_note(event.packed, options, plan, &note_ons, note_shifts);
+
+                pipeline_process(pipeline, table, &options->settings, &midi);
+                last_ns = event.time_ns;
+
+                pending = timeline_source_next(source, &event);
+            }
+
+            pipeline_update(pipeline, &options->settings, now_ns);
+
+            // @Note: The wheel hands events out a tick late, the timeline gets when they were
+            // actually due (plus whatever pacing added), not when we got around to them.
+            Key_Event key = {0};
+            while (result && pipeline_pop_due(pipeline, &options->settings, now_ns, &key)) {
+                uint64_t sent_ns = key.time_ns;
+                if (options->settings.key_gap_ms > 0) sent_ns += pipeline->pacer.last_delay_ns;
+
+                result = timeline_push(timeline, &key, sent_ns - TIMELINE_EPOCH_NS);
+            }
+        }
+
+        timeline->duration_ns = last_ns;
+        if (timeline->count > 0 && timeline->records[timeline->count - 1].time_ns > last_ns) {
+            timeline->duration_ns = timeline->records[timeline->count - 1].time_ns;
+        }
+    }
+
+    delete pipeline;
+    free(plan);
+    free(durations);
+    free(source);
+
+    if (!result) timeline_free(timeline);
+    return(result);
+}
+
+internal inline bool timeline_write(const Timeline *timeline, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) return(false);
+
+    Timeline_File_Header header = {0};
+    header.magic = TIMELINE_MAGIC;
+    header.version = TIMELINE_VERSION;
+    header.record_size = sizeof(Timeline_Record);
+    header.count = timeline->count;
+    header.duration_ns = timeline->duration_ns;
+
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  (timeline->count == 0 || fwrite(timeline->records, sizeof(Timeline_Record), timeline->count, file) == timeline->count);
+
+    return(fclose(file) == 0 && result);
+}
+
+// @Note: Points 'records' into a file that's already in memory, false if it isn't a timeline we can read.
+internal inline bool timeline_view(const void *data, size_t size, const Timeline_Record **records, size_t *count, uint64_t *duration_ns)
+{
+    if (size < sizeof(Timeline_File_Header)) return(false);
+
+    const Timeline_File_Header *header = (const Timeline_File_Header *) data;
+    if (header->magic != TIMELINE_MAGIC || header->version != TIMELINE_VERSION || header->record_size != sizeof(Timeline_Record)) return(false);
+    if (header->count > (size - sizeof(Timeline_File_Header))/sizeof(Timeline_Record)) return(false);
+
+    *records = (const Timeline_Record *) (header + 1);
+    *count = (size_t) header->count;
+    *duration_ns = header->duration_ns;
+
+    return(true);
+}
+
+// @Note: Seeking means knowing which keys are down at that point, and the
+// only way to know is to go through the records before it. A checkpoint
+// keeps that every TIMELINE_CHECKPOINT_RECORDS records, so a seek is a binary
+// search for the one before the target plus at most that many records
+// replayed (without sending anything). Tempo is already in the record times
+// and modifiers are just keys, so held keys are all the state there is.
+#define TIMELINE_CHECKPOINT_RECORDS 256
+
+enum Timeline_Key_State {
+    TIMELINE_KEY_UP = 0,
+    TIMELINE_KEY_DOWN,
+    TIMELINE_KEY_MODIFIER, // @Note: Down, and it's a modifier or control key (lane -1).
+};
+
+struct Timeline_Checkpoint {
+    uint64_t time_ns; // @Note: Of records[cursor].
+    size_t cursor;
+    uint32_t down[8]; // @Note: Bit per vk, before records[cursor].
+    uint32_t modifiers[8];
+};
+
+internal inline void timeline_apply(uint8_t keys[256], const Timeline_Record *record)
+{
+    uint8_t down = record->lane < 0 ? TIMELINE_KEY_MODIFIER : TIMELINE_KEY_DOWN;
+    keys[record->vk & 0xFF] = (record->flags & KEY_EVENT_UP) ? (uint8_t) TIMELINE_KEY_UP : down;
+}
+
+// @Note: One checkpoint per TIMELINE_CHECKPOINT_RECORDS records, the first one at record 0.
+internal inline bool timeline_build_checkpoints(const Timeline_Record *records, size_t count,
+                                                Timeline_Checkpoint **checkpoints, size_t *checkpoints_len)
+{
+    size_t len = count/TIMELINE_CHECKPOINT_RECORDS + 1;
+    *checkpoints = (Timeline_Checkpoint *) malloc(len*sizeof(Timeline_Checkpoint));
+    *checkpoints_len = 0;
+    if (*checkpoints == 0) return(false);
+
+    uint8_t keys[256] = {0};
+    for (size_t cursor = 0; cursor < count || *checkpoints_len == 0; ++cursor) {
+        if (cursor % TIMELINE_CHECKPOINT_RECORDS == 0) {
+            Timeline_Checkpoint *checkpoint = &(*checkpoints)[(*checkpoints_len)++];
+            memset(checkpoint, 0, sizeof(*checkpoint));
+            checkpoint->time_ns = cursor < count ? records[cursor].time_ns : 0;
+            checkpoint->cursor = cursor;
+
+            for (int vk = 0; vk < 256; ++vk) {
+                if (keys[vk] != TIMELINE_KEY_UP) checkpoint->down[vk >> 5] |= 1u << (vk & 31);
+                if (keys[vk] == TIMELINE_KEY_MODIFIER) checkpoint->modifiers[vk >> 5] |= 1u << (vk & 31);
+            }
+        }
+
+        if (cursor < count) timeline_apply(keys, &records[cursor]);
+    }
+
+    return(true);
+}
+
+// @Note: The first record at or after 'time_ns', with which keys are down right before it in 'keys'.
+internal inline size_t timeline_seek(const Timeline_Record *records, size_t count, const Timeline_Checkpoint *checkpoints,
+                                     size_t checkpoints_len, uint64_t time_ns, uint8_t keys[256])
+{
+    memset(keys, 0, 256);
+    if (checkpoints_len == 0) return(0);
+
+    // @Note: Last checkpoint before 'time_ns', strictly, records on the same
+    // time can straddle one. The first one is always empty and at record 0.
+    size_t low = 0;
+    size_t high = checkpoints_len;
+    while (high - low > 1) {
+        size_t middle = low + (high - low)/2;
+        if (checkpoints[middle].time_ns < time_ns) low = middle;
+        else high = middle;
+    }
+
+    const Timeline_Checkpoint *checkpoint = &checkpoints[low];
+    for (int vk = 0; vk < 256; ++vk) {
+        if ((checkpoint->down[vk >> 5] >> (vk & 31)) & 1) {
+            keys[vk] = ((checkpoint->modifiers[vk >> 5] >> (vk & 31)) & 1) ? TIMELINE_KEY_MODIFIER : TIMELINE_KEY_DOWN;
+        }
+    }
+
+    size_t cursor = checkpoint->cursor;
+    while (cursor < count && records[cursor].time_ns < time_ns) timeline_apply(keys, &records[cursor++]);
+
+    return(cursor);
+}
+
+// @Note: Replays a timeline, owned by whichever thread sends the keys.
+// It remembers which keys it has down so stopping halfway can let go of them,
+// and so a seek can take them from whatever's down to whatever should be.
+// With 'loop_end_ns' set it jumps back to 'loop_start_ns' when it gets
+// there, the song clock just moves on by the length of the loop.
+struct Timeline_Player {
+    const Timeline_Record *records;
+    size_t count;
+    size_t cursor;
+    uint64_t start_ns;
+    uint8_t held[256]; // @Note: Timeline_Key_State.
+
+    const Timeline_Checkpoint *checkpoints;
+    size_t checkpoints_len;
+    uint64_t loop_start_ns;
+    uint64_t loop_end_ns; // @Note: 0 for no loop.
+
+    bool resyncing; // @Note: 'target' is what 'held' should become before the next record.
+    uint64_t resync_ns;
+    uint8_t target[256];
+};
+
+internal inline void timeline_player_start(Timeline_Player *player, const Timeline_Record *records, size_t count,
+                                           const Timeline_Checkpoint *checkpoints, size_t checkpoints_len, uint64_t start_ns)
+{
+    memset(player, 0, sizeof(*player));
+    player->records = records;
+    player->count = count;
+    player->checkpoints = checkpoints;
+    player->checkpoints_len = checkpoints_len;
+    player->start_ns = start_ns;
+}
+
+internal inline bool timeline_player_looping(const Timeline_Player *player)
+{
+    return(player->loop_end_ns > player->loop_start_ns);
+}
+
+internal inline bool timeline_player_done(const Timeline_Player *player)
+{
+    return(!timeline_player_looping(player) && !player->resyncing && player->cursor >= player->count);
+}
+
+// @Note: Song time 'time_ns' plays at 'at_ns', whatever was down gets
+// fixed up first (see 'timeline_player_pop_due()').
+internal inline void timeline_player_seek(Timeline_Player *player, uint64_t time_ns, uint64_t at_ns)
+{
+    player->cursor = timeline_seek(player->records, player->count, player->checkpoints, player->checkpoints_len, time_ns, player->target);
+    player->start_ns = at_ns - time_ns;
+    player->resync_ns = at_ns;
+    player->resyncing = true;
+}
+
+// @Note: Loops from 'start_ns' to 'end_ns' of the song, 'end_ns' 0 stops looping.
+internal inline void timeline_player_loop(Timeline_Player *player, uint64_t start_ns, uint64_t end_ns)
+{
+    player->loop_start_ns = start_ns;
+    player->loop_end_ns = end_ns;
+}
+
+internal inline bool timeline_player_at_loop_end(const Timeline_Player *player)
+{
+    if (!timeline_player_looping(player)) return(false);
+
+    return(player->cursor >= player->count || player->records[player->cursor].time_ns >= player->loop_end_ns);
+}
+
+internal inline uint64_t timeline_player_next_due(const Timeline_Player *player)
+{
+    if (player->resyncing) return(player->resync_ns);
+    if (timeline_player_at_loop_end(player)) return(player->start_ns + player->loop_end_ns);
+    if (player->cursor >= player->count) return(UINT64_MAX);
+
+    return(player->start_ns + player->records[player->cursor].time_ns);
+}
+
+// @Note: Key ups before key downs, and modifiers go down before the keys
+// that need them and come up after, same as the pipeline sends them.
+internal inline bool timeline_player_resync(Timeline_Player *player, Key_Event *event)
+{
+    const uint8_t passes[4][2] = {
+        { TIMELINE_KEY_DOWN, TIMELINE_KEY_UP },
+        { TIMELINE_KEY_MODIFIER, TIMELINE_KEY_UP },
+        { TIMELINE_KEY_UP, TIMELINE_KEY_MODIFIER },
+        { TIMELINE_KEY_UP, TIMELINE_KEY_DOWN },
+    };
+
+    for (int pass = 0; pass < 4; ++pass) {
+        for (int vk = 0; vk < 256; ++vk) {
+            if (player->held[vk] != passes[pass][0] || player->target[vk] != passes[pass][1]) continue;
+
+            player->held[vk] = player->target[vk];
+            event->time_ns = player->resync_ns;
+            event->vk = (uint16_t) vk;
+            event->flags = player->target[vk] == TIMELINE_KEY_UP ? KEY_EVENT_UP : 0;
+            event->lane = -1;
+
+            return(true);
+        }
+    }
+
+    // @Note: The same key down as something else (a modifier pressed as a plain key), nothing to send.
+    memcpy(player->held, player->target, sizeof(player->held));
+    player->resyncing = false;
+
+    return(false);
+}
+
+internal inline bool timeline_player_pop_due(Timeline_Player *player, uint64_t now_ns, Key_Event *event)
+{
+    if (timeline_player_next_due(player) > now_ns) return(false);
+
+    // @Note: The loop's end is exact, the next time around starts right where this one ends.
+    if (!player->resyncing && timeline_player_at_loop_end(player)) {
+        timeline_player_seek(player, player->loop_start_ns, player->start_ns + player->loop_end_ns);
+    }
+
+    if (player->resyncing) {
+        if (timeline_player_resync(player, event)) return(true);
+        if (timeline_player_next_due(player) > now_ns) return(false);
+        if (timeline_player_at_loop_end(player)) return(false); // @Note: An empty loop, wait for the next turn.
+    }
+
+    const Timeline_Record *record = &player->records[player->cursor++];
+    event->time_ns = player->start_ns + record->time_ns;
+    event->vk = record->vk;
+    event->flags = record->flags;
+    event->lane = record->lane;
+
+    timeline_apply(player->held, record);
+    return(true);
+}
+
+// @Note: Key up for one key that's still down, call until it returns false.
+internal inline bool timeline_player_release(Timeline_Player *player, Key_Event *event)
+{
+    memset(player->target, 0, sizeof(player->target));
+    player->resync_ns = 0;
+    player->resyncing = true;
+
+    return(timeline_player_resync(player, event));
+}
+
+#endif // TIMELINE_H
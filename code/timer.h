@@ -0,0 +1,14 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <chrono>
+
+// @Note: steady_clock is QueryPerformanceCounter on MSVC and CLOCK_MONOTONIC
+// everywhere else, so this is the one clock everything in the pipeline agrees on.
+internal inline uint64_t get_time_ns()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+#endif // TIMER_H
@@ -0,0 +1,351 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// @Note: Hierarchical timer wheel for every key event that has to go out at
+// some point in the future. Owned by the injection thread, so nothing in here
+// is thread safe.
+//
+// 4 levels of 64 slots with a 250us tick cover ~70 minutes, anything further
+// out sits in the last level and gets re-sorted each time it cascades. Inserting
+// and cancelling are O(1), nodes come from a fixed pool and lists are linked by
+// index, so nothing is ever allocated after startup.
+//
+// Expired nodes move to the 'ready' list, which is kept sorted by (time, seq)
+// so events that are due at the same time still go out in the order they were
+// inserted (a key down before its key up). It's short and new nodes almost
+// always go at the end, so keeping it sorted is cheap.
+
+#define TIMER_WHEEL_TICK_NS 250000ull
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_NODES_LEN 4096
+#define TIMER_WHEEL_NIL 0xFFFFFFFFu
+#define TIMER_WHEEL_READY_LIST (TIMER_WHEEL_LEVELS*TIMER_WHEEL_SLOTS)
+#define TIMER_WHEEL_LISTS_LEN (TIMER_WHEEL_READY_LIST + 1)
+
+#define KEY_EVENT_UP 0x1
+
+struct Key_Event {
+    uint64_t time_ns;
+    uint16_t vk;
+    uint16_t flags;
+    int8_t lane; // @Note: Keyboard index of the note it plays, -1 for modifiers and control keys.
+};
+
+// @Note: How many slots after 'position' the next occupied one is (1..64),
+// 'occupied' can't be 0.
+internal inline uint64_t timer_wheel_slots_until(uint64_t occupied, uint64_t position)
+{
+    uint32_t shift = (uint32_t) ((position + 1) & (TIMER_WHEEL_SLOTS - 1));
+    uint64_t rotated = shift ? (occupied >> shift) | (occupied << (64 - shift)) : occupied;
+
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward64(&index, rotated);
+#else
+    uint64_t index = (uint64_t) __builtin_ctzll(rotated);
+#endif
+    
+    return((uint64_t) index + 1);
+}
+
+struct Timer_Handle {
+    uint32_t index;
+    uint32_t generation;
+};
+
+struct Timer_Node {
+    Key_Event event;
+    uint32_t next;
+    uint32_t prev;
+    uint32_t seq;
+    uint16_t list;
+    uint16_t generation;
+};
+
+struct Timer_List {
+    uint32_t head;
+    uint32_t tail;
+};
+
+struct Timer_Wheel {
+    Timer_Node nodes[TIMER_WHEEL_NODES_LEN];
+    Timer_List lists[TIMER_WHEEL_LISTS_LEN];
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    
+    uint32_t free_head;
+    uint32_t next_seq;
+    uint64_t current_tick;
+    
+    size_t len;
+    uint32_t dropped;
+};
+
+internal inline void timer_wheel_init(Timer_Wheel *wheel, uint64_t now_ns)
+{
+    for (uint32_t i = 0; i < TIMER_WHEEL_NODES_LEN; ++i) {
+        wheel->nodes[i].next = i + 1 < TIMER_WHEEL_NODES_LEN ? i + 1 : TIMER_WHEEL_NIL;
+        wheel->nodes[i].generation = 0;
+    }
+
+    for (size_t i = 0; i < TIMER_WHEEL_LISTS_LEN; ++i) {
+        wheel->lists[i].head = TIMER_WHEEL_NIL;
+        wheel->lists[i].tail = TIMER_WHEEL_NIL;
+    }
+
+    for (size_t i = 0; i < TIMER_WHEEL_LEVELS; ++i) {
+        wheel->occupied[i] = 0;
+    }
+    
+    wheel->free_head = 0;
+    wheel->next_seq = 0;
+    wheel->current_tick = now_ns / TIMER_WHEEL_TICK_NS;
+    wheel->len = 0;
+    wheel->dropped = 0;
+}
+
+internal inline void timer_wheel_unlink(Timer_Wheel *wheel, uint32_t index)
+{
+    Timer_Node *node = &wheel->nodes[index];
+    Timer_List *list = &wheel->lists[node->list];
+
+    if (node->prev != TIMER_WHEEL_NIL) wheel->nodes[node->prev].next = node->next;
+    else list->head = node->next;
+    
+    if (node->next != TIMER_WHEEL_NIL) wheel->nodes[node->next].prev = node->prev;
+    else list->tail = node->prev;
+
+    if (list->head == TIMER_WHEEL_NIL && node->list < TIMER_WHEEL_READY_LIST) {
+        uint32_t level = node->list / TIMER_WHEEL_SLOTS;
+        uint32_t slot = node->list % TIMER_WHEEL_SLOTS;
+        wheel->occupied[level] &= ~(1ull << slot);
+    }
+}
+
+internal inline void timer_wheel_append(Timer_Wheel *wheel, uint32_t list_index, uint32_t index)
+{
+    Timer_Node *node = &wheel->nodes[index];
+    Timer_List *list = &wheel->lists[list_index];
+
+    node->list = (uint16_t) list_index;
+    node->next = TIMER_WHEEL_NIL;
+    node->prev = list->tail;
+    
+    if (list->tail != TIMER_WHEEL_NIL) wheel->nodes[list->tail].next = index;
+    else list->head = index;
+    list->tail = index;
+
+    if (list_index < TIMER_WHEEL_READY_LIST) {
+        wheel->occupied[list_index / TIMER_WHEEL_SLOTS] |= 1ull << (list_index % TIMER_WHEEL_SLOTS);
+    }
+}
+
+internal inline bool timer_node_before(const Timer_Node *a, const Timer_Node *b)
+{
+    if (a->event.time_ns != b->event.time_ns) return(a->event.time_ns < b->event.time_ns);
+
+    return((int32_t) (a->seq - b->seq) < 0);
+}
+
+internal inline void timer_wheel_make_ready(Timer_Wheel *wheel, uint32_t index)
+{
+    Timer_List *ready = &wheel->lists[TIMER_WHEEL_READY_LIST];
+    Timer_Node *node = &wheel->nodes[index];
+
+    uint32_t after = ready->tail;
+    while (after != TIMER_WHEEL_NIL && timer_node_before(node, &wheel->nodes[after])) {
+        after = wheel->nodes[after].prev;
+    }
+
+    node->list = TIMER_WHEEL_READY_LIST;
+    node->prev = after;
+    
+    if (after == TIMER_WHEEL_NIL) {
+        node->next = ready->head;
+        ready->head = index;
+    } else {
+        node->next = wheel->nodes[after].next;
+        wheel->nodes[after].next = index;
+    }
+
+    if (node->next != TIMER_WHEEL_NIL) wheel->nodes[node->next].prev = index;
+    else ready->tail = index;
+}
+
+// @Note: Puts a node in the slot matching how far out it is.
+internal inline void timer_wheel_place(Timer_Wheel *wheel, uint32_t index)
+{
+    uint64_t expiry = wheel->nodes[index].event.time_ns / TIMER_WHEEL_TICK_NS;
+    if (expiry <= wheel->current_tick) {
+        timer_wheel_make_ready(wheel, index);
+        return;
+    }
+
+    uint64_t delta = expiry - wheel->current_tick;
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        uint32_t shift = level*TIMER_WHEEL_SLOT_BITS;
+        bool last = level == TIMER_WHEEL_LEVELS - 1;
+        
+        if (delta < (1ull << (shift + TIMER_WHEEL_SLOT_BITS)) || last) {
+            // @Note: Past the horizon, park it in the furthest slot, it'll be
+            // placed again when that slot cascades.
+            if (last && delta >= (1ull << (shift + TIMER_WHEEL_SLOT_BITS))) {
+                expiry = wheel->current_tick + (1ull << (shift + TIMER_WHEEL_SLOT_BITS)) - 1;
+            }
+            
+            uint32_t slot = (uint32_t) ((expiry >> shift) & (TIMER_WHEEL_SLOTS - 1));
+            timer_wheel_append(wheel, level*TIMER_WHEEL_SLOTS + slot, index);
+            return;
+        }
+    }
+}
+
+internal inline Timer_Handle timer_wheel_insert(Timer_Wheel *wheel, Key_Event event)
+{
+    Timer_Handle handle = { TIMER_WHEEL_NIL, 0 };
+    
+    if (wheel->free_head == TIMER_WHEEL_NIL) {
+        wheel->dropped += 1;
+        return(handle);
+    }
+
+    uint32_t index = wheel->free_head;
+    Timer_Node *node = &wheel->nodes[index];
+    wheel->free_head = node->next;
+
+    node->event = event;
+    node->seq = wheel->next_seq++;
+    timer_wheel_place(wheel, index);
+    wheel->len += 1;
+
+    handle.index = index;
+    handle.generation = node->generation;
+    
+    return(handle);
+}
+
+internal inline void timer_wheel_release(Timer_Wheel *wheel, uint32_t index)
+{
+    Timer_Node *node = &wheel->nodes[index];
+    node->generation += 1;
+    node->next = wheel->free_head;
+    wheel->free_head = index;
+    wheel->len -= 1;
+}
+
+// @Note: Does nothing if the event already went out (or was cancelled before).
+internal inline bool timer_wheel_cancel(Timer_Wheel *wheel, Timer_Handle handle)
+{
+    if (handle.index >= TIMER_WHEEL_NODES_LEN) return(false);
+    if (wheel->nodes[handle.index].generation != handle.generation) return(false);
+
+    timer_wheel_unlink(wheel, handle.index);
+    timer_wheel_release(wheel, handle.index);
+    
+    return(true);
+}
+
+internal inline void timer_wheel_cascade(Timer_Wheel *wheel, uint32_t level)
+{
+    uint32_t shift = level*TIMER_WHEEL_SLOT_BITS;
+    uint32_t slot = (uint32_t) ((wheel->current_tick >> shift) & (TIMER_WHEEL_SLOTS - 1));
+    uint32_t list_index = level*TIMER_WHEEL_SLOTS + slot;
+    
+    uint32_t index = wheel->lists[list_index].head;
+    wheel->lists[list_index].head = TIMER_WHEEL_NIL;
+    wheel->lists[list_index].tail = TIMER_WHEEL_NIL;
+    wheel->occupied[level] &= ~(1ull << slot);
+
+    while (index != TIMER_WHEEL_NIL) {
+        uint32_t next = wheel->nodes[index].next;
+        timer_wheel_place(wheel, index);
+        index = next;
+    }
+}
+
+// @Note: Moves everything that expired up to 'now_ns' onto the ready list.
+internal inline void timer_wheel_advance(Timer_Wheel *wheel, uint64_t now_ns)
+{
+    uint64_t target = now_ns / TIMER_WHEEL_TICK_NS;
+    
+    if (wheel->len == 0) {
+        if (target > wheel->current_tick) wheel->current_tick = target;
+        return;
+    }
+
+    while (wheel->current_tick < target) {
+        // @Note: Jump straight to whichever comes first, the next occupied slot
+        // on the first level or the next cascade, the ticks in between are empty.
+        uint64_t next = (wheel->current_tick | (TIMER_WHEEL_SLOTS - 1)) + 1;
+        if (wheel->occupied[0]) {
+            uint64_t position = wheel->current_tick & (TIMER_WHEEL_SLOTS - 1);
+            uint64_t slot_tick = wheel->current_tick + timer_wheel_slots_until(wheel->occupied[0], position);
+            if (slot_tick < next) next = slot_tick;
+        }
+        
+        if (next > target) {
+            wheel->current_tick = target;
+            break;
+        }
+        
+        wheel->current_tick = next;
+
+        for (uint32_t level = TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+            uint64_t mask = (1ull << (level*TIMER_WHEEL_SLOT_BITS)) - 1;
+            if ((wheel->current_tick & mask) == 0) timer_wheel_cascade(wheel, level);
+        }
+
+        timer_wheel_cascade(wheel, 0);
+    }
+}
+
+// @Note: Lower bound on when the next event is due, exact when something
+// is already ready. Anything past the first level reports when its slot
+// cascades, so the caller wakes up, advances and asks again.
+internal inline uint64_t timer_wheel_next_due(const Timer_Wheel *wheel)
+{
+    const Timer_List *ready = &wheel->lists[TIMER_WHEEL_READY_LIST];
+    if (ready->head != TIMER_WHEEL_NIL) return(wheel->nodes[ready->head].event.time_ns);
+    if (wheel->len == 0) return(UINT64_MAX);
+
+    uint64_t next_tick = UINT64_MAX;
+    
+    // @Note: Every level has to be checked, a slot cascading soon on a higher
+    // level can still come before a far away slot on a lower one.
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        uint64_t occupied = wheel->occupied[level];
+        if (occupied == 0) continue;
+
+        uint32_t shift = level*TIMER_WHEEL_SLOT_BITS;
+        uint64_t position = (wheel->current_tick >> shift) & (TIMER_WHEEL_SLOTS - 1);
+        
+        uint64_t tick = ((wheel->current_tick >> shift) + timer_wheel_slots_until(occupied, position)) << shift;
+        if (tick < next_tick) next_tick = tick;
+    }
+
+    return(next_tick*TIMER_WHEEL_TICK_NS);
+}
+
+internal inline const Key_Event *timer_wheel_peek_ready(const Timer_Wheel *wheel)
+{
+    uint32_t head = wheel->lists[TIMER_WHEEL_READY_LIST].head;
+    if (head == TIMER_WHEEL_NIL) return(0);
+
+    return(&wheel->nodes[head].event);
+}
+
+internal inline void timer_wheel_pop_ready(Timer_Wheel *wheel, Key_Event *event)
+{
+    uint32_t head = wheel->lists[TIMER_WHEEL_READY_LIST].head;
+    *event = wheel->nodes[head].event;
+    
+    timer_wheel_unlink(wheel, head);
+    timer_wheel_release(wheel, head);
+}
+
+#endif // TIMER_WHEEL_H
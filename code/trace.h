@@ -0,0 +1,120 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+
+// @Note: Binary trace of what every MIDI event went through, for looking at
+// a bad session after the fact (see trace_tool.cpp). Each thread that does
+// pipeline work writes fixed-size records into its own single-producer ring
+// and a writer thread appends them to the trace file, so tracing costs a
+// clock read and a 32 byte copy per stage and never waits on anything.
+// A full ring drops the record and counts it.
+//
+// Records from different threads land in the file in whatever order the
+// writer drained them, sort by 'time_ns' before reading them as a timeline.
+//
+// File layout: a Trace_File_Header, then records until the end of the file.
+
+#define TRACE_MAGIC 0x4352544D // @Note: "MTRC"
+#define TRACE_VERSION 1
+#define TRACE_BUFFER_LEN 8192 // @Note: Must be a power of two.
+
+enum Trace_Stage {
+    TRACE_RECEIVE = 0, // @Note: In the MIDI callback, 'data' is the packed message.
+    TRACE_DECODE, // @Note: Popped off the queue by the injection thread, 'data' is the packed message.
+    TRACE_FILTER, // @Note: 'due_ns' is when the note may go out.
+    TRACE_MAP, // @Note: 'data' is the key (KEY_COMBO()), 0 if the note isn't mapped.
+    TRACE_SCHEDULE, // @Note: Key event into the wheel, 'data' is vk | flags << 16.
+    TRACE_INJECT, // @Note: Key event sent, 'data' is vk | flags << 16, 'due_ns' when it was due.
+    TRACE_STAGE_COUNT,
+};
+
+enum Trace_Result {
+    TRACE_OK = 0,
+    TRACE_DROPPED, // @Note: Receive filter.
+    TRACE_QUEUE_FULL,
+    TRACE_FILTERED, // @Note: Debounce or re-trigger.
+    TRACE_DELAYED, // @Note: Re-trigger, held back until 'due_ns'.
+    TRACE_UNMAPPED,
+    TRACE_OUT_OF_RANGE,
+    TRACE_FAILED, // @Note: SendInput didn't take it.
+    TRACE_RESULT_COUNT,
+};
+
+global const char *const trace_stage_names[TRACE_STAGE_COUNT] = {
+    "receive", "decode", "filter", "map", "schedule", "inject",
+};
+
+global const char *const trace_result_names[TRACE_RESULT_COUNT] = {
+    "ok", "dropped", "queue full", "filtered", "delayed", "unmapped", "out of range", "failed",
+};
+
+struct Trace_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t start_ns; // @Note: When tracing started, same clock as the records.
+};
+
+struct Trace_Record {
+    uint64_t time_ns; // @Note: When the stage ran.
+    uint64_t event_ns; // @Note: When the MIDI event it belongs to came in, 0 if it isn't known.
+    uint64_t due_ns;
+    uint32_t data;
+    uint8_t stage;
+    uint8_t result;
+    uint8_t note;
+    uint8_t reserved;
+};
+
+struct Trace_Buffer {
+    Trace_Record records[TRACE_BUFFER_LEN];
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<uint32_t> dropped;
+    std::atomic<bool> enabled;
+};
+
+internal inline void trace_emit(Trace_Buffer *buffer, int stage, int result, int note, uint32_t data, uint64_t event_ns, uint64_t due_ns)
+{
+    if (buffer == 0 || !buffer->enabled.load(std::memory_order_relaxed)) return;
+
+    size_t head = buffer->head.load(std::memory_order_relaxed);
+    size_t tail = buffer->tail.load(std::memory_order_acquire);
+
+    if (head - tail >= TRACE_BUFFER_LEN) {
+        buffer->dropped.store(buffer->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    Trace_Record *record = &buffer->records[head & (TRACE_BUFFER_LEN - 1)];
+    record->time_ns = get_time_ns();
+    record->event_ns = event_ns;
+    record->due_ns = due_ns;
+    record->data = data;
+    record->stage = (uint8_t) stage;
+    record->result = (uint8_t) result;
+    record->note = (uint8_t) note;
+    record->reserved = 0;
+
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+// @Note: Copies out up to 'cap' records, only the writer thread calls this.
+internal inline size_t trace_drain(Trace_Buffer *buffer, Trace_Record *out, size_t cap)
+{
+    size_t tail = buffer->tail.load(std::memory_order_relaxed);
+    size_t head = buffer->head.load(std::memory_order_acquire);
+    size_t count = 0;
+
+    while (tail != head && count < cap) {
+        out[count++] = buffer->records[tail & (TRACE_BUFFER_LEN - 1)];
+        tail += 1;
+    }
+
+    buffer->tail.store(tail, std::memory_order_release);
+    return(count);
+}
+
+#endif // TRACE_H
@@ -0,0 +1,288 @@
+// @Note: Offline reader for the traces maidai writes with F7 / --trace (see
+// trace.h). Plain C++ and stdio only, so it builds anywhere the trace file
+// ends up, not just on the machine that recorded it.
+//
+// Usage: maidai-trace <file.trace> [summary|timeline] [max lines]
+//
+//     summary   counts per stage and result, latency percentiles per stage,
+//               how late key events went out and everything that was dropped
+//     timeline  one line per note on: what it mapped to and when its key
+//               actually went down
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "./base.h"
+#include "./timer.h"
+#include "./midi.h"
+#include "./vk.h"
+#include "./config.h"
+#include "./timer_wheel.h"
+#include "./trace.h"
+
+// @Note: Everything the trace knows about one MIDI event, keyed by when it came in.
+struct Trace_Event {
+    uint64_t event_ns;
+    uint32_t packed;
+    int filter_result;
+    int map_result;
+    uint32_t key;
+    uint64_t scheduled_ns; // @Note: When its first key down was due.
+    uint64_t injected_ns; // @Note: When its first key down was actually sent.
+};
+
+struct Trace_File {
+    Trace_File_Header header;
+    std::vector<Trace_Record> records;
+};
+
+internal bool read_trace_file(const char *path, Trace_File *trace)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open '%s'\n", path);
+        return(false);
+    }
+
+    bool result = false;
+    if (fread(&trace->header, sizeof(trace->header), 1, file) == 1 && trace->header.magic == TRACE_MAGIC &&
+        trace->header.version == TRACE_VERSION && trace->header.record_size == sizeof(Trace_Record)) {
+        Trace_Record record = {0};
+        while (fread(&record, sizeof(record), 1, file) == 1) trace->records.push_back(record);
+
+        result = true;
+    } else {
+        fprintf(stderr, "'%s' isn't a trace this version can read\n", path);
+    }
+
+    fclose(file);
+
+    // @Note: Every thread's records come in batches, see trace.h.
+    std::stable_sort(trace->records.begin(), trace->records.end(), [](const Trace_Record &a, const Trace_Record &b) {
+        return(a.time_ns < b.time_ns);
+    });
+
+    return(result);
+}
+
+internal double ms_between(uint64_t from_ns, uint64_t to_ns)
+{
+    return((int64_t) (to_ns - from_ns)/1e6);
+}
+
+internal void format_note(int note, char *out, size_t size)
+{
+    const char *names[12] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+    snprintf(out, size, "%s%d", names[note % 12], note/12 - 1);
+}
+
+internal void format_key(uint32_t key, char *out, size_t size)
+{
+    int modifiers = KEY_MODS(key);
+    snprintf(out, size, "%s%s%s%s", (modifiers & KEY_MOD_CTRL) ? "Ctrl+" : "", (modifiers & KEY_MOD_ALT) ? "Alt+" : "",
+             (modifiers & KEY_MOD_SHIFT) ? "Shift+" : "", vk_translation[KEY_VK(key)]);
+}
+
+internal void print_distribution(const char *name, std::vector<double> *values)
+{
+    if (values->empty()) {
+        printf("  %-22s %8s\n", name, "-");
+        return;
+    }
+
+    std::sort(values->begin(), values->end());
+    size_t count = values->size();
+
+    printf("  %-22s %8zu %9.3f %9.3f %9.3f %9.3f\n", name, count,
+           (*values)[count/2], (*values)[count*9/10], (*values)[count*99/100], (*values)[count - 1]);
+}
+
+// @Note: Ties every record back to the event it came from. Key events don't
+// know their event, an inject is matched to the oldest schedule with the
+// same key and due time, a schedule without an event (strummed notes go out
+// later) to the last time its note was mapped.
+internal std::vector<Trace_Event> collect_events(const Trace_File *trace)
+{
+    std::vector<Trace_Event> events;
+    std::map<uint64_t, size_t> by_time;
+    std::map<std::pair<uint32_t, uint64_t>, std::vector<uint64_t>> scheduled;
+    uint64_t last_mapped[128] = {0};
+
+    for (const Trace_Record &record : trace->records) {
+        uint64_t event_ns = record.event_ns;
+
+        if (record.stage == TRACE_SCHEDULE) {
+            if (event_ns == 0) event_ns = last_mapped[record.note & 0x7F];
+            scheduled[std::make_pair(record.data, record.due_ns)].push_back(event_ns);
+        } else if (record.stage == TRACE_INJECT) {
+            std::vector<uint64_t> *waiting = &scheduled[std::make_pair(record.data, record.due_ns)];
+            if (waiting->empty()) continue;
+
+            event_ns = waiting->front();
+            waiting->erase(waiting->begin());
+        }
+
+        if (event_ns == 0) continue;
+
+        auto found = by_time.find(event_ns);
+        if (found == by_time.end()) {
+            Trace_Event event = {0};
+            event.event_ns = event_ns;
+            event.filter_result = -1;
+            event.map_result = -1;
+
+            found = by_time.insert(std::make_pair(event_ns, events.size())).first;
+            events.push_back(event);
+        }
+
+        Trace_Event *event = &events[found->second];
+        bool key_down = ((record.data >> 16) & KEY_EVENT_UP) == 0;
+
+        switch (record.stage) {
+        case TRACE_RECEIVE:
+        case TRACE_DECODE: {
+            event->packed = record.data;
+        } break;
+
+        case TRACE_FILTER: {
+            event->filter_result = record.result;
+        } break;
+
+        case TRACE_MAP: {
+            event->map_result = record.result;
+            event->key = record.data;
+            last_mapped[record.note & 0x7F] = event_ns;
+        } break;
+
+        case TRACE_SCHEDULE: {
+            if (key_down && event->scheduled_ns == 0) event->scheduled_ns = record.due_ns;
+        } break;
+
+        case TRACE_INJECT: {
+            if (key_down && event->injected_ns == 0) event->injected_ns = record.time_ns;
+        } break;
+        }
+    }
+
+    return(events);
+}
+
+internal void print_summary(const Trace_File *trace)
+{
+    const std::vector<Trace_Record> &records = trace->records;
+    uint64_t last_ns = records.empty() ? trace->header.start_ns : records.back().time_ns;
+
+    printf("%zu records over %.3f s\n\n", records.size(), ms_between(trace->header.start_ns, last_ns)/1000.0);
+
+    size_t counts[TRACE_STAGE_COUNT][TRACE_RESULT_COUNT] = {0};
+    std::vector<double> latencies[TRACE_STAGE_COUNT];
+    std::vector<double> lateness;
+
+    for (const Trace_Record &record : records) {
+        if (record.stage >= TRACE_STAGE_COUNT || record.result >= TRACE_RESULT_COUNT) continue;
+
+        counts[record.stage][record.result] += 1;
+        if (record.event_ns != 0) latencies[record.stage].push_back(ms_between(record.event_ns, record.time_ns));
+        if (record.stage == TRACE_INJECT) lateness.push_back(ms_between(record.due_ns, record.time_ns));
+    }
+
+    printf("Records per stage:\n");
+    for (int stage = 0; stage < TRACE_STAGE_COUNT; ++stage) {
+        printf("  %-10s", trace_stage_names[stage]);
+        for (int result = 0; result < TRACE_RESULT_COUNT; ++result) {
+            if (counts[stage][result] > 0) printf("  %s %zu", trace_result_names[result], counts[stage][result]);
+        }
+        printf("\n");
+    }
+
+    // @Note: Injects only know their event through the schedule, see 'collect_events()'.
+    std::vector<Trace_Event> events = collect_events(trace);
+    std::vector<double> end_to_end;
+    size_t notes = 0, lost = 0;
+
+    for (const Trace_Event &event : events) {
+        Midi_Message message = midi_decode(event.packed);
+        if (message.status != NOTE_ON || event.map_result != TRACE_OK) continue;
+
+        notes += 1;
+        if (event.injected_ns != 0) end_to_end.push_back(ms_between(event.event_ns, event.injected_ns));
+        else if (event.filter_result != TRACE_FILTERED) lost += 1;
+    }
+
+    printf("\nLatency from MIDI in, ms:  %8s %9s %9s %9s %9s\n", "count", "p50", "p90", "p99", "max");
+    for (int stage = 0; stage < TRACE_STAGE_COUNT; ++stage) {
+        if (stage == TRACE_INJECT) continue;
+        print_distribution(trace_stage_names[stage], &latencies[stage]);
+    }
+    print_distribution("note to key down", &end_to_end);
+    print_distribution("inject after due", &lateness);
+
+    printf("\nDropped:\n");
+    printf("  receive filter     %zu\n", counts[TRACE_RECEIVE][TRACE_DROPPED]);
+    printf("  queue full         %zu\n", counts[TRACE_RECEIVE][TRACE_QUEUE_FULL]);
+    printf("  debounce/retrigger %zu\n", counts[TRACE_FILTER][TRACE_FILTERED]);
+    printf("  out of range       %zu\n", counts[TRACE_MAP][TRACE_OUT_OF_RANGE]);
+    printf("  unmapped           %zu\n", counts[TRACE_MAP][TRACE_UNMAPPED]);
+    printf("  SendInput failed   %zu\n", counts[TRACE_INJECT][TRACE_FAILED]);
+    printf("  mapped notes without a key down: %zu of %zu\n", lost, notes);
+}
+
+internal void print_timeline(const Trace_File *trace, size_t max_lines)
+{
+    std::vector<Trace_Event> events = collect_events(trace);
+    size_t lines = 0;
+
+    printf("%10s  %-5s %3s  %-8s %-14s %9s %9s\n", "time s", "note", "vel", "filter", "key", "due ms", "sent ms");
+
+    for (const Trace_Event &event : events) {
+        Midi_Message message = midi_decode(event.packed);
+        if (message.status != NOTE_ON) continue;
+        if (lines++ >= max_lines) break;
+
+        char note[8] = {0};
+        char key[64] = "-";
+        char due[16] = "-";
+        char sent[16] = "-";
+
+        format_note(message.note, note, sizeof(note));
+        if (event.map_result == TRACE_OK) format_key(event.key, key, sizeof(key));
+        else if (event.map_result >= 0) snprintf(key, sizeof(key), "(%s)", trace_result_names[event.map_result]);
+
+        if (event.scheduled_ns != 0) snprintf(due, sizeof(due), "%+9.3f", ms_between(event.event_ns, event.scheduled_ns));
+        if (event.injected_ns != 0) snprintf(sent, sizeof(sent), "%+9.3f", ms_between(event.event_ns, event.injected_ns));
+
+        printf("%10.3f  %-5s %3d  %-8s %-14s %9s %9s\n", ms_between(trace->header.start_ns, event.event_ns)/1000.0,
+               note, message.velocity, event.filter_result >= 0 ? trace_result_names[event.filter_result] : "-", key, due, sent);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: maidai-trace <file.trace> [summary|timeline] [max lines]\n");
+        return 1;
+    }
+
+    const char *command = argc > 2 ? argv[2] : "summary";
+    size_t max_lines = argc > 3 ? (size_t) strtoull(argv[3], 0, 10) : (size_t) -1;
+
+    Trace_File trace = {};
+    if (!read_trace_file(argv[1], &trace)) return 1;
+
+    if (strcmp(command, "summary") == 0) {
+        print_summary(&trace);
+    } else if (strcmp(command, "timeline") == 0) {
+        print_timeline(&trace, max_lines);
+    } else {
+        fprintf(stderr, "Unknown command '%s'\n", command);
+        return 1;
+    }
+
+    return 0;
+}
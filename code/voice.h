@@ -0,0 +1,169 @@
+#ifndef VOICE_H
+#define VOICE_H
+
+// @Note: Turns a polyphonic song into one voice before it's mapped, for
+// games where a performer only gets one note at a time. It's a skyline: at
+// any point at most one note sounds, a new note takes over if it beats the
+// one that's sounding (see 'voice_wins()'), otherwise it's dropped. When the
+// sounding note ends, nothing takes its place until the next note on, a
+// note that's already being held never gets struck again halfway through.
+//
+// Note ons on the same time are one chord, they're held back until time
+// moves on and only the best of them plays, otherwise every chord would come
+// out as a burst of taps. That's the only buffering, it's one pass over
+// the events in order with O(1) work each, so it streams through files of
+// any size.
+//
+// VOICE_LONGEST needs to know how long a note is when it starts, the caller
+// fills that in from an earlier pass (see 'timeline_collect_durations()').
+
+enum Voice_Mode {
+    VOICE_ALL = 0, // @Note: No reduction.
+    VOICE_HIGHEST,
+    VOICE_LOUDEST,
+    VOICE_LONGEST,
+    VOICE_TRACK, // @Note: Notes from 'track' first, then the lowest track, then the highest note.
+    VOICE_MODE_COUNT,
+};
+
+global const char *const voice_mode_names[VOICE_MODE_COUNT] = { "all", "highest", "loudest", "longest", "track" };
+
+#define VOICE_OUT_LEN 3 // @Note: Most one event can turn into, a chord resolving plus itself.
+
+struct Voice_Note {
+    uint64_t duration_ns;
+    uint8_t note;
+    uint8_t velocity;
+    uint8_t channel;
+    uint8_t track;
+};
+
+struct Voice_Out {
+    uint64_t time_ns;
+    uint32_t packed;
+};
+
+struct Voice_Reducer {
+    int mode;
+    int track;
+
+    bool sounding;
+    Voice_Note current;
+
+    bool pending; // @Note: Best note on of the chord at 'pending_ns' so far.
+    uint64_t pending_ns;
+    Voice_Note candidate;
+
+    uint64_t dropped;
+};
+
+internal inline void voice_init(Voice_Reducer *reducer, int mode, int track)
+{
+    memset(reducer, 0, sizeof(*reducer));
+    reducer->mode = mode;
+    reducer->track = track;
+}
+
+// @Note: Does 'a' take over from 'b'? Ties go to the higher note, then to whoever was first.
+internal inline bool voice_wins(const Voice_Reducer *reducer, const Voice_Note *a, const Voice_Note *b)
+{
+    switch (reducer->mode) {
+    case VOICE_LOUDEST: {
+        if (a->velocity != b->velocity) return(a->velocity > b->velocity);
+    } break;
+
+    case VOICE_LONGEST: {
+        if (a->duration_ns != b->duration_ns) return(a->duration_ns > b->duration_ns);
+    } break;
+
+    case VOICE_TRACK: {
+        bool a_preferred = a->track == reducer->track;
+        bool b_preferred = b->track == reducer->track;
+        if (a_preferred != b_preferred) return(a_preferred);
+        if (a->track != b->track) return(a->track < b->track);
+    } break;
+    }
+
+    return(a->note > b->note);
+}
+
+internal inline uint32_t voice_pack(int status, const Voice_Note *note, int velocity)
+{
+    return((uint32_t) (status | note->channel) | ((uint32_t) note->note << 8) | ((uint32_t) velocity << 16));
+}
+
+internal inline int voice_resolve(Voice_Reducer *reducer, Voice_Out *out)
+{
+    if (!reducer->pending) return(0);
+    reducer->pending = false;
+
+    int count = 0;
+    if (reducer->sounding && !voice_wins(reducer, &reducer->candidate, &reducer->current)) {
+        reducer->dropped += 1;
+        return(0);
+    }
+
+    if (reducer->sounding) {
+        out[count++] = { reducer->pending_ns, voice_pack(NOTE_OFF, &reducer->current, 0) };
+    }
+
+    out[count++] = { reducer->pending_ns, voice_pack(NOTE_ON, &reducer->candidate, reducer->candidate.velocity) };
+    reducer->current = reducer->candidate;
+    reducer->sounding = true;
+
+    return(count);
+}
+
+// @Note: Feeds one event in time order, returns how many came out (up to
+// VOICE_OUT_LEN). Anything that isn't a note goes straight through.
+internal inline int voice_push(Voice_Reducer *reducer, uint64_t time_ns, uint32_t packed, const Voice_Note *note, Voice_Out *out)
+{
+    Midi_Message message = midi_decode(packed);
+    int count = 0;
+
+    if (reducer->mode == VOICE_ALL) {
+        out[0] = { time_ns, packed };
+        return(1);
+    }
+
+    if (reducer->pending && time_ns > reducer->pending_ns) count += voice_resolve(reducer, out);
+
+    if (message.status == NOTE_ON) {
+        if (!reducer->pending) {
+            reducer->pending = true;
+            reducer->pending_ns = time_ns;
+            reducer->candidate = *note;
+        } else if (voice_wins(reducer, note, &reducer->candidate)) {
+            reducer->candidate = *note;
+            reducer->dropped += 1;
+        } else {
+            reducer->dropped += 1;
+        }
+    } else if (message.status == NOTE_OFF) {
+        bool current = reducer->sounding && reducer->current.note == message.note && reducer->current.channel == message.channel;
+        bool waiting = reducer->pending && reducer->candidate.note == message.note && reducer->candidate.channel == message.channel;
+
+        if (current) {
+            out[count++] = { time_ns, packed };
+            reducer->sounding = false;
+        } else if (waiting) {
+            // @Note: Over before it started, it never plays.
+            reducer->pending = false;
+            reducer->dropped += 1;
+        }
+    } else {
+        out[count++] = { time_ns, packed };
+    }
+
+    return(count);
+}
+
+// @Note: At the end of the song, a chord on the very last tick is still waiting.
+internal inline int voice_flush(Voice_Reducer *reducer, Voice_Out *out)
+{
+    if (reducer->mode == VOICE_ALL) return(0);
+
+    return(voice_resolve(reducer, out));
+}
+
+#endif // VOICE_H